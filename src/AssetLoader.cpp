@@ -0,0 +1,306 @@
+#include "AssetLoader.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include "Parallel.hpp"
+
+namespace
+{
+
+// bump whenever the layout of the cache files changes
+const sf::Uint32 cacheVersion = 1;
+
+// cache files start with this header, followed by the RGBA pixels row by row
+struct CacheHeader
+{
+    char       magic[4] = {'Q', 'R', 'G', 'B'};
+    sf::Uint32 version  = cacheVersion;
+    sf::Uint32 width;
+    sf::Uint32 height;
+    sf::Uint64 hash; // hash of the file the pixels were decoded from
+};
+
+// 64 bit FNV-1a, which is plenty to tell edited assets apart
+sf::Uint64 hashBytes(const std::vector<char> &bytes)
+{
+    sf::Uint64 hash = 14695981039346656037ull;
+    for (char byte : bytes) {
+        hash ^= static_cast<sf::Uint8>(byte);
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// cache files are named after the hash of the image they were decoded from
+std::string getCacheName(sf::Uint64 hash)
+{
+    return fmt::format("{:016x}.rgba", hash);
+}
+
+bool readFile(const std::string &filename, std::vector<char> &bytes)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    bytes.resize(file.tellg());
+    file.seekg(0);
+    file.read(bytes.data(), bytes.size());
+
+    return file.good();
+}
+
+} // namespace
+
+AssetLoader::AssetLoader(const std::string &cacheDirectory)
+{
+    m_cacheDirectory = cacheDirectory;
+
+    std::error_code error;
+    std::filesystem::create_directories(m_cacheDirectory, error);
+    if (error) {
+        spdlog::error("AssetLoader::AssetLoader: failed to create {}: {}", m_cacheDirectory, error.message());
+    }
+}
+
+void AssetLoader::add(const std::string &filename, Kind kind)
+{
+    if (m_assets.count(filename)) {
+        return;
+    }
+
+    auto &asset  = m_assets[filename];
+    asset.kind   = kind;
+    asset.loaded = false;
+    asset.cached = false;
+    asset.hash   = 0;
+}
+
+void AssetLoader::addImage(const std::string &filename)
+{
+    add(filename, Kind::IMAGE);
+}
+
+void AssetLoader::addFont(const std::string &filename)
+{
+    add(filename, Kind::FONT);
+}
+
+void AssetLoader::addPrefab(const std::string &filename)
+{
+    add(filename, Kind::PREFAB);
+}
+
+bool AssetLoader::load(sf::Uint32 threads)
+{
+    sf::Clock clock;
+
+    // the map is not changed while loading, so the workers can each fill in
+    // their own asset without locking
+    std::vector<std::pair<const std::string *, Asset *>> pending;
+    for (auto &[filename, asset] : m_assets) {
+        if (!asset.loaded) {
+            pending.emplace_back(&filename, &asset);
+        }
+    }
+
+    parallelForEach(
+        0, pending.size(), [&](sf::Uint32 i) { load(*pending[i].first, *pending[i].second); }, threads);
+
+    sf::Uint32 loaded = 0;
+    sf::Uint32 cached = 0;
+    for (auto [filename, asset] : pending) {
+        loaded += asset->loaded;
+        cached += asset->cached;
+    }
+
+    spdlog::info("AssetLoader::load: loaded {} of {} assets, {} images from the cache, in {}ms",
+                 loaded,
+                 pending.size(),
+                 cached,
+                 clock.getElapsedTime().asMilliseconds());
+
+    return loaded == pending.size();
+}
+
+void AssetLoader::load(const std::string &filename, Asset &asset) const
+{
+    switch (asset.kind) {
+    case Kind::IMAGE:
+        asset.loaded = loadImage(filename, asset);
+        break;
+    case Kind::FONT:
+        // SFML gives every font its own FreeType library, so fonts can be opened on any thread
+        asset.loaded = asset.font.loadFromFile(filename);
+        break;
+    case Kind::PREFAB:
+        asset.loaded = asset.prefab.loadPrefab(filename);
+        break;
+    }
+
+    if (!asset.loaded) {
+        spdlog::error("AssetLoader::load: failed to load {}", filename);
+    }
+}
+
+bool AssetLoader::loadImage(const std::string &filename, Asset &asset) const
+{
+    // the file has to be read to hash it anyway, so it is decoded from memory
+    std::vector<char> bytes;
+    if (!readFile(filename, bytes)) {
+        return false;
+    }
+
+    sf::Uint64 hash      = hashBytes(bytes);
+    auto       cacheFile = (std::filesystem::path(m_cacheDirectory) / getCacheName(hash)).string();
+
+    asset.hash = hash;
+
+    if (readCache(cacheFile, hash, asset.image)) {
+        asset.cached = true;
+        return true;
+    }
+
+    if (!asset.image.loadFromMemory(bytes.data(), bytes.size())) {
+        return false;
+    }
+
+    writeCache(cacheFile, hash, asset.image);
+
+    return true;
+}
+
+void AssetLoader::pruneCache() const
+{
+    std::set<std::string> current;
+    for (const auto &[filename, asset] : m_assets) {
+        if (asset.kind == Kind::IMAGE && asset.loaded) {
+            current.insert(getCacheName(asset.hash));
+        }
+    }
+
+    // files are collected before any is removed, so the directory does not
+    // change while it is being listed
+    std::vector<std::filesystem::path> stale;
+    std::error_code                    error;
+    for (const auto &entry : std::filesystem::directory_iterator(m_cacheDirectory, error)) {
+        if (entry.path().extension() == ".rgba" && !current.count(entry.path().filename().string())) {
+            stale.push_back(entry.path());
+        }
+    }
+
+    if (error) {
+        spdlog::error("AssetLoader::pruneCache: failed to list {}: {}", m_cacheDirectory, error.message());
+        return;
+    }
+
+    for (const auto &path : stale) {
+        if (!std::filesystem::remove(path, error)) {
+            spdlog::error("AssetLoader::pruneCache: failed to remove {}: {}", path.string(), error.message());
+        }
+    }
+
+    if (!stale.empty()) {
+        spdlog::info("AssetLoader::pruneCache: removed {} stale files from {}", stale.size(), m_cacheDirectory);
+    }
+}
+
+bool AssetLoader::readCache(const std::string &cacheFile, sf::Uint64 hash, sf::Image &image) const
+{
+    std::ifstream file(cacheFile, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    CacheHeader expected;
+    CacheHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!file.good() || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != cacheVersion || header.hash != hash)
+    {
+        return false;
+    }
+
+    std::vector<sf::Uint8> pixels(static_cast<size_t>(header.width) * header.height * 4);
+    file.read(reinterpret_cast<char *>(pixels.data()), pixels.size());
+    if (!file.good()) {
+        return false;
+    }
+
+    image.create(header.width, header.height, pixels.data());
+
+    return true;
+}
+
+void AssetLoader::writeCache(const std::string &cacheFile, sf::Uint64 hash, const sf::Image &image) const
+{
+    // write to a file of our own and rename it into place, so that no other
+    // thread or instance of the game ever reads a partly written cache file
+    auto temporary = fmt::format("{}.{}.tmp", cacheFile, std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    CacheHeader header;
+    header.width  = image.getSize().x;
+    header.height = image.getSize().y;
+    header.hash   = hash;
+
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(image.getPixelsPtr()),
+                   static_cast<size_t>(header.width) * header.height * 4);
+
+        if (!file.good()) {
+            spdlog::error("AssetLoader::writeCache: failed to write {}", temporary);
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, cacheFile, error);
+    if (error) {
+        spdlog::error("AssetLoader::writeCache: failed to write {}: {}", cacheFile, error.message());
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+const sf::Image *AssetLoader::getImage(const std::string &filename) const
+{
+    auto it = m_assets.find(filename);
+    if (it == m_assets.end() || !it->second.loaded || it->second.kind != Kind::IMAGE) {
+        return nullptr;
+    }
+
+    return &it->second.image;
+}
+
+const sf::Font *AssetLoader::getFont(const std::string &filename) const
+{
+    auto it = m_assets.find(filename);
+    if (it == m_assets.end() || !it->second.loaded || it->second.kind != Kind::FONT) {
+        return nullptr;
+    }
+
+    return &it->second.font;
+}
+
+const RoomShape *AssetLoader::getPrefab(const std::string &filename) const
+{
+    auto it = m_assets.find(filename);
+    if (it == m_assets.end() || !it->second.loaded || it->second.kind != Kind::PREFAB) {
+        return nullptr;
+    }
+
+    return &it->second.prefab;
+}
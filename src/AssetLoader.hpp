@@ -0,0 +1,87 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <SFML/Graphics.hpp>
+
+#include "RoomShape.hpp"
+
+// AssetLoader loads every asset the game needs at startup in parallel, instead
+// of each class reading and decoding its own files one after another.
+//
+// Assets are registered with the add methods and then loaded together by load,
+// which reads, decodes and parses them on worker threads. Nothing it does
+// touches the GPU, so the callers upload textures from the decoded images on
+// the main thread afterwards.
+//
+// Decoding PNGs is most of the startup cost, so decoded images are also written
+// to an on-disk cache of raw RGBA pixels, keyed by a hash of the file contents.
+// On later starts an unchanged image is read straight from the cache, and an
+// edited one misses the cache because its hash changes. Each cache file records
+// the cache format version, and files from another version are ignored and
+// rewritten. Files left behind by images that were edited or removed are
+// deleted by pruneCache.
+class AssetLoader
+{
+    private:
+        enum class Kind
+        {
+            IMAGE,
+            FONT,
+            PREFAB,
+        };
+
+        struct Asset
+        {
+            Kind       kind;
+            bool       loaded;
+            bool       cached; // image came from the cache
+            sf::Uint64 hash;   // hash of the image file, which names its cache file
+            sf::Image  image;
+            sf::Font   font;
+            RoomShape  prefab;
+        };
+
+        std::string                  m_cacheDirectory; // directory of decoded image files
+        std::map<std::string, Asset> m_assets;         // assets by file name
+
+        // register an asset of a kind, once
+        void add(const std::string &filename, Kind kind);
+
+        // load one asset, on a worker thread
+        void load(const std::string &filename, Asset &asset) const;
+
+        // decode an image, through the cache
+        bool loadImage(const std::string &filename, Asset &asset) const;
+
+        // read a decoded image from the cache, if it holds the file with this hash
+        bool readCache(const std::string &cacheFile, sf::Uint64 hash, sf::Image &image) const;
+
+        // write a decoded image to the cache
+        void writeCache(const std::string &cacheFile, sf::Uint64 hash, const sf::Image &image) const;
+
+    public:
+        // decoded images are cached in cacheDirectory, which is created if needed
+        AssetLoader(const std::string &cacheDirectory = ".cache/assets");
+        ~AssetLoader() = default;
+
+        // register assets to load
+        void addImage(const std::string &filename);
+        void addFont(const std::string &filename);
+        void addPrefab(const std::string &filename);
+
+        // load every registered asset that is not loaded yet, using threads workers
+        // or every hardware thread if 0. Returns false if any of them failed to load.
+        bool load(sf::Uint32 threads = 0);
+
+        // delete the cache files of images that are not loaded, such as old
+        // versions of edited images, so the cache does not grow forever. Call it
+        // after every image has been registered and loaded.
+        void pruneCache() const;
+
+        // get a loaded asset, or null if it was not registered or failed to load
+        const sf::Image *getImage(const std::string &filename) const;
+        const sf::Font  *getFont(const std::string &filename) const;
+        const RoomShape *getPrefab(const std::string &filename) const;
+};
@@ -0,0 +1,238 @@
+#include "AssetWatcher.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// the key a file is watched under, the same however its path was spelled
+std::string normalize(const std::filesystem::path &path)
+{
+    return path.lexically_normal().string();
+}
+
+// the directory a file is in, "." for a bare file name
+std::filesystem::path getDirectory(const std::string &filename)
+{
+    auto directory = std::filesystem::path(filename).parent_path();
+    return directory.empty() ? std::filesystem::path(".") : directory;
+}
+
+} // namespace
+
+AssetWatcher::AssetWatcher()
+{
+    m_inotify = -1;
+    m_wake    = -1;
+
+#if defined(__linux__)
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wake    = eventfd(0, EFD_CLOEXEC);
+
+    if (m_inotify < 0 || m_wake < 0) {
+        spdlog::error("AssetWatcher::AssetWatcher: failed to set up inotify: {}", std::strerror(errno));
+        return;
+    }
+
+    m_thread = std::thread(&AssetWatcher::run, this);
+#else
+    spdlog::info("AssetWatcher::AssetWatcher: hot reloading is not supported on this platform");
+#endif
+}
+
+AssetWatcher::~AssetWatcher()
+{
+#if defined(__linux__)
+    if (m_thread.joinable()) {
+        sf::Uint64 one = 1;
+        if (write(m_wake, &one, sizeof(one)) != sizeof(one)) {
+            spdlog::error("AssetWatcher::~AssetWatcher: failed to wake the watcher thread");
+        }
+        m_thread.join();
+    }
+
+    if (m_inotify >= 0) {
+        close(m_inotify);
+    }
+
+    if (m_wake >= 0) {
+        close(m_wake);
+    }
+#endif
+}
+
+void AssetWatcher::watchDirectory(const std::string &filename)
+{
+#if defined(__linux__)
+    if (m_inotify < 0) {
+        return;
+    }
+
+    auto directory = getDirectory(filename);
+
+    // watching a directory twice returns the same descriptor, so this is harmless
+    int watch = inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) {
+        spdlog::error("AssetWatcher::watchDirectory: failed to watch {}: {}", directory.string(), std::strerror(errno));
+        return;
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_directories[watch] = directory.string();
+#else
+    (void)filename;
+#endif
+}
+
+void AssetWatcher::watchTilesheet(const std::string &filename, Tilemap *tilemap)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_watches[normalize(filename)] = Watch{tilemap, nullptr};
+    }
+
+    watchDirectory(filename);
+}
+
+void AssetWatcher::watchPrefab(const std::string &filename, std::function<void(const RoomShape &)> onReload)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_watches[normalize(filename)] = Watch{nullptr, std::move(onReload)};
+    }
+
+    watchDirectory(filename);
+}
+
+void AssetWatcher::run()
+{
+#if defined(__linux__)
+    pollfd descriptors[2] = {{m_inotify, POLLIN, 0}, {m_wake, POLLIN, 0}};
+
+    alignas(inotify_event) char buffer[4096];
+
+    while (true) {
+        if (poll(descriptors, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            spdlog::error("AssetWatcher::run: poll failed: {}", std::strerror(errno));
+            return;
+        }
+
+        if (descriptors[1].revents & POLLIN) {
+            return;
+        }
+
+        ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        // one save can produce several events, so each file is decoded once per batch
+        std::vector<std::string> changed;
+        {
+            std::lock_guard lock(m_mutex);
+
+            for (ssize_t offset = 0; offset < length;) {
+                auto *event = reinterpret_cast<inotify_event *>(buffer + offset);
+                offset     += sizeof(inotify_event) + event->len;
+
+                auto directory = m_directories.find(event->wd);
+                if (event->len == 0 || directory == m_directories.end()) {
+                    continue;
+                }
+
+                auto filename = normalize(std::filesystem::path(directory->second) / event->name);
+                if (m_watches.count(filename) && std::find(changed.begin(), changed.end(), filename) == changed.end()) {
+                    changed.push_back(filename);
+                }
+            }
+        }
+
+        for (const auto &filename : changed) {
+            reload(filename);
+        }
+    }
+#endif
+}
+
+void AssetWatcher::reload(const std::string &filename)
+{
+    sf::Clock clock;
+
+    bool isTilesheet;
+    {
+        std::lock_guard lock(m_mutex);
+        isTilesheet = m_watches[filename].tilemap != nullptr;
+    }
+
+    Reload reload;
+    reload.filename = filename;
+
+    if (isTilesheet) {
+        sf::Image image;
+        if (!image.loadFromFile(filename)) {
+            spdlog::error("AssetWatcher::reload: failed to decode {}, keeping the old tilesheet", filename);
+            return;
+        }
+
+        reload.image = std::move(image);
+    } else {
+        RoomShape prefab;
+        if (!prefab.loadPrefab(filename)) {
+            spdlog::error("AssetWatcher::reload: failed to load {}, keeping the old prefab", filename);
+            return;
+        }
+
+        reload.prefab = std::move(prefab);
+    }
+
+    spdlog::info("AssetWatcher::reload: decoded {} in {}ms", filename, clock.getElapsedTime().asMilliseconds());
+
+    std::lock_guard lock(m_mutex);
+    m_ready.push_back(std::move(reload));
+}
+
+void AssetWatcher::update()
+{
+    std::vector<std::pair<Watch, Reload>> ready;
+
+    {
+        // the background thread only holds the lock briefly, but the frame loop
+        // should not wait for it even then; anything missed is swapped in next frame
+        std::unique_lock lock(m_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || m_ready.empty()) {
+            return;
+        }
+
+        for (auto &reload : m_ready) {
+            ready.emplace_back(m_watches[reload.filename], std::move(reload));
+        }
+
+        m_ready.clear();
+    }
+
+    for (auto &[watch, reload] : ready) {
+        if (reload.image && watch.tilemap != nullptr) {
+            watch.tilemap->reloadTilesheet(*reload.image);
+        } else if (reload.prefab && watch.onPrefab) {
+            watch.onPrefab(*reload.prefab);
+        }
+
+        spdlog::info("AssetWatcher::update: reloaded {}", reload.filename);
+    }
+}
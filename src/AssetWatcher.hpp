@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "RoomShape.hpp"
+#include "Tilemap.hpp"
+
+// AssetWatcher reloads assets while the game is running, so that editing a
+// tilesheet or a prefab no longer means restarting and regenerating everything.
+//
+// The directories holding the watched files are watched with inotify on a
+// background thread. When a watched file is written, or replaced by renaming a
+// new file over it as most editors do, that thread decodes it again. The frame
+// loop calls update() to swap the decoded assets in, so it never waits on the
+// disk or on PNG decoding; only the texture upload happens on the main thread.
+//
+// A reloaded tilesheet only invalidates the map tiles that use tiles whose
+// pixels actually changed (see Tilemap::reloadTilesheet).
+//
+// Hot reloading needs inotify, so on other platforms nothing is watched.
+class AssetWatcher
+{
+    private:
+        // what to do when a watched file changes
+        struct Watch
+        {
+            Tilemap                               *tilemap;  // tilemap whose tilesheet the file is, or null
+            std::function<void(const RoomShape &)> onPrefab; // called with a reloaded prefab
+        };
+
+        // a file decoded on the background thread, waiting to be swapped in
+        struct Reload
+        {
+            std::string              filename;
+            std::optional<sf::Image> image;
+            std::optional<RoomShape> prefab;
+        };
+
+        int                          m_inotify;     // inotify descriptor, or -1
+        int                          m_wake;        // eventfd that stops the background thread
+        std::thread                  m_thread;      // background thread decoding changed files
+        std::mutex                   m_mutex;       // guards the members below
+        std::map<std::string, Watch> m_watches;     // watched files by path
+        std::map<int, std::string>   m_directories; // watched directories by inotify watch descriptor
+        std::vector<Reload>          m_ready;       // decoded files waiting for update
+
+        // start watching the directory a file is in
+        void watchDirectory(const std::string &filename);
+
+        // wait for file changes and decode the files, until woken to stop
+        void run();
+
+        // decode a changed file and queue it for update
+        void reload(const std::string &filename);
+
+    public:
+        AssetWatcher();
+        ~AssetWatcher();
+
+        AssetWatcher(const AssetWatcher &)            = delete;
+        AssetWatcher &operator=(const AssetWatcher &) = delete;
+
+        // reload the tilesheet of a tilemap when its image file changes
+        void watchTilesheet(const std::string &filename, Tilemap *tilemap);
+
+        // reload a prefab room shape when its file changes. onReload is called from
+        // update with the new shape, and only if the file loaded without errors.
+        void watchPrefab(const std::string &filename, std::function<void(const RoomShape &)> onReload);
+
+        // swap in every asset that finished reloading since the last call. Call once
+        // per frame from the thread that owns the window.
+        void update();
+};
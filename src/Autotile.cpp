@@ -1,7 +1,31 @@
 #include "Autotile.hpp"
 
+#include <array>
+
 #include <spdlog/spdlog.h>
 
+namespace
+{
+
+// bits of the 8 neighbour mask, in reading order
+enum Neighbour : sf::Uint8
+{
+    NORTH_WEST_CELL = 1,
+    NORTH_CELL      = 2,
+    NORTH_EAST_CELL = 4,
+    WEST_CELL       = 8,
+    EAST_CELL       = 16,
+    SOUTH_WEST_CELL = 32,
+    SOUTH_CELL      = 64,
+    SOUTH_EAST_CELL = 128
+};
+
+// The wall tiles in the tilesheet are chosen with a 4-bit mask of the directions
+// a wall connects to:
+//
+//   1        bit 0
+// 2   4      bit 1 and bit 2
+//   8        bit 3
 enum Direction
 {
     NONE                  = 0,
@@ -22,182 +46,162 @@ enum Direction
     NORTH_WEST_EAST_SOUTH = 15
 };
 
-Autotile::Autotile(Maze *maze, Tilemap *tilemap)
+constexpr std::array<sf::Uint32, 16> wallTiles = {
+    20, // NONE: a wall with no neighbors
+    50, // NORTH
+    17, // WEST
+    51, // NORTH_WEST
+    18, // EAST
+    48, // NORTH_EAST
+    2,  // WEST_EAST
+    49, // NORTH_WEST_EAST
+    33, // SOUTH
+    32, // NORTH_SOUTH
+    4,  // WEST_SOUTH
+    19, // NORTH_WEST_SOUTH
+    0,  // EAST_SOUTH
+    16, // NORTH_EAST_SOUTH
+    34, // WEST_EAST_SOUTH
+    1,  // NORTH_WEST_EAST_SOUTH
+};
+
+constexpr sf::Uint32 floorTile = 7;  // a floor tile
+constexpr sf::Uint32 voidTile  = 55; // a wall completely surrounded by walls
+
+// A diagonal neighbour only changes how a wall looks when both of the orthogonal
+// neighbours next to it are walls too, so dropping the other diagonals reduces
+// the 256 masks to the 47 that need distinct tiles.
+constexpr sf::Uint8 reduceMask(sf::Uint8 mask)
 {
-    m_tilemap = tilemap;
-    m_maze    = maze;
-    m_walls.reserve(16);
-
-    // wall tiles are calculated based on their neighor using a bitmask. The
-    // bitmask is calculated by setting the bit to 1 if the neighbor is a wall
-    // and 0 if the neighbor is a floor. The bits are set in the following order:
-    //
-    //   1        bit 0
-    // 2   4      bit 1 and bit 2
-    //   8        bit 3
-    //
-    // this is a 4-bit number, so there are 16 possible combinations. The
-    // wall tiles are calculated by iterating over the bitmask and setting
-    // the wall tile based on the bitmask. The wall tiles are stored in a vector
-    // and the index of the vector is the bitmask.
-    //
-    // 0 represents a wall with no neighbors
-
-    m_walls[NONE]                  = 20; // a wall with no neighbors
-    m_walls[NORTH]                 = 50; // a wall with a neighbor to the north
-    m_walls[WEST]                  = 17; // a wall with a neighbor to the west
-    m_walls[NORTH_WEST]            = 51; // a wall with neighbors to the north and west
-    m_walls[EAST]                  = 18; // a wall with a neighbor to the east
-    m_walls[NORTH_EAST]            = 48; // a wall with neighbors to the north and east
-    m_walls[WEST_EAST]             = 2;  // a wall with neighbors to the west and east
-    m_walls[NORTH_WEST_EAST]       = 49; // a wall with neighbors to the north, west, and east
-    m_walls[SOUTH]                 = 33; // a wall with a neighbor to the south
-    m_walls[NORTH_SOUTH]           = 32; // a wall with neighbors to the north and south
-    m_walls[WEST_SOUTH]            = 4;  // a wall with neighbors to the west and south
-    m_walls[NORTH_WEST_SOUTH]      = 19; // a wall with neighbors to the north, west, and south
-    m_walls[EAST_SOUTH]            = 0;  // a wall with neighbors to the east and south
-    m_walls[NORTH_EAST_SOUTH]      = 16; // a wall with neighbors to the north, east, and south
-    m_walls[WEST_EAST_SOUTH]       = 34; // a wall with neighbors to the west, east, and south
-    m_walls[NORTH_WEST_EAST_SOUTH] = 1;  // a wall with neighbors to the north, west, east, and south
-
-    m_floor = 7;  // a floor tile
-    m_void  = 55; // if a tile is completely surrounded by walls, it is a void tile
+    auto keep = [mask](sf::Uint8 diagonal, sf::Uint8 first, sf::Uint8 second) {
+        return (mask & first) && (mask & second) ? diagonal : 0;
+    };
 
-    spdlog::info("Autotile::Autotile() initialized");
+    sf::Uint8 orthogonal = mask & (NORTH_CELL | WEST_CELL | EAST_CELL | SOUTH_CELL);
+
+    return orthogonal | keep(mask & NORTH_WEST_CELL, NORTH_CELL, WEST_CELL) |
+           keep(mask & NORTH_EAST_CELL, NORTH_CELL, EAST_CELL) | keep(mask & SOUTH_WEST_CELL, SOUTH_CELL, WEST_CELL) |
+           keep(mask & SOUTH_EAST_CELL, SOUTH_CELL, EAST_CELL);
 }
 
-bool Autotile::isVoid(unsigned int x, unsigned int y)
-{
-    if (m_maze->isCell(sf::Vector2u(x - 1, y - 1), Cell::WALL) &&
-        m_maze->isCell(sf::Vector2u(x + 1, y - 1), Cell::WALL) &&
-        m_maze->isCell(sf::Vector2u(x - 1, y + 1), Cell::WALL) &&
-        m_maze->isCell(sf::Vector2u(x + 1, y + 1), Cell::WALL))
-    {
-        return true;
+// the blob index of every mask: reduced masks numbered in increasing order
+constexpr std::array<sf::Uint8, 256> blobIndices = [] {
+    std::array<sf::Uint8, 256> indices{};
+    std::array<bool, 256>      used{};
+
+    for (sf::Uint32 mask = 0; mask < 256; mask++) {
+        used[reduceMask(mask)] = true;
     }
 
-    return false;
-}
+    std::array<sf::Uint8, 256> numbers{};
+    sf::Uint8                  count = 0;
+    for (sf::Uint32 mask = 0; mask < 256; mask++) {
+        if (used[mask]) {
+            numbers[mask] = count++;
+        }
+    }
 
-bool Autotile::isNotWall(unsigned int x, unsigned int y)
-{
-    return m_maze->isCell(sf::Vector2u(x, y), Cell::ROOM) || m_maze->isCell(sf::Vector2u(x, y), Cell::CORRIDOR) ||
-           m_maze->isCell(sf::Vector2u(x, y), Cell::DOOR);
-}
+    for (sf::Uint32 mask = 0; mask < 256; mask++) {
+        indices[mask] = numbers[reduceMask(mask)];
+    }
 
-bool Autotile::isWall(unsigned int x, unsigned int y)
-{
-    return m_maze->isCell(sf::Vector2u(x, y), Cell::WALL);
-}
+    return indices;
+}();
+
+constexpr sf::Uint32 blobCount = blobIndices[255] + 1;
+static_assert(blobCount == 47, "the blob scheme has 47 distinct neighbourhoods");
+
+// the reduced mask of every blob index
+constexpr std::array<sf::Uint8, blobCount> blobMasks = [] {
+    std::array<sf::Uint8, blobCount> masks{};
 
-sf::Uint32 Autotile::voidMask(unsigned int x, unsigned int y)
+    for (sf::Uint32 mask = 0; mask < 256; mask++) {
+        masks[blobIndices[mask]] = reduceMask(mask);
+    }
+
+    return masks;
+}();
+
+// Pick the tile for a blob from the 16 wall tiles in the tilesheet. A wall joins
+// an orthogonal neighbour when that neighbour is a wall that can be seen, which
+// is when one of the cells it shares with this 3x3 neighbourhood is open. A
+// wall between floor and solid rock therefore runs along the floor instead of
+// turning into the rock, and a wall buried in rock on all sides is void.
+constexpr sf::Uint32 blobTile(sf::Uint8 mask)
 {
-    sf::Uint32 bitmask = 0;
+    if (mask == 255) {
+        return voidTile;
+    }
 
-    if (isVoid(x, y - 1)) {
-        bitmask |= NORTH;
+    auto open = [mask](sf::Uint8 bits) {
+        return (mask & bits) != bits;
+    };
+
+    sf::Uint32 directions = NONE;
+
+    if ((mask & NORTH_CELL) && open(NORTH_WEST_CELL | NORTH_EAST_CELL | WEST_CELL | EAST_CELL)) {
+        directions |= NORTH;
     }
 
-    if (isVoid(x - 1, y)) {
-        bitmask |= WEST;
+    if ((mask & WEST_CELL) && open(NORTH_WEST_CELL | SOUTH_WEST_CELL | NORTH_CELL | SOUTH_CELL)) {
+        directions |= WEST;
     }
 
-    if (isVoid(x + 1, y)) {
-        bitmask |= EAST;
+    if ((mask & EAST_CELL) && open(NORTH_EAST_CELL | SOUTH_EAST_CELL | NORTH_CELL | SOUTH_CELL)) {
+        directions |= EAST;
     }
 
-    if (isVoid(x, y + 1)) {
-        bitmask |= SOUTH;
+    if ((mask & SOUTH_CELL) && open(SOUTH_WEST_CELL | SOUTH_EAST_CELL | WEST_CELL | EAST_CELL)) {
+        directions |= SOUTH;
     }
 
-    return bitmask;
+    return wallTiles[directions];
+}
+
+// The final lookup table, indexed by the neighbour mask with the cell itself as
+// bit 8, so that walls and floors are looked up alike without a branch.
+constexpr std::array<sf::Uint16, 512> tiles = [] {
+    std::array<sf::Uint16, 512> table{};
+
+    for (sf::Uint32 mask = 0; mask < 256; mask++) {
+        table[mask]       = floorTile;
+        table[mask | 256] = blobTile(blobMasks[blobIndices[mask]]);
+    }
+
+    return table;
+}();
+
+} // namespace
+
+Autotile::Autotile(Maze *maze, Tilemap *tilemap)
+{
+    m_tilemap = tilemap;
+    m_maze    = maze;
+
+    spdlog::info("Autotile::Autotile() initialized");
+}
+
+sf::Uint32 Autotile::getTile(sf::Uint8 mask, bool wall)
+{
+    return tiles[mask | (wall ? 256 : 0)];
 }
 
 void Autotile::render()
 {
-    for (sf::Uint32 y = 0; y < m_maze->getSize().y; y++) {
-        for (sf::Uint32 x = 0; x < m_maze->getSize().x; x++) {
-            if (isVoid(x, y)) {
-                m_tilemap->setTile(0, sf::Vector2u(x, y), m_void);
-                continue;
-            }
-
-            Cell cell = m_maze->getCell(sf::Vector2u(x, y));
-
-            if (cell == Cell::WALL) {
-                sf::Uint32 bitmask = 0;
-
-                if (isWall(x, y - 1)) {
-                    bitmask |= NORTH;
-                }
-
-                if (isWall(x - 1, y)) {
-                    bitmask |= WEST;
-                }
-
-                if (isWall(x + 1, y)) {
-                    bitmask |= EAST;
-                }
-
-                if (isWall(x, y + 1)) {
-                    bitmask |= SOUTH;
-                }
-
-                // when we have a wall with a wall on either side, and a floor tile on one side and a void tile on the
-                // other we need to not choose the bitmask that will render a wall into the void tile
-
-                if (bitmask == WEST_EAST_SOUTH) {
-                    if (isVoid(x - 1, y)) {
-                        bitmask = EAST_SOUTH;
-                    } else if (isVoid(x + 1, y)) {
-                        bitmask = WEST_SOUTH;
-                    } else if (isVoid(x, y + 1)) {
-                        bitmask = WEST_EAST;
-                    }
-                    m_tilemap->setTile(0, sf::Vector2u(x, y), m_walls[bitmask]);
-                    continue;
-                }
-
-                if (bitmask == NORTH_WEST_EAST) {
-                    if (isVoid(x, y - 1)) {
-                        bitmask = WEST_EAST;
-                    } else if (isVoid(x - 1, y)) {
-                        bitmask = NORTH_EAST;
-                    } else if (isVoid(x + 1, y)) {
-                        bitmask = NORTH_WEST;
-                    }
-                    m_tilemap->setTile(0, sf::Vector2u(x, y), m_walls[bitmask]);
-                    continue;
-                }
-
-                if (bitmask == NORTH_WEST_SOUTH) {
-                    if (isVoid(x, y - 1)) {
-                        bitmask = WEST_SOUTH;
-                    } else if (isVoid(x - 1, y)) {
-                        bitmask = NORTH_SOUTH;
-                    } else if (isVoid(x, y + 1)) {
-                        bitmask = NORTH_WEST;
-                    }
-                    m_tilemap->setTile(0, sf::Vector2u(x, y), m_walls[bitmask]);
-                    continue;
-                }
-
-                if (bitmask == NORTH_EAST_SOUTH) {
-                    if (isVoid(x, y + 1)) {
-                        bitmask = NORTH_EAST;
-                    } else if (isVoid(x + 1, y)) {
-                        bitmask = NORTH_SOUTH;
-                    } else if (isVoid(x, y - 1)) {
-                        bitmask = EAST_SOUTH;
-                    }
-                    m_tilemap->setTile(0, sf::Vector2u(x, y), m_walls[bitmask]);
-                    continue;
-                }
-
-                m_tilemap->setTile(0, sf::Vector2u(x, y), m_walls[bitmask]);
-            } else {
-                m_tilemap->setTile(0, sf::Vector2u(x, y), m_floor);
-            }
+    auto size = m_maze->getSize();
+    if (m_masks.getSize() != size) {
+        m_masks.resize(size);
+    }
+
+    // the grid has a border of walls, so the neighbours of every cell can be read
+    // without bounds checks
+    auto masks = m_masks.view();
+    getMasks(m_maze->getGrid(), masks);
+
+    for (sf::Uint32 y = 0; y < size.y; y++) {
+        auto row = masks.row(y);
+        for (sf::Uint32 x = 0; x < size.x; x++) {
+            m_tilemap->setTile(0, sf::Vector2u(x, y), tiles[row[x]]);
         }
     }
 }
@@ -1,21 +1,24 @@
 #pragma once
 
+#include <type_traits>
+
 #include "Maze.hpp"
 #include "Tilemap.hpp"
 
 // Autotile is a class that renders a maze to a tilemap. The maze is rendered
 // by iterating over the cells in the maze and rendering the cells to the tilemap.
 //
-// Walls are automatically rendered based on the types of the adjacent cells.
+// Walls are automatically rendered based on the types of all eight adjacent
+// cells, using the 47 tile blob scheme: the eight neighbours form an 8-bit mask,
+// and a lookup table generated at compile time maps every mask straight to a
+// tile, so each cell costs one mask gather and one table load.
 
 class Autotile
 {
     private:
-        Tilemap                *m_tilemap;
-        Maze                   *m_maze;
-        std::vector<sf::Uint32> m_walls; // vector of wall tiles based on the type of the adjacent cells
-        sf::Uint32              m_floor; // id of the floor tile
-        sf::Uint32              m_void;  // id of the void tile
+        Tilemap         *m_tilemap;
+        Maze            *m_maze;
+        Grid<sf::Uint16> m_masks; // mask of every cell, kept for the next render
 
     public:
         Autotile(Maze *maze, Tilemap *tilemap);
@@ -24,8 +27,43 @@ class Autotile
         // render the maze to the tilemap
         void render();
 
-        bool       isVoid(unsigned int x, unsigned int y);
-        bool       isNotWall(unsigned int x, unsigned int y);
-        bool       isWall(unsigned int x, unsigned int y);
-        sf::Uint32 voidMask(unsigned int x, unsigned int y);
+        // get the tile for a cell from the 8-bit mask of its neighbours that are
+        // walls, and whether the cell itself is a wall. Bits are set in reading
+        // order: north west, north, north east, west, east, south west, south,
+        // south east.
+        static sf::Uint32 getTile(sf::Uint8 mask, bool wall);
+
+        // get the neighbour mask of every cell of a grid with a border of walls
+        // into masks, with whether the cell itself is a wall as bit 8. This is the
+        // stencil render uses, for a grid in any layout, so that quantum-gen can
+        // time it in each of them; row by row it reads three rows through pointers.
+        template <typename Layout>
+        static void getMasks(const Grid<Cell, Layout> &cells, GridView<sf::Uint16> masks)
+        {
+            auto isWall = [](Cell cell) { return static_cast<sf::Uint32>(cell == Cell::WALL); };
+
+            for (int y = 0; y < static_cast<int>(masks.getSize().y); y++) {
+                auto out = masks.row(y);
+
+                if constexpr (std::is_same_v<Layout, RowMajor>) {
+                    const Cell *above = &cells(0, y - 1);
+                    const Cell *row   = &cells(0, y);
+                    const Cell *below = &cells(0, y + 1);
+
+                    for (int x = 0; x < static_cast<int>(out.size()); x++) {
+                        out[x] = isWall(above[x - 1]) | isWall(above[x]) << 1 | isWall(above[x + 1]) << 2 |
+                                 isWall(row[x - 1]) << 3 | isWall(row[x + 1]) << 4 | isWall(below[x - 1]) << 5 |
+                                 isWall(below[x]) << 6 | isWall(below[x + 1]) << 7 | isWall(row[x]) << 8;
+                    }
+                } else {
+                    for (int x = 0; x < static_cast<int>(out.size()); x++) {
+                        out[x] = isWall(cells(x - 1, y - 1)) | isWall(cells(x, y - 1)) << 1 |
+                                 isWall(cells(x + 1, y - 1)) << 2 | isWall(cells(x - 1, y)) << 3 |
+                                 isWall(cells(x + 1, y)) << 4 | isWall(cells(x - 1, y + 1)) << 5 |
+                                 isWall(cells(x, y + 1)) << 6 | isWall(cells(x + 1, y + 1)) << 7 |
+                                 isWall(cells(x, y)) << 8;
+                    }
+                }
+            }
+        }
 };
@@ -0,0 +1,214 @@
+#include "CaveGenerator.hpp"
+
+#include "Parallel.hpp"
+
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// add three bit-sliced inputs, giving the sum bit and the carry bit of each lane
+inline void fullAdd(sf::Uint64 a, sf::Uint64 b, sf::Uint64 c, sf::Uint64 &sum, sf::Uint64 &carry)
+{
+    sf::Uint64 half = a ^ b;
+    sum             = half ^ c;
+    carry           = (a & b) | (half & c);
+}
+
+inline void halfAdd(sf::Uint64 a, sf::Uint64 b, sf::Uint64 &sum, sf::Uint64 &carry)
+{
+    sum   = a ^ b;
+    carry = a & b;
+}
+
+// splitmix64, which gives good random bits from a plain counter, so every row
+// can have its own generator without any setup
+inline sf::Uint64 nextRandom(sf::Uint64 &state)
+{
+    sf::Uint64 z = (state += 0x9e3779b97f4a7c15ull);
+    z            = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z            = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// get the bits past the width in the last word of a row, which are kept as wall
+inline sf::Uint64 getTailMask(sf::Uint32 width)
+{
+    return width % 64 == 0 ? 0 : ~0ull << (width % 64);
+}
+
+} // namespace
+
+CaveGenerator::CaveGenerator()
+{
+    m_size       = sf::Vector2u(0, 0);
+    m_stride     = 0;
+    m_fill       = 0.45f;
+    m_birth      = 0x1e0; // 5 to 8
+    m_survival   = 0x1f0; // 4 to 8
+    m_iterations = 5;
+    m_minCave    = 16;
+    m_connect    = true;
+}
+
+void CaveGenerator::generate(const sf::Vector2u &size, sf::Uint32 seed, sf::Uint32 threads)
+{
+    sf::Clock clock;
+
+    if (threads == 0) {
+        threads = getThreadCount();
+    }
+
+    // the guard words and rows are walls, and are never written, so they only need
+    // setting when the buffers are made
+    if (size != m_size) {
+        m_size   = size;
+        m_stride = (size.x + 63) / 64 + 2;
+        m_bits.assign((size.y + 2) * m_stride, ~0ull);
+        m_next.assign((size.y + 2) * m_stride, ~0ull);
+    }
+
+    if (m_size.x == 0 || m_size.y == 0) {
+        return;
+    }
+
+    this->seed(seed, threads);
+
+    for (sf::Uint32 i = 0; i < m_iterations; i++) {
+        parallelFor(
+            0, m_size.y, [this](sf::Uint32 first, sf::Uint32 last) { step(first, last); }, threads);
+        std::swap(m_bits, m_next);
+    }
+
+    spdlog::debug("CaveGenerator::generate: {} iterations on {}x{} in {}ms",
+                  m_iterations,
+                  m_size.x,
+                  m_size.y,
+                  clock.getElapsedTime().asMilliseconds());
+}
+
+void CaveGenerator::seed(sf::Uint32 seed, sf::Uint32 threads)
+{
+    // a cell is a wall if its 32 random bits fall below this
+    sf::Uint64 threshold = static_cast<sf::Uint64>(std::clamp(m_fill, 0.f, 1.f) * 4294967296.0);
+    sf::Uint32 words     = m_stride - 2;
+    sf::Uint64 tail      = getTailMask(m_size.x);
+
+    parallelFor(
+        0,
+        m_size.y,
+        [&](sf::Uint32 first, sf::Uint32 last) {
+            for (sf::Uint32 y = first; y < last; y++) {
+                // every row is seeded from its own position, so the map does not depend
+                // on how the rows were split between threads
+                sf::Uint64  state = static_cast<sf::Uint64>(seed) << 32 | y;
+                sf::Uint64 *row   = getRow(m_bits, y);
+
+                for (sf::Uint32 w = 1; w <= words; w++) {
+                    sf::Uint64 word = 0;
+                    for (sf::Uint32 bit = 0; bit < 64; bit += 2) {
+                        sf::Uint64 random = nextRandom(state);
+                        word             |= static_cast<sf::Uint64>((random & 0xffffffff) < threshold) << bit;
+                        word             |= static_cast<sf::Uint64>((random >> 32) < threshold) << (bit + 1);
+                    }
+                    row[w] = word;
+                }
+
+                row[words] |= tail;
+            }
+        },
+        threads);
+}
+
+void CaveGenerator::step(sf::Uint32 first, sf::Uint32 last)
+{
+    sf::Uint32 words = m_stride - 2;
+    sf::Uint64 tail  = getTailMask(m_size.x);
+
+    // the neighbour counts the rule cares about, so the others are never tested
+    sf::Uint32 counts[9];
+    sf::Uint32 countCount = 0;
+    for (sf::Uint32 n = 0; n <= 8; n++) {
+        if ((m_birth | m_survival) >> n & 1) {
+            counts[countCount++] = n;
+        }
+    }
+
+    for (sf::Uint32 y = first; y < last; y++) {
+        const sf::Uint64 *above = getRow(m_bits, static_cast<int>(y) - 1);
+        const sf::Uint64 *row   = getRow(m_bits, y);
+        const sf::Uint64 *below = getRow(m_bits, static_cast<int>(y) + 1);
+        sf::Uint64       *out   = getRow(m_next, y);
+
+        for (sf::Uint32 w = 1; w <= words; w++) {
+            // each neighbour as a word lined up with this one; bit x of a word is
+            // cell x, so the cell to the left comes from the bit below
+            sf::Uint64 north     = above[w];
+            sf::Uint64 northWest = (above[w] << 1) | (above[w - 1] >> 63);
+            sf::Uint64 northEast = (above[w] >> 1) | (above[w + 1] << 63);
+            sf::Uint64 west      = (row[w] << 1) | (row[w - 1] >> 63);
+            sf::Uint64 east      = (row[w] >> 1) | (row[w + 1] << 63);
+            sf::Uint64 south     = below[w];
+            sf::Uint64 southWest = (below[w] << 1) | (below[w - 1] >> 63);
+            sf::Uint64 southEast = (below[w] >> 1) | (below[w + 1] << 63);
+
+            // add the eight neighbours up into the four bits of each count
+            sf::Uint64 a1, a2, b1, b2, c1, c2, d2, e2, e4, f4;
+            sf::Uint64 count1, count2, count4, count8;
+
+            fullAdd(northWest, north, northEast, a1, a2);
+            fullAdd(west, east, southWest, b1, b2);
+            halfAdd(south, southEast, c1, c2);
+            fullAdd(a1, b1, c1, count1, d2);
+            fullAdd(a2, b2, c2, e2, e4);
+            halfAdd(e2, d2, count2, f4);
+            count4 = e4 ^ f4;
+            count8 = e4 & f4;
+
+            sf::Uint64 born = 0;
+            sf::Uint64 kept = 0;
+
+            for (sf::Uint32 i = 0; i < countCount; i++) {
+                sf::Uint32 n     = counts[i];
+                sf::Uint64 match = (n & 1 ? count1 : ~count1) & (n & 2 ? count2 : ~count2) &
+                                   (n & 4 ? count4 : ~count4) & (n & 8 ? count8 : ~count8);
+
+                born |= m_birth >> n & 1 ? match : 0;
+                kept |= m_survival >> n & 1 ? match : 0;
+            }
+
+            out[w] = (row[w] & kept) | (~row[w] & born);
+        }
+
+        out[words] |= tail;
+    }
+}
+
+void CaveGenerator::getCells(GridView<Cell> cells, sf::Uint32 threads) const
+{
+    if (cells.getSize() != m_size) {
+        spdlog::error("CaveGenerator::getCells: cells are {}x{} but the map is {}x{}",
+                      cells.getSize().x,
+                      cells.getSize().y,
+                      m_size.x,
+                      m_size.y);
+        return;
+    }
+
+    parallelFor(
+        0,
+        m_size.y,
+        [&](sf::Uint32 first, sf::Uint32 last) {
+            for (sf::Uint32 y = first; y < last; y++) {
+                const sf::Uint64 *bits = getRow(m_bits, y);
+                auto              row  = cells.row(y);
+
+                for (sf::Uint32 x = 0; x < m_size.x; x++) {
+                    row[x] = bits[1 + x / 64] >> (x % 64) & 1 ? Cell::WALL : Cell::ROOM;
+                }
+            }
+        },
+        threads);
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "Cell.hpp"
+#include "GridView.hpp"
+
+// CaveGenerator grows organic caves with a cellular automaton, as an alternative
+// to the rooms and corridors of Maze::regenerate. Maze::generateCaves runs it and
+// then keeps or connects the caves it made.
+//
+// The map starts as random noise, with a given fraction of walls, and each
+// iteration applies a birth/survival rule to every cell at once: a wall survives
+// if the number of walls among its 8 neighbours is in the survival set, and an
+// open cell becomes a wall if it is in the birth set. Everything outside the map
+// counts as wall, so caves close up at the edges.
+//
+// Cells are packed 64 to a word, one bit each, set for walls. The neighbours of a
+// whole word are found with shifts, and their counts are added up bit-sliced: a
+// tree of full adders gives the four bits of every count in a word at once, so an
+// iteration costs a few dozen word operations per 64 cells. Rows are split into
+// bands that are stepped in parallel.
+class CaveGenerator
+{
+    private:
+        sf::Vector2u            m_size;       // size of the map in cells
+        size_t                  m_stride;     // words per row, including a guard word on each side
+        std::vector<sf::Uint64> m_bits;       // wall bits of the map, with a guard row above and below
+        std::vector<sf::Uint64> m_next;       // wall bits of the next iteration
+        float                   m_fill;       // fraction of cells that start as wall
+        sf::Uint16              m_birth;      // bit n set if an open cell with n wall neighbours becomes wall
+        sf::Uint16              m_survival;   // bit n set if a wall with n wall neighbours stays wall
+        sf::Uint32              m_iterations; // number of times the rule is applied
+        sf::Uint32              m_minCave;    // caves with fewer cells than this are filled in
+        bool                    m_connect;    // true to connect caves, false to keep only the largest
+
+        // get the first word of a row, from -1 for the guard row above to the height
+        // for the guard row below
+        sf::Uint64 *getRow(std::vector<sf::Uint64> &bits, int y)
+        {
+            return &bits[(y + 1) * m_stride];
+        }
+
+        const sf::Uint64 *getRow(const std::vector<sf::Uint64> &bits, int y) const
+        {
+            return &bits[(y + 1) * m_stride];
+        }
+
+        // fill the map with random walls
+        void seed(sf::Uint32 seed, sf::Uint32 threads);
+
+        // apply the rule to rows [first, last) of m_bits, writing them to m_next
+        void step(sf::Uint32 first, sf::Uint32 last);
+
+    public:
+        // a cave generator with the classic 4-5 rule: walls with at least 4 wall
+        // neighbours stay, open cells with at least 5 fill in, and 45% of cells start
+        // as wall, over 5 iterations
+        CaveGenerator();
+        ~CaveGenerator() = default;
+
+        // set the fraction of cells, from 0 to 1, that start as wall
+        void setFill(float fill)
+        {
+            m_fill = fill;
+        }
+
+        float getFill() const
+        {
+            return m_fill;
+        }
+
+        // set the rule as masks of neighbour counts: bit n of birth is set if an open
+        // cell with n wall neighbours becomes a wall, and bit n of survival if a wall
+        // with n wall neighbours stays one. Only bits 0 to 8 are used.
+        void setRule(sf::Uint16 birth, sf::Uint16 survival)
+        {
+            m_birth    = birth & 0x1ff;
+            m_survival = survival & 0x1ff;
+        }
+
+        sf::Uint16 getBirth() const
+        {
+            return m_birth;
+        }
+
+        sf::Uint16 getSurvival() const
+        {
+            return m_survival;
+        }
+
+        // set the number of times the rule is applied
+        void setIterations(sf::Uint32 iterations)
+        {
+            m_iterations = iterations;
+        }
+
+        sf::Uint32 getIterations() const
+        {
+            return m_iterations;
+        }
+
+        // set the number of cells a cave needs to be kept, smaller ones are filled in
+        void setMinCave(sf::Uint32 cells)
+        {
+            m_minCave = cells;
+        }
+
+        sf::Uint32 getMinCave() const
+        {
+            return m_minCave;
+        }
+
+        // set whether caves big enough to keep are connected to the largest one by
+        // tunnels, or filled in so that only the largest is left
+        void setConnect(bool connect)
+        {
+            m_connect = connect;
+        }
+
+        bool getConnect() const
+        {
+            return m_connect;
+        }
+
+        // seed a map of the given size and run the automaton on it, on threads
+        // workers or every hardware thread if 0. The same seed always gives the same
+        // map, whatever the number of threads. Buffers are kept for the next run.
+        void generate(const sf::Vector2u &size, sf::Uint32 seed, sf::Uint32 threads = 0);
+
+        // write the map to cells of the same size, WALL for walls and ROOM for the rest
+        void getCells(GridView<Cell> cells, sf::Uint32 threads = 0) const;
+
+        // check if the cell at a position is a wall
+        bool isWall(const sf::Vector2u &position) const
+        {
+            return getRow(m_bits, position.y)[1 + position.x / 64] >> (position.x % 64) & 1;
+        }
+};
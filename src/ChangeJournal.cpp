@@ -0,0 +1,599 @@
+#include "ChangeJournal.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+const sf::Uint32 journalVersion = 1;
+
+// snapshots start with this header, followed by one byte per maze cell and then
+// the tile IDs of each tilemap layer, all row by row
+struct SnapshotHeader
+{
+    char       magic[4] = {'Q', 'S', 'N', 'P'};
+    sf::Uint32 version  = journalVersion;
+    sf::Uint32 generation;
+    sf::Uint32 mazeWidth;
+    sf::Uint32 mazeHeight;
+    sf::Uint32 mapWidth;
+    sf::Uint32 mapHeight;
+    sf::Uint32 layers;
+};
+
+// journals start with this header, naming the snapshot they follow
+struct JournalHeader
+{
+    char       magic[4] = {'Q', 'J', 'R', 'N'};
+    sf::Uint32 version  = journalVersion;
+    sf::Uint32 generation;
+};
+
+// each turn in the journal starts with this header, followed by its changes
+struct TurnHeader
+{
+    sf::Uint32 bytes;    // size of the changes
+    sf::Uint32 number;   // turn number
+    sf::Uint32 checksum; // checksum of the changes, to find turns cut short by a crash
+};
+
+// no turn changes anything like this much, so a larger size means a damaged journal
+const sf::Uint32 maxTurnBytes = 1u << 28;
+
+bool hasMagic(const char (&magic)[4], const char *expected)
+{
+    return std::memcmp(magic, expected, sizeof(magic)) == 0;
+}
+
+// 32 bit FNV-1a
+sf::Uint32 checksum(const std::vector<sf::Uint8> &bytes)
+{
+    sf::Uint32 hash = 2166136261u;
+    for (auto byte : bytes) {
+        hash ^= byte;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// write an unsigned integer 7 bits at a time, low bits first, setting the top bit
+// of every byte but the last
+void writeVarint(std::vector<sf::Uint8> &bytes, sf::Uint64 value)
+{
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<sf::Uint8>(value | 0x80));
+        value >>= 7;
+    }
+
+    bytes.push_back(static_cast<sf::Uint8>(value));
+}
+
+bool readVarint(const sf::Uint8 *&bytes, const sf::Uint8 *end, sf::Uint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && bytes < end; shift += 7) {
+        sf::Uint8 byte = *bytes++;
+        value         |= static_cast<sf::Uint64>(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// map signed deltas to unsigned so that small steps back stay small
+sf::Uint64 zigzag(sf::Int64 value)
+{
+    return (static_cast<sf::Uint64>(value) << 1) ^ static_cast<sf::Uint64>(value >> 63);
+}
+
+sf::Int64 unzigzag(sf::Uint64 value)
+{
+    return static_cast<sf::Int64>(value >> 1) ^ -static_cast<sf::Int64>(value & 1);
+}
+
+} // namespace
+
+ChangeJournal::ChangeJournal(const std::string &path, Maze *maze, Tilemap *tilemap)
+{
+    m_path          = path;
+    m_maze          = maze;
+    m_tilemap       = tilemap;
+    m_turn          = 0;
+    m_rebase        = false;
+    m_compact       = false;
+    m_replaying     = false;
+    m_stopping      = false;
+    m_generation    = 0;
+    m_journalBytes  = 0;
+    m_snapshotBytes = 0;
+
+    m_maze->addListener(this);
+    m_tilemap->addListener(this);
+}
+
+ChangeJournal::~ChangeJournal()
+{
+    m_maze->removeListener(this);
+    m_tilemap->removeListener(this);
+
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    // save whatever changed during the last turn before stopping
+    endTurn();
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+bool ChangeJournal::open()
+{
+    if (m_thread.joinable()) {
+        spdlog::error("ChangeJournal::open: {} is already open", m_path);
+        return false;
+    }
+
+    std::error_code error;
+    auto            directory = std::filesystem::path(m_path).parent_path();
+    if (!directory.empty()) {
+        std::filesystem::create_directories(directory, error);
+        if (error) {
+            spdlog::error("ChangeJournal::open: failed to create {}: {}", directory.string(), error.message());
+        }
+    }
+
+    Level      current = captureLevel();
+    Level      saved;
+    sf::Uint32 generation = 0;
+    bool       recovered  = false;
+
+    if (readSnapshot(saved, generation)) {
+        if (saved.mazeSize == current.mazeSize && saved.mapSize == current.mapSize &&
+            saved.layers.size() == current.layers.size())
+        {
+            sf::Uint32 turns = replayJournal(generation, saved);
+            applyLevel(saved);
+
+            spdlog::info("ChangeJournal::open: recovered {} from snapshot {} and {} turns", m_path, generation, turns);
+
+            m_level   = std::move(saved);
+            recovered = true;
+        } else {
+            spdlog::error("ChangeJournal::open: the level saved in {} does not fit the map, starting again", m_path);
+        }
+    }
+
+    if (!recovered) {
+        m_level = std::move(current);
+    }
+
+    // setting up the level made changes that are already in m_level
+    m_changes.clear();
+    m_rebase     = false;
+    m_compact    = false;
+    m_generation = generation;
+
+    // fold the replayed turns into a new snapshot, so the next start replays nothing
+    compactJournal();
+
+    m_thread = std::thread(&ChangeJournal::run, this);
+
+    return recovered;
+}
+
+void ChangeJournal::endTurn()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    m_turn++;
+
+    if (m_changes.empty() && !m_rebase && !m_compact) {
+        return;
+    }
+
+    Turn turn;
+    turn.number  = m_turn;
+    turn.compact = m_compact;
+
+    // a regenerated level is saved whole, which covers every change made this turn
+    if (m_rebase) {
+        turn.rebase = captureLevel();
+        m_changes.clear();
+    } else {
+        turn.changes.swap(m_changes);
+    }
+
+    m_rebase  = false;
+    m_compact = false;
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_queue.push_back(std::move(turn));
+    }
+
+    m_wake.notify_one();
+}
+
+void ChangeJournal::compact()
+{
+    m_compact = true;
+}
+
+void ChangeJournal::onCellChanged(const sf::Vector2u &position, Cell cell)
+{
+    if (m_replaying) {
+        return;
+    }
+
+    m_changes.push_back(Change{0, position.y * m_maze->getSize().x + position.x, static_cast<sf::Uint32>(cell)});
+}
+
+void ChangeJournal::onMazeGenerated()
+{
+    if (!m_replaying) {
+        m_rebase = true;
+    }
+}
+
+void ChangeJournal::onTileChanged(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id)
+{
+    if (m_replaying) {
+        return;
+    }
+
+    m_changes.push_back(Change{layer + 1, position.y * m_tilemap->getMapSize().x + position.x, id});
+}
+
+ChangeJournal::Level ChangeJournal::captureLevel() const
+{
+    Level level;
+    level.mazeSize = m_maze->getSize();
+    level.mapSize  = m_tilemap->getMapSize();
+    level.layers.resize(1 + m_tilemap->getLayerCount());
+
+    auto  cells = m_maze->getCells();
+    auto &maze  = level.layers[0];
+    maze.reserve(static_cast<size_t>(level.mazeSize.x) * level.mazeSize.y);
+
+    for (sf::Uint32 y = 0; y < level.mazeSize.y; y++) {
+        for (auto cell : cells.row(y)) {
+            maze.push_back(static_cast<sf::Uint32>(cell));
+        }
+    }
+
+    for (sf::Uint32 layer = 0; layer < m_tilemap->getLayerCount(); layer++) {
+        auto  tiles  = m_tilemap->getLayer(layer);
+        auto &stored = level.layers[layer + 1];
+        stored.reserve(static_cast<size_t>(level.mapSize.x) * level.mapSize.y);
+
+        for (sf::Uint32 y = 0; y < level.mapSize.y; y++) {
+            auto row = tiles.row(y);
+            stored.insert(stored.end(), row.begin(), row.end());
+        }
+    }
+
+    return level;
+}
+
+void ChangeJournal::applyLevel(const Level &level)
+{
+    m_replaying = true;
+
+    std::vector<Cell> cells(level.layers[0].size());
+    std::transform(level.layers[0].begin(), level.layers[0].end(), cells.begin(), [](sf::Uint32 cell) {
+        return static_cast<Cell>(cell);
+    });
+
+    m_maze->setCells(GridView<const Cell>(cells.data(), level.mazeSize));
+
+    for (sf::Uint32 layer = 0; layer + 1 < level.layers.size(); layer++) {
+        const auto &tiles = level.layers[layer + 1];
+
+        for (sf::Uint32 y = 0; y < level.mapSize.y; y++) {
+            for (sf::Uint32 x = 0; x < level.mapSize.x; x++) {
+                m_tilemap->setTile(layer, sf::Vector2u(x, y), tiles[y * level.mapSize.x + x]);
+            }
+        }
+    }
+
+    m_replaying = false;
+}
+
+bool ChangeJournal::readSnapshot(Level &level, sf::Uint32 &generation) const
+{
+    std::ifstream file(m_path + ".snapshot", std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    SnapshotHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!file.good() || !hasMagic(header.magic, "QSNP") || header.version != journalVersion) {
+        spdlog::error("ChangeJournal::readSnapshot: {}.snapshot is not a snapshot this version can read", m_path);
+        return false;
+    }
+
+    level.mazeSize = sf::Vector2u(header.mazeWidth, header.mazeHeight);
+    level.mapSize  = sf::Vector2u(header.mapWidth, header.mapHeight);
+    level.layers.resize(1 + header.layers);
+
+    std::vector<sf::Uint8> cells(static_cast<size_t>(header.mazeWidth) * header.mazeHeight);
+    file.read(reinterpret_cast<char *>(cells.data()), cells.size());
+    level.layers[0].assign(cells.begin(), cells.end());
+
+    for (sf::Uint32 layer = 1; layer <= header.layers; layer++) {
+        auto &tiles = level.layers[layer];
+        tiles.resize(static_cast<size_t>(header.mapWidth) * header.mapHeight);
+        file.read(reinterpret_cast<char *>(tiles.data()), tiles.size() * sizeof(sf::Uint32));
+    }
+
+    if (!file.good()) {
+        spdlog::error("ChangeJournal::readSnapshot: {}.snapshot is truncated", m_path);
+        return false;
+    }
+
+    generation = header.generation;
+
+    return true;
+}
+
+sf::Uint32 ChangeJournal::replayJournal(sf::Uint32 generation, Level &level) const
+{
+    std::ifstream file(m_path + ".journal", std::ios::binary);
+    if (!file.is_open()) {
+        return 0;
+    }
+
+    JournalHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!file.good() || !hasMagic(header.magic, "QJRN") || header.version != journalVersion ||
+        header.generation != generation)
+    {
+        // compaction writes the snapshot before starting the journal, so a journal
+        // for another snapshot was already folded into this one
+        spdlog::info("ChangeJournal::replayJournal: {}.journal does not follow the snapshot, ignoring it", m_path);
+        return 0;
+    }
+
+    std::vector<sf::Uint8>                          bytes;
+    std::vector<std::pair<sf::Uint32 *, sf::Uint32>> applied; // changed values and what they held
+    sf::Uint32                                       turns = 0;
+
+    while (true) {
+        TurnHeader turn;
+        if (!file.read(reinterpret_cast<char *>(&turn), sizeof(turn))) {
+            break;
+        }
+
+        if (turn.bytes > maxTurnBytes) {
+            spdlog::error("ChangeJournal::replayJournal: turn {} is damaged, stopping there", turn.number);
+            break;
+        }
+
+        bytes.resize(turn.bytes);
+        if (!file.read(reinterpret_cast<char *>(bytes.data()), bytes.size()) || checksum(bytes) != turn.checksum) {
+            spdlog::info("ChangeJournal::replayJournal: turn {} was not saved completely, stopping there", turn.number);
+            break;
+        }
+
+        // apply the changes one by one, checking that each cell held the old value;
+        // if one did not, the turn is undone and replaying stops
+        const sf::Uint8 *next     = bytes.data();
+        const sf::Uint8 *end      = next + bytes.size();
+        sf::Int64        previous = 0;
+        bool             valid    = true;
+
+        applied.clear();
+        while (next < end) {
+            sf::Uint64 layer, delta, before, after;
+            if (!readVarint(next, end, layer) || !readVarint(next, end, delta) || !readVarint(next, end, before) ||
+                !readVarint(next, end, after) || layer >= level.layers.size())
+            {
+                valid = false;
+                break;
+            }
+
+            sf::Int64 index = previous + unzigzag(delta);
+            if (index < 0 || static_cast<sf::Uint64>(index) >= level.layers[layer].size() ||
+                level.layers[layer][index] != before)
+            {
+                valid = false;
+                break;
+            }
+
+            auto &value = level.layers[layer][index];
+            applied.emplace_back(&value, value);
+            value    = static_cast<sf::Uint32>(after);
+            previous = index;
+        }
+
+        if (!valid) {
+            for (auto it = applied.rbegin(); it != applied.rend(); ++it) {
+                *it->first = it->second;
+            }
+
+            spdlog::error("ChangeJournal::replayJournal: turn {} does not match the level, stopping there",
+                          turn.number);
+            break;
+        }
+
+        turns++;
+    }
+
+    return turns;
+}
+
+bool ChangeJournal::compactJournal()
+{
+    auto snapshotFile = m_path + ".snapshot";
+    auto journalFile  = m_path + ".journal";
+
+    SnapshotHeader snapshot;
+    snapshot.generation = m_generation + 1;
+    snapshot.mazeWidth  = m_level.mazeSize.x;
+    snapshot.mazeHeight = m_level.mazeSize.y;
+    snapshot.mapWidth   = m_level.mapSize.x;
+    snapshot.mapHeight  = m_level.mapSize.y;
+    snapshot.layers     = m_level.layers.size() - 1;
+
+    // both files are written beside the old ones and renamed over them, so a crash
+    // leaves either the old or the new snapshot, never half of one. The snapshot
+    // goes first: a journal left behind by a crash in between names the old
+    // snapshot and is ignored.
+    {
+        std::ofstream file(snapshotFile + ".tmp", std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&snapshot), sizeof(snapshot));
+
+        std::vector<sf::Uint8> cells(m_level.layers[0].begin(), m_level.layers[0].end());
+        file.write(reinterpret_cast<const char *>(cells.data()), cells.size());
+
+        for (sf::Uint32 layer = 1; layer < m_level.layers.size(); layer++) {
+            const auto &tiles = m_level.layers[layer];
+            file.write(reinterpret_cast<const char *>(tiles.data()), tiles.size() * sizeof(sf::Uint32));
+        }
+
+        if (!file.good()) {
+            spdlog::error("ChangeJournal::compactJournal: failed to write {}.tmp", snapshotFile);
+            return false;
+        }
+
+        m_snapshotBytes = file.tellp();
+    }
+
+    std::error_code error;
+    std::filesystem::rename(snapshotFile + ".tmp", snapshotFile, error);
+    if (error) {
+        spdlog::error("ChangeJournal::compactJournal: failed to replace {}: {}", snapshotFile, error.message());
+        return false;
+    }
+
+    m_generation++;
+
+    JournalHeader journal;
+    journal.generation = m_generation;
+
+    {
+        std::ofstream file(journalFile + ".tmp", std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&journal), sizeof(journal));
+
+        if (!file.good()) {
+            spdlog::error("ChangeJournal::compactJournal: failed to write {}.tmp", journalFile);
+            return false;
+        }
+    }
+
+    m_journal.close();
+    std::filesystem::rename(journalFile + ".tmp", journalFile, error);
+    if (error) {
+        spdlog::error("ChangeJournal::compactJournal: failed to replace {}: {}", journalFile, error.message());
+        return false;
+    }
+
+    m_journal.open(journalFile, std::ios::binary | std::ios::app);
+    m_journalBytes = sizeof(journal);
+
+    spdlog::debug("ChangeJournal::compactJournal: wrote snapshot {} of {} bytes", m_generation, m_snapshotBytes);
+
+    return true;
+}
+
+void ChangeJournal::writeTurn(Turn &turn)
+{
+    if (turn.rebase) {
+        m_level = std::move(*turn.rebase);
+        compactJournal();
+        return;
+    }
+
+    // in index order the deltas between changes stay small; the sort is stable so
+    // a cell changed twice in a turn still ends up with its last value
+    std::stable_sort(turn.changes.begin(), turn.changes.end(), [](const Change &a, const Change &b) {
+        return a.layer != b.layer ? a.layer < b.layer : a.index < b.index;
+    });
+
+    std::vector<sf::Uint8> bytes;
+    sf::Int64              previous = 0;
+
+    for (const auto &change : turn.changes) {
+        if (change.layer >= m_level.layers.size() || change.index >= m_level.layers[change.layer].size()) {
+            continue;
+        }
+
+        auto &value = m_level.layers[change.layer][change.index];
+        if (value == change.value) {
+            continue;
+        }
+
+        writeVarint(bytes, change.layer);
+        writeVarint(bytes, zigzag(change.index - previous));
+        writeVarint(bytes, value);
+        writeVarint(bytes, change.value);
+
+        value    = change.value;
+        previous = change.index;
+    }
+
+    if (!bytes.empty()) {
+        TurnHeader header;
+        header.bytes    = bytes.size();
+        header.number   = turn.number;
+        header.checksum = checksum(bytes);
+
+        m_journal.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_journal.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        m_journalBytes += sizeof(header) + bytes.size();
+
+        if (!m_journal.good()) {
+            spdlog::error("ChangeJournal::writeTurn: failed to save turn {} to {}.journal", turn.number, m_path);
+        }
+    }
+
+    // once replaying the journal would read more than the snapshot, fold it in
+    if (turn.compact || m_journalBytes > m_snapshotBytes) {
+        compactJournal();
+    }
+}
+
+void ChangeJournal::run()
+{
+    std::vector<Turn> turns;
+
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+            if (m_queue.empty()) {
+                return;
+            }
+
+            turns.swap(m_queue);
+        }
+
+        for (auto &turn : turns) {
+            writeTurn(turn);
+        }
+
+        turns.clear();
+        m_journal.flush();
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SFML/Config.hpp>
+
+#include "Maze.hpp"
+#include "Tilemap.hpp"
+
+// ChangeJournal autosaves a level as it is edited, at a cost that depends on
+// how much changed rather than on the size of the map.
+//
+// The level is saved as a base snapshot of every maze cell and tile, and an
+// append-only journal of the changes made since. The journal listens to the
+// Maze and the Tilemap, collecting the cells and tiles set during a turn, and
+// endTurn hands them to a background writer thread. The writer appends the turn
+// as one record: a header holding its length and a checksum, followed by the
+// changes, each encoded as the layer, the distance from the previous changed
+// index, and the old and new values, all as variable length integers. Most
+// turns come to a few dozen bytes.
+//
+// The writer keeps its own copy of the level up to date from the turns it
+// writes, and once the journal has grown larger than the snapshot it folds it
+// into a new snapshot and starts an empty journal, so that neither the main
+// thread nor recovery ever waits on a long journal.
+//
+// open recovers a saved level by loading the snapshot and replaying every
+// complete turn of the journal, stopping at a turn that was only partly written
+// when the game stopped. Each journal names the snapshot it follows, so a
+// journal left over from before a compaction is never replayed twice.
+//
+// Regenerating the maze changes every cell at once, so instead of journalling
+// each one the next turn saves a new snapshot.
+class ChangeJournal : public MazeListener, public TilemapListener
+{
+    private:
+        // a cell of the maze or a tile set to a new value. Layer 0 is the maze and
+        // the tilemap layers follow it; index is y * width + x.
+        struct Change
+        {
+            sf::Uint32 layer;
+            sf::Uint32 index;
+            sf::Uint32 value;
+        };
+
+        // every cell and tile of a level, layer 0 being the maze
+        struct Level
+        {
+            sf::Vector2u                         mazeSize;
+            sf::Vector2u                         mapSize;
+            std::vector<std::vector<sf::Uint32>> layers;
+        };
+
+        // one turn for the writer to save
+        struct Turn
+        {
+            sf::Uint32           number;
+            std::vector<Change>  changes;
+            std::optional<Level> rebase;  // the whole level, if it was regenerated
+            bool                 compact; // fold the journal into the snapshot afterwards
+        };
+
+        // used by the main thread
+        std::string         m_path;      // snapshot and journal path, without the extension
+        Maze               *m_maze;      // the maze being saved
+        Tilemap            *m_tilemap;   // the tilemap being saved
+        std::vector<Change> m_changes;   // changes made during this turn
+        sf::Uint32          m_turn;      // number of the current turn
+        bool                m_rebase;    // the maze was regenerated during this turn
+        bool                m_compact;   // compact was called during this turn
+        bool                m_replaying; // true while open sets the level, so it is not journalled
+
+        // shared between the threads
+        std::thread             m_thread;   // writer thread
+        std::mutex              m_mutex;    // guards the queue and stopping flag
+        std::condition_variable m_wake;     // wakes the writer when there is work
+        std::vector<Turn>       m_queue;    // turns waiting to be written
+        bool                    m_stopping; // true when the writer should finish up and stop
+
+        // used by the writer thread once it has started
+        Level         m_level;         // the level as saved so far
+        std::ofstream m_journal;       // journal file, open for appending
+        sf::Uint32    m_generation;    // number of the current snapshot
+        size_t        m_journalBytes;  // size of the journal
+        size_t        m_snapshotBytes; // size of the snapshot
+
+        // copy the current level out of the maze and tilemap
+        Level captureLevel() const;
+
+        // set the maze and tilemap to a saved level
+        void applyLevel(const Level &level);
+
+        // read a snapshot, returning false if there is none or it cannot be read
+        bool readSnapshot(Level &level, sf::Uint32 &generation) const;
+
+        // apply the complete turns of the journal that follows the given snapshot,
+        // returning how many were replayed
+        sf::Uint32 replayJournal(sf::Uint32 generation, Level &level) const;
+
+        // write m_level as a new snapshot and start a new, empty journal after it
+        bool compactJournal();
+
+        // apply a turn to m_level and append it to the journal
+        void writeTurn(Turn &turn);
+
+        // write turns until told to stop
+        void run();
+
+    public:
+        // the level is saved to path.snapshot and path.journal
+        ChangeJournal(const std::string &path, Maze *maze, Tilemap *tilemap);
+        ~ChangeJournal();
+
+        ChangeJournal(const ChangeJournal &)            = delete;
+        ChangeJournal &operator=(const ChangeJournal &) = delete;
+
+        // recover the saved level into the maze and tilemap, if there is one that
+        // fits them, and start journalling. Without a saved level, the current one
+        // is saved as the first snapshot. Returns true if a level was recovered.
+        bool open();
+
+        // save the changes made since the last call as one turn, in the background
+        void endTurn();
+
+        // fold the journal into a new snapshot once the current turn is written
+        void compact();
+
+        // MazeListener
+        void onCellChanged(const sf::Vector2u &position, Cell cell) override;
+        void onMazeGenerated() override;
+
+        // TilemapListener
+        void onTileChanged(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id) override;
+};
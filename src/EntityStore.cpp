@@ -0,0 +1,289 @@
+#include "EntityStore.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+EntityStore::EntityStore(const sf::Vector2u &mapSize)
+{
+    m_mapSize = mapSize;
+    m_tileHeads.resize(mapSize.x * mapSize.y, NONE);
+    m_vertices.setPrimitiveType(sf::Triangles);
+}
+
+sf::Uint32 EntityStore::cellIndex(const sf::Vector2f &position) const
+{
+    // positions are clamped to the map so that an entity which wanders off the
+    // edge is still indexed and can be found again
+    auto x = static_cast<sf::Uint32>(std::clamp(std::floor(position.x), 0.f, static_cast<float>(m_mapSize.x - 1)));
+    auto y = static_cast<sf::Uint32>(std::clamp(std::floor(position.y), 0.f, static_cast<float>(m_mapSize.y - 1)));
+
+    return y * m_mapSize.x + x;
+}
+
+void EntityStore::link(sf::Uint32 slot, sf::Uint32 cell)
+{
+    // new entities are pushed on the front of the tile list
+    sf::Uint32 head = m_tileHeads[cell];
+
+    m_cell[slot] = cell;
+    m_prev[slot] = NONE;
+    m_next[slot] = head;
+
+    if (head != NONE) {
+        m_prev[head] = slot;
+    }
+
+    m_tileHeads[cell] = slot;
+}
+
+void EntityStore::unlink(sf::Uint32 slot)
+{
+    sf::Uint32 prev = m_prev[slot];
+    sf::Uint32 next = m_next[slot];
+
+    if (prev != NONE) {
+        m_next[prev] = next;
+    } else {
+        m_tileHeads[m_cell[slot]] = next;
+    }
+
+    if (next != NONE) {
+        m_prev[next] = prev;
+    }
+
+    m_prev[slot] = NONE;
+    m_next[slot] = NONE;
+    m_cell[slot] = NONE;
+}
+
+EntityId EntityStore::create(EntityKind kind, const sf::Vector2f &position, sf::Uint32 sprite)
+{
+    if (m_mapSize.x == 0 || m_mapSize.y == 0) {
+        spdlog::error("EntityStore::create: store has no map");
+        return EntityId{NONE, 0};
+    }
+
+    // reuse a free slot if there is one, otherwise grow the sparse arrays
+    sf::Uint32 slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        slot = m_generations.size();
+        m_generations.push_back(0);
+        m_dense.push_back(NONE);
+        m_next.push_back(NONE);
+        m_prev.push_back(NONE);
+        m_cell.push_back(NONE);
+    }
+
+    m_dense[slot] = m_slots.size();
+    m_slots.push_back(slot);
+    m_kinds.push_back(kind);
+    m_positions.push_back(position);
+    m_sprites.push_back(sprite);
+    m_colors.push_back(sf::Color::White);
+
+    link(slot, cellIndex(position));
+
+    return EntityId{slot, m_generations[slot]};
+}
+
+void EntityStore::destroy(EntityId id)
+{
+    if (!isAlive(id)) {
+        return;
+    }
+
+    unlink(id.index);
+
+    // keep the component arrays packed by moving the last entity into the hole
+    sf::Uint32 dense = m_dense[id.index];
+    sf::Uint32 last  = m_slots.size() - 1;
+
+    if (dense != last) {
+        m_slots[dense]     = m_slots[last];
+        m_kinds[dense]     = m_kinds[last];
+        m_positions[dense] = m_positions[last];
+        m_sprites[dense]   = m_sprites[last];
+        m_colors[dense]    = m_colors[last];
+
+        m_dense[m_slots[dense]] = dense;
+    }
+
+    m_slots.pop_back();
+    m_kinds.pop_back();
+    m_positions.pop_back();
+    m_sprites.pop_back();
+    m_colors.pop_back();
+
+    m_dense[id.index] = NONE;
+    m_generations[id.index]++;
+    m_freeSlots.push_back(id.index);
+}
+
+bool EntityStore::isAlive(EntityId id) const
+{
+    return id.index < m_generations.size() && m_generations[id.index] == id.generation && m_dense[id.index] != NONE;
+}
+
+void EntityStore::clear()
+{
+    // bump the generation of every live slot so that outstanding ids go stale
+    for (auto slot : m_slots) {
+        m_generations[slot]++;
+        m_dense[slot] = NONE;
+        m_next[slot]  = NONE;
+        m_prev[slot]  = NONE;
+        m_cell[slot]  = NONE;
+        m_freeSlots.push_back(slot);
+    }
+
+    m_slots.clear();
+    m_kinds.clear();
+    m_positions.clear();
+    m_sprites.clear();
+    m_colors.clear();
+
+    std::fill(m_tileHeads.begin(), m_tileHeads.end(), NONE);
+}
+
+void EntityStore::setPosition(EntityId id, const sf::Vector2f &position)
+{
+    if (!isAlive(id)) {
+        spdlog::error("EntityStore::setPosition: stale entity id");
+        return;
+    }
+
+    m_positions[m_dense[id.index]] = position;
+
+    sf::Uint32 cell = cellIndex(position);
+    if (cell != m_cell[id.index]) {
+        unlink(id.index);
+        link(id.index, cell);
+    }
+}
+
+sf::Vector2f EntityStore::getPosition(EntityId id) const
+{
+    if (!isAlive(id)) {
+        return sf::Vector2f(0, 0);
+    }
+
+    return m_positions[m_dense[id.index]];
+}
+
+void EntityStore::setSprite(EntityId id, sf::Uint32 sprite, const sf::Color &color)
+{
+    if (!isAlive(id)) {
+        spdlog::error("EntityStore::setSprite: stale entity id");
+        return;
+    }
+
+    m_sprites[m_dense[id.index]] = sprite;
+    m_colors[m_dense[id.index]]  = color;
+}
+
+EntityKind EntityStore::getKind(EntityId id) const
+{
+    if (!isAlive(id)) {
+        return EntityKind::ITEM;
+    }
+
+    return m_kinds[m_dense[id.index]];
+}
+
+EntityId EntityStore::getId(sf::Uint32 denseIndex) const
+{
+    if (denseIndex >= m_slots.size()) {
+        return EntityId{NONE, 0};
+    }
+
+    sf::Uint32 slot = m_slots[denseIndex];
+    return EntityId{slot, m_generations[slot]};
+}
+
+void EntityStore::getEntitiesAt(const sf::Vector2u &position, std::vector<EntityId> &out) const
+{
+    if (position.x >= m_mapSize.x || position.y >= m_mapSize.y) {
+        return;
+    }
+
+    for (sf::Uint32 slot = m_tileHeads[position.y * m_mapSize.x + position.x]; slot != NONE; slot = m_next[slot]) {
+        out.push_back(EntityId{slot, m_generations[slot]});
+    }
+}
+
+void EntityStore::getEntitiesIn(const sf::IntRect &area, std::vector<EntityId> &out) const
+{
+    // clip the rectangle to the map so that we only walk tiles that exist
+    sf::Uint32 left   = std::clamp(area.left, 0, static_cast<int>(m_mapSize.x));
+    sf::Uint32 top    = std::clamp(area.top, 0, static_cast<int>(m_mapSize.y));
+    sf::Uint32 right  = std::clamp(area.left + area.width, 0, static_cast<int>(m_mapSize.x));
+    sf::Uint32 bottom = std::clamp(area.top + area.height, 0, static_cast<int>(m_mapSize.y));
+
+    for (sf::Uint32 y = top; y < bottom; y++) {
+        const sf::Uint32 *row = &m_tileHeads[y * m_mapSize.x];
+        for (sf::Uint32 x = left; x < right; x++) {
+            for (sf::Uint32 slot = row[x]; slot != NONE; slot = m_next[slot]) {
+                out.push_back(EntityId{slot, m_generations[slot]});
+            }
+        }
+    }
+}
+
+bool EntityStore::isOccupied(const sf::Vector2u &position) const
+{
+    if (position.x >= m_mapSize.x || position.y >= m_mapSize.y) {
+        return false;
+    }
+
+    return m_tileHeads[position.y * m_mapSize.x + position.x] != NONE;
+}
+
+void EntityStore::draw(sf::RenderTarget    &target,
+                       const Tilesheet     &tilesheet,
+                       const sf::FloatRect &viewPort,
+                       const sf::Vector2f  &viewPosition,
+                       const sf::Vector2u   scale)
+{
+    auto tileSize = tilesheet.getTileSize();
+    auto tilePx   = sf::Vector2f(tileSize.x * scale.x, tileSize.y * scale.y);
+
+    // Work out which tiles are under the view. Entities are drawn from their
+    // position towards the bottom right, so the range is widened by a tile to pick
+    // up entities that straddle the top or left edge.
+    sf::Vector2f viewSize(viewPort.width / tilePx.x, viewPort.height / tilePx.y);
+    sf::IntRect  visible(static_cast<int>(std::floor(viewPosition.x - viewSize.x / 2.f)) - 1,
+                        static_cast<int>(std::floor(viewPosition.y - viewSize.y / 2.f)) - 1,
+                        static_cast<int>(std::ceil(viewSize.x)) + 2,
+                        static_cast<int>(std::ceil(viewSize.y)) + 2);
+
+    sf::Uint32 left   = std::clamp(visible.left, 0, static_cast<int>(m_mapSize.x));
+    sf::Uint32 top    = std::clamp(visible.top, 0, static_cast<int>(m_mapSize.y));
+    sf::Uint32 right  = std::clamp(visible.left + visible.width, 0, static_cast<int>(m_mapSize.x));
+    sf::Uint32 bottom = std::clamp(visible.top + visible.height, 0, static_cast<int>(m_mapSize.y));
+
+    m_vertices.clear();
+
+    for (sf::Uint32 y = top; y < bottom; y++) {
+        const sf::Uint32 *row = &m_tileHeads[y * m_mapSize.x];
+        for (sf::Uint32 x = left; x < right; x++) {
+            for (sf::Uint32 slot = row[x]; slot != NONE; slot = m_next[slot]) {
+                sf::Uint32 dense    = m_dense[slot];
+                auto       position = m_positions[dense];
+
+                auto pixelPosition = sf::Vector2f((position.x - viewPosition.x) * tilePx.x + viewPort.width / 2,
+                                                  (position.y - viewPosition.y) * tilePx.y + viewPort.height / 2);
+
+                tilesheet.appendTile(m_vertices, m_sprites[dense], pixelPosition, scale, m_colors[dense]);
+            }
+        }
+    }
+
+    if (m_vertices.getVertexCount() > 0) {
+        target.draw(m_vertices, sf::RenderStates(&tilesheet.getTexture()));
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Tilesheet.hpp"
+
+// EntityKind identifies what sort of thing an entity is.
+enum class EntityKind
+{
+    MONSTER,
+    ITEM,
+    PROJECTILE
+};
+
+// EntityId is a generational handle to an entity in the EntityStore. The index
+// names a slot in the store, and the generation is bumped every time the slot is
+// reused, so a stale id held by gameplay code can never alias a newer entity.
+struct EntityId
+{
+    sf::Uint32 index;      // slot in the store
+    sf::Uint32 generation; // generation of the slot when the id was issued
+
+    bool operator==(const EntityId &other) const = default;
+};
+
+// EntityStore holds every monster, item and projectile on the map as a
+// struct-of-arrays. Components are kept in dense arrays that are packed on
+// destroy, so systems that touch every entity walk contiguous memory.
+//
+// On top of the dense arrays the store keeps an occupancy index aligned to the
+// map grid: every tile holds the head of an intrusive doubly linked list of the
+// entities standing on it. Asking what is on a tile is O(1) plus the number of
+// entities there, and asking what is in a rectangle only visits the tiles in it.
+class EntityStore
+{
+    private:
+        static constexpr sf::Uint32 NONE = 0xffffffff; // marks an empty link or slot
+
+        sf::Vector2u m_mapSize; // size of the map in tiles
+
+        // sparse slot data, indexed by EntityId::index
+        std::vector<sf::Uint32> m_generations; // current generation of each slot
+        std::vector<sf::Uint32> m_dense;       // dense index of each live slot
+        std::vector<sf::Uint32> m_freeSlots;   // slots available for reuse
+        std::vector<sf::Uint32> m_next;        // next slot on the same tile
+        std::vector<sf::Uint32> m_prev;        // previous slot on the same tile
+        std::vector<sf::Uint32> m_cell;        // tile index each slot is linked into
+
+        // dense component arrays, indexed by dense index
+        std::vector<sf::Uint32>   m_slots;     // slot owning each dense entry
+        std::vector<EntityKind>   m_kinds;     // kind of each entity
+        std::vector<sf::Vector2f> m_positions; // position in tile coordinates
+        std::vector<sf::Uint32>   m_sprites;   // tile id in the tilesheet used to draw it
+        std::vector<sf::Color>    m_colors;    // colour the sprite is modulated with
+
+        // occupancy index, one list head per tile
+        std::vector<sf::Uint32> m_tileHeads;
+
+        // vertex batch rebuilt by draw
+        sf::VertexArray m_vertices;
+
+        // returns the tile index a position falls into, clamped to the map
+        sf::Uint32 cellIndex(const sf::Vector2f &position) const;
+
+        // link or unlink a slot from the list of the tile it stands on
+        void link(sf::Uint32 slot, sf::Uint32 cell);
+        void unlink(sf::Uint32 slot);
+
+    public:
+        EntityStore(const sf::Vector2u &mapSize);
+        ~EntityStore() = default;
+
+        // create a new entity at the given position in tile coordinates. sprite is
+        // the id of the tile in the tilesheet used to draw the entity.
+        EntityId create(EntityKind kind, const sf::Vector2f &position, sf::Uint32 sprite);
+
+        // destroy an entity; stale ids are ignored
+        void destroy(EntityId id);
+
+        // check if an id still refers to a live entity
+        bool isAlive(EntityId id) const;
+
+        // remove every entity from the store
+        void clear();
+
+        // get the number of live entities
+        sf::Uint32 size() const
+        {
+            return m_slots.size();
+        }
+
+        // move an entity. The occupancy index is only touched when the entity
+        // crosses into another tile.
+        void setPosition(EntityId id, const sf::Vector2f &position);
+
+        // get the position of an entity in tile coordinates
+        sf::Vector2f getPosition(EntityId id) const;
+
+        // set the tile id and colour used to draw an entity
+        void setSprite(EntityId id, sf::Uint32 sprite, const sf::Color &color = sf::Color::White);
+
+        // get the kind of an entity
+        EntityKind getKind(EntityId id) const;
+
+        // get the entities standing on a tile. Results are appended to out.
+        void getEntitiesAt(const sf::Vector2u &position, std::vector<EntityId> &out) const;
+
+        // get the entities inside a rectangle of tiles. Results are appended to out.
+        void getEntitiesIn(const sf::IntRect &area, std::vector<EntityId> &out) const;
+
+        // check if any entity stands on a tile
+        bool isOccupied(const sf::Vector2u &position) const;
+
+        // dense component arrays, for systems that want to walk every entity.
+        // Entries at the same index belong to the same entity.
+        const std::vector<EntityKind> &getKinds() const
+        {
+            return m_kinds;
+        }
+
+        const std::vector<sf::Vector2f> &getPositions() const
+        {
+            return m_positions;
+        }
+
+        // get the id of the entity stored at a dense index
+        EntityId getId(sf::Uint32 denseIndex) const;
+
+        // draw the visible entities to the target with the same camera conventions
+        // as Tilemap::draw. Only the tiles under the view are visited, and every
+        // entity is batched into a single draw call using the tilesheet texture.
+        void draw(sf::RenderTarget    &target,
+                  const Tilesheet     &tilesheet,
+                  const sf::FloatRect &viewPort,
+                  const sf::Vector2f  &viewPosition,
+                  const sf::Vector2u   scale);
+};
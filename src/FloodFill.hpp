@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SFML/System/Vector2.hpp>
+
+#include "Grid.hpp"
+
+// floodRelabel changes the label of every cell connected to start, through the
+// four cells next to each, from from to to. It is the search Maze uses to merge
+// regions, written against any Grid layout so that quantum-gen can time it in
+// each of them.
+//
+// The cells changed are left in queue, which is cleared first and can be kept
+// between calls so that relabelling does not allocate once it has grown. The grid
+// needs a border at least one cell wide that is never labelled from, so that no
+// neighbour needs a bounds check.
+template <typename Layout, typename Queue>
+void floodRelabel(Grid<sf::Uint32, Layout> &labels,
+                  const sf::Vector2i       &start,
+                  sf::Uint32                from,
+                  sf::Uint32                to,
+                  Queue                    &queue)
+{
+    const int offsetsX[4] = {0, -1, 1, 0};
+    const int offsetsY[4] = {-1, 0, 0, 1};
+
+    queue.clear();
+    queue.push_back(start);
+    labels(start.x, start.y) = to;
+
+    for (size_t i = 0; i < queue.size(); i++) {
+        auto cell = queue[i];
+        for (int d = 0; d < 4; d++) {
+            int nx = cell.x + offsetsX[d];
+            int ny = cell.y + offsetsY[d];
+
+            if (labels(nx, ny) == from) {
+                labels(nx, ny) = to;
+                queue.push_back(sf::Vector2i(nx, ny));
+            }
+        }
+    }
+}
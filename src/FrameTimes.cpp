@@ -0,0 +1,42 @@
+#include "FrameTimes.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+void FrameTimes::add(sf::Time time)
+{
+    m_times.push_back(time.asMicroseconds());
+}
+
+sf::Time FrameTimes::getPercentile(float fraction) const
+{
+    if (m_times.empty()) {
+        return sf::Time::Zero;
+    }
+
+    // nth_element only needs a copy, not a full sort, to find one rank
+    std::vector<sf::Int64> times(m_times);
+    size_t                 rank = std::ceil(std::clamp(fraction, 0.f, 1.f) * times.size());
+    rank                        = std::clamp<size_t>(rank, 1, times.size()) - 1;
+
+    std::nth_element(times.begin(), times.begin() + rank, times.end());
+
+    return sf::microseconds(times[rank]);
+}
+
+void FrameTimes::report(const std::string &label) const
+{
+    if (m_times.empty()) {
+        spdlog::info("{}: no frames", label);
+        return;
+    }
+
+    spdlog::info("{}: {} frames, p50 {:.2f}ms, p99 {:.2f}ms, max {:.2f}ms",
+                 label,
+                 m_times.size(),
+                 getPercentile(0.5f).asMicroseconds() / 1000.0,
+                 getPercentile(0.99f).asMicroseconds() / 1000.0,
+                 getPercentile(1.f).asMicroseconds() / 1000.0);
+}
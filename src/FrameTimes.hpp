@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <SFML/System/Time.hpp>
+
+// FrameTimes collects how long each frame took and summarises them as
+// percentiles. The median shows the typical cost of a frame, while the 99th
+// percentile and the maximum show the hitches that an average hides.
+class FrameTimes
+{
+    private:
+        std::vector<sf::Int64> m_times; // frame times in microseconds
+
+    public:
+        FrameTimes()  = default;
+        ~FrameTimes() = default;
+
+        // add the time a frame took
+        void add(sf::Time time);
+
+        // get the number of frames measured
+        size_t getCount() const
+        {
+            return m_times.size();
+        }
+
+        // get the frame time that the given fraction of frames, from 0 to 1, took
+        // no longer than. Uses the nearest frame rather than interpolating.
+        sf::Time getPercentile(float fraction) const;
+
+        // log the frame count, p50, p99 and maximum frame times
+        void report(const std::string &label) const;
+};
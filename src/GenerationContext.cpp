@@ -0,0 +1,44 @@
+#include "GenerationContext.hpp"
+
+GenerationContext::UpstreamCounter::UpstreamCounter()
+{
+    m_allocated = 0;
+}
+
+void *GenerationContext::UpstreamCounter::do_allocate(size_t bytes, size_t alignment)
+{
+    m_allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void GenerationContext::UpstreamCounter::do_deallocate(void *pointer, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+bool GenerationContext::UpstreamCounter::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+    return this == &other;
+}
+
+GenerationContext::GenerationContext(size_t bufferSize)
+{
+    m_buffer.resize(bufferSize);
+    m_threads = 0;
+    m_arena.emplace(m_buffer.data(), m_buffer.size(), &m_upstream);
+}
+
+void GenerationContext::reset()
+{
+    // the overflow goes back to the heap, but stays counted until the buffer has grown
+    m_arena->release();
+
+    if (m_upstream.getAllocated() > 0) {
+        // the arena also pads for alignment and grows its overflow blocks
+        // geometrically, so leave some room over what was used
+        m_buffer.resize((m_buffer.size() + m_upstream.getAllocated()) * 5 / 4);
+        m_upstream.resetAllocated();
+    }
+
+    m_arena.emplace(m_buffer.data(), m_buffer.size(), &m_upstream);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+#include <SFML/Config.hpp>
+
+// GenerationContext holds what maze generation needs besides the maze itself: a
+// monotonic arena for the temporary buffers of each step, and the number of
+// threads to use.
+//
+// Allocating from the arena is a pointer bump, and nothing is freed until
+// reset, which makes the whole arena reusable at once. The arena starts on a
+// buffer of its own; if a run needs more, the extra comes from the heap, and the
+// next reset grows the buffer to cover it. After a few runs the buffer is big
+// enough for any of them, and generating no longer touches the heap at all.
+//
+// Memory from the arena is only valid until the next reset, so temporaries must
+// not outlive the step that made them. The arena is not thread safe: workers must
+// be handed buffers allocated before they start.
+class GenerationContext
+{
+    private:
+        // UpstreamCounter passes the allocations the arena buffer could not hold on
+        // to the heap, counting them so that reset knows how far to grow.
+        class UpstreamCounter : public std::pmr::memory_resource
+        {
+            private:
+                size_t m_allocated; // bytes allocated since the last reset
+
+            protected:
+                void *do_allocate(size_t bytes, size_t alignment) override;
+                void  do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+                bool  do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+            public:
+                UpstreamCounter();
+
+                size_t getAllocated() const
+                {
+                    return m_allocated;
+                }
+
+                void resetAllocated()
+                {
+                    m_allocated = 0;
+                }
+        };
+
+        std::vector<std::byte>                             m_buffer;   // memory the arena allocates from first
+        UpstreamCounter                                    m_upstream; // heap memory when the buffer is full
+        std::optional<std::pmr::monotonic_buffer_resource> m_arena;    // the arena over m_buffer
+        sf::Uint32                                         m_threads;  // threads to use, 0 for all of them
+
+    public:
+        GenerationContext(size_t bufferSize = 0);
+        ~GenerationContext() = default;
+
+        GenerationContext(const GenerationContext &)            = delete;
+        GenerationContext &operator=(const GenerationContext &) = delete;
+
+        // free everything allocated from the arena, growing its buffer first if
+        // the last run did not fit in it
+        void reset();
+
+        // get the arena, for std::pmr containers holding temporaries
+        std::pmr::memory_resource *getArena()
+        {
+            return &*m_arena;
+        }
+
+        // get the size of the arena buffer in bytes
+        size_t getBufferSize() const
+        {
+            return m_buffer.size();
+        }
+
+        // set the number of threads steps may use, 0 for every hardware thread. With
+        // 1 no threads are started, which is best when many mazes are generated at
+        // once, and is the only way generation is fully free of allocations.
+        void setThreads(sf::Uint32 threads)
+        {
+            m_threads = threads;
+        }
+
+        sf::Uint32 getThreads() const
+        {
+            return m_threads;
+        }
+};
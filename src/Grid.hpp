@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <SFML/System/Vector2.hpp>
+
+#include "GridView.hpp"
+
+// Grid layouts decide where element (x, y) of a grid lives in memory. Each one
+// provides getCapacity, the number of elements needed to store a grid of the
+// given size, and getIndex, the position of an element within them. Both are
+// given the size of the whole grid including any border. quantum-gen
+// --bench-layout times Autotile and the region flood fill of Maze in each of them,
+// to pick the layout that suits a workload.
+
+// RowMajor stores the grid row by row. It is the layout that suits code walking
+// whole rows, and the only one that can be seen through a GridView.
+struct RowMajor
+{
+    static size_t getCapacity(const sf::Vector2u &size)
+    {
+        return static_cast<size_t>(size.x) * size.y;
+    }
+
+    static size_t getIndex(sf::Uint32 x, sf::Uint32 y, const sf::Vector2u &size)
+    {
+        return static_cast<size_t>(y) * size.x + x;
+    }
+};
+
+// Tiled stores the grid in square blocks of Block x Block elements, each block
+// row by row and the blocks themselves row by row. A cell and its neighbours
+// usually share a block, so stencils and flood fills that wander in both
+// directions can touch fewer cache lines than with RowMajor.
+template <sf::Uint32 Block = 8>
+struct Tiled
+{
+    static_assert(std::has_single_bit(Block), "Tiled block size must be a power of two");
+
+    static size_t getCapacity(const sf::Vector2u &size)
+    {
+        size_t blocksX = (size.x + Block - 1) / Block;
+        size_t blocksY = (size.y + Block - 1) / Block;
+        return blocksX * blocksY * Block * Block;
+    }
+
+    static size_t getIndex(sf::Uint32 x, sf::Uint32 y, const sf::Vector2u &size)
+    {
+        size_t blocksX = (size.x + Block - 1) / Block;
+        size_t block   = (y / Block) * blocksX + x / Block;
+        return block * Block * Block + (y % Block) * Block + x % Block;
+    }
+};
+
+// Morton stores the grid in Z-order, interleaving the bits of x and y, so that
+// cells close together in 2D are close together in memory at every scale. The
+// grid is stored in the smallest power of two square that holds it, and each
+// side is limited to 65536 elements.
+struct Morton
+{
+    // spread the low 16 bits of v out to the even bits
+    static sf::Uint32 spread(sf::Uint32 v)
+    {
+        v &= 0x0000FFFF;
+        v  = (v | (v << 8)) & 0x00FF00FF;
+        v  = (v | (v << 4)) & 0x0F0F0F0F;
+        v  = (v | (v << 2)) & 0x33333333;
+        v  = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    static size_t getCapacity(const sf::Vector2u &size)
+    {
+        size_t side = std::bit_ceil(std::max(size.x, size.y));
+        return side * side;
+    }
+
+    static size_t getIndex(sf::Uint32 x, sf::Uint32 y, const sf::Vector2u &)
+    {
+        return spread(x) | (static_cast<size_t>(spread(y)) << 1);
+    }
+};
+
+// Grid is an owning 2D array of T stored in the given Layout, used for the cells
+// of a Maze or RoomShape and the layers of a Tilemap.
+//
+// A grid can have a sentinel border: extra rows and columns of ghost cells on
+// every side, filled with a value of their own. Coordinates from -border up to
+// size + border - 1 are valid, so a 3x3 stencil over a grid with a border of 1
+// never needs to check whether a neighbour is inside the grid. Element access is
+// not bounds checked; use contains() for positions that may be outside.
+template <typename T, typename Layout = RowMajor>
+class Grid
+{
+    private:
+        sf::Vector2u   m_size;   // size of the grid, without the border
+        sf::Uint32     m_border; // width of the sentinel border on each side
+        sf::Vector2u   m_padded; // size of the grid including the border
+        std::vector<T> m_cells;  // elements of the grid and border, in Layout order
+
+        size_t getIndex(int x, int y) const
+        {
+            return Layout::getIndex(x + m_border, y + m_border, m_padded);
+        }
+
+    public:
+        Grid()
+        {
+            m_size   = sf::Vector2u(0, 0);
+            m_border = 0;
+            m_padded = sf::Vector2u(0, 0);
+        }
+
+        Grid(const sf::Vector2u &size, const T &value = T(), sf::Uint32 border = 0)
+        {
+            resize(size, value, border);
+        }
+
+        // resize the grid, filling it and its border with value
+        void resize(const sf::Vector2u &size, const T &value = T(), sf::Uint32 border = 0)
+        {
+            m_size   = size;
+            m_border = border;
+            m_padded = sf::Vector2u(size.x + border * 2, size.y + border * 2);
+
+            m_cells.assign(Layout::getCapacity(m_padded), value);
+        }
+
+        // fill the grid, but not its border, with value
+        void fill(const T &value)
+        {
+            for (int y = 0; y < static_cast<int>(m_size.y); y++) {
+                for (int x = 0; x < static_cast<int>(m_size.x); x++) {
+                    m_cells[getIndex(x, y)] = value;
+                }
+            }
+        }
+
+        // fill the border, but not the grid, with value
+        void fillBorder(const T &value)
+        {
+            int border = m_border;
+            for (int y = -border; y < static_cast<int>(m_size.y) + border; y++) {
+                for (int x = -border; x < static_cast<int>(m_size.x) + border; x++) {
+                    if (x < 0 || y < 0 || x >= static_cast<int>(m_size.x) || y >= static_cast<int>(m_size.y)) {
+                        m_cells[getIndex(x, y)] = value;
+                    }
+                }
+            }
+        }
+
+        // get the size of the grid, without the border
+        sf::Vector2u getSize() const
+        {
+            return m_size;
+        }
+
+        // get the width of the border on each side
+        sf::Uint32 getBorder() const
+        {
+            return m_border;
+        }
+
+        // true if the position is inside the grid, not counting the border
+        bool contains(const sf::Vector2u &position) const
+        {
+            return position.x < m_size.x && position.y < m_size.y;
+        }
+
+        // get the element at a position. Positions in the border are allowed.
+        T &operator()(int x, int y)
+        {
+            return m_cells[getIndex(x, y)];
+        }
+
+        const T &operator()(int x, int y) const
+        {
+            return m_cells[getIndex(x, y)];
+        }
+
+        T &operator[](const sf::Vector2u &position)
+        {
+            return m_cells[getIndex(position.x, position.y)];
+        }
+
+        const T &operator[](const sf::Vector2u &position) const
+        {
+            return m_cells[getIndex(position.x, position.y)];
+        }
+
+        // get a view of the grid, without the border. Rows of the view are strided
+        // over the border, so only RowMajor grids can be viewed.
+        GridView<T> view()
+            requires std::is_same_v<Layout, RowMajor>
+        {
+            if (m_cells.empty()) {
+                return GridView<T>();
+            }
+
+            return GridView<T>(&m_cells[getIndex(0, 0)], m_size, m_padded.x);
+        }
+
+        GridView<const T> view() const
+            requires std::is_same_v<Layout, RowMajor>
+        {
+            if (m_cells.empty()) {
+                return GridView<const T>();
+            }
+
+            return GridView<const T>(&m_cells[getIndex(0, 0)], m_size, m_padded.x);
+        }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+
+// GridView is a non-owning view of a 2D grid of elements stored row by row, such
+// as the cells of a Maze or RoomShape or a layer of a Tilemap. It holds only a
+// pointer, a size and a stride, so it is cheap to copy and pass by value.
+//
+// The stride is the distance in elements between the starts of two consecutive
+// rows. It is equal to the width for a whole grid, and larger for a view of a
+// rectangle inside a bigger grid, which lets sub-rect views share the storage of
+// the grid they were cut from.
+//
+// Element access does no bounds checking. Bulk consumers are expected to iterate
+// over row(y) spans, which compile down to plain pointer loops, and to use
+// contains() or sub() where positions may fall outside the grid.
+//
+// A view is only valid while the grid it was taken from is alive and not
+// resized.
+template <typename T>
+class GridView
+{
+    private:
+        T           *m_data;   // first element of the first row
+        sf::Vector2u m_size;   // size of the view in elements
+        size_t       m_stride; // elements between the starts of two rows
+
+    public:
+        GridView()
+        {
+            m_data   = nullptr;
+            m_size   = sf::Vector2u(0, 0);
+            m_stride = 0;
+        }
+
+        // a view of a grid whose rows are stored back to back
+        GridView(T *data, const sf::Vector2u &size)
+        {
+            m_data   = data;
+            m_size   = size;
+            m_stride = size.x;
+        }
+
+        // a view of a grid whose rows start stride elements apart
+        GridView(T *data, const sf::Vector2u &size, size_t stride)
+        {
+            m_data   = data;
+            m_size   = size;
+            m_stride = stride;
+        }
+
+        // a view of mutable elements converts to a view of const elements
+        template <typename U>
+            requires std::is_convertible_v<U (*)[], T (*)[]>
+        GridView(const GridView<U> &other)
+        {
+            m_data   = other.data();
+            m_size   = other.getSize();
+            m_stride = other.getStride();
+        }
+
+        // get the first element of the first row
+        T *data() const
+        {
+            return m_data;
+        }
+
+        // get the size of the view in elements
+        sf::Vector2u getSize() const
+        {
+            return m_size;
+        }
+
+        // get the distance in elements between the starts of two rows
+        size_t getStride() const
+        {
+            return m_stride;
+        }
+
+        // true if the view has no elements
+        bool empty() const
+        {
+            return m_size.x == 0 || m_size.y == 0;
+        }
+
+        // true if the rows are stored back to back, so that elements() is valid
+        bool isContiguous() const
+        {
+            return m_stride == m_size.x;
+        }
+
+        // true if the position is inside the view
+        bool contains(const sf::Vector2u &position) const
+        {
+            return position.x < m_size.x && position.y < m_size.y;
+        }
+
+        // get a row of the view
+        std::span<T> row(sf::Uint32 y) const
+        {
+            return std::span<T>(m_data + y * m_stride, m_size.x);
+        }
+
+        // get every element of a contiguous view as one span
+        std::span<T> elements() const
+        {
+            return std::span<T>(m_data, m_stride * m_size.y);
+        }
+
+        // get the element at a position
+        T &operator()(sf::Uint32 x, sf::Uint32 y) const
+        {
+            return m_data[y * m_stride + x];
+        }
+
+        T &operator[](const sf::Vector2u &position) const
+        {
+            return m_data[position.y * m_stride + position.x];
+        }
+
+        // get a view of a rectangle of this view, clipped to it. The new view
+        // shares the storage and stride of this one.
+        GridView sub(const sf::IntRect &area) const
+        {
+            int left   = std::clamp(area.left, 0, static_cast<int>(m_size.x));
+            int top    = std::clamp(area.top, 0, static_cast<int>(m_size.y));
+            int right  = std::clamp(area.left + area.width, 0, static_cast<int>(m_size.x));
+            int bottom = std::clamp(area.top + area.height, 0, static_cast<int>(m_size.y));
+
+            if (right <= left || bottom <= top) {
+                return GridView();
+            }
+
+            return GridView(m_data + top * m_stride + left, sf::Vector2u(right - left, bottom - top), m_stride);
+        }
+};
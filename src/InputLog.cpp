@@ -0,0 +1,172 @@
+#include "InputLog.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+struct LogHeader
+{
+    char       magic[4] = {'Q', 'I', 'N', 'P'};
+    sf::Uint32 version  = 1;
+    sf::Uint32 seed;
+    sf::Uint32 windowWidth;
+    sf::Uint32 windowHeight;
+    sf::Uint32 frames;
+};
+
+// each frame is stored as this, followed by its events
+struct FrameRecord
+{
+    sf::Uint32 time;
+    sf::Int32  mouseX;
+    sf::Int32  mouseY;
+    sf::Uint8  keys;
+    sf::Uint8  events;
+};
+
+struct EventRecord
+{
+    sf::Uint8 type;
+    sf::Int32 key;
+    float     delta;
+};
+
+} // namespace
+
+InputLog::InputLog()
+{
+    m_seed       = 0;
+    m_windowSize = sf::Vector2u(0, 0);
+    m_next       = 0;
+}
+
+void InputLog::addFrame(const InputFrame &frame)
+{
+    m_frames.push_back(frame);
+}
+
+bool InputLog::nextFrame(InputFrame &frame)
+{
+    if (m_next >= m_frames.size()) {
+        return false;
+    }
+
+    frame = m_frames[m_next++];
+    return true;
+}
+
+bool InputLog::save(const std::string &filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        spdlog::error("InputLog::save: failed to open {}", filename);
+        return false;
+    }
+
+    LogHeader header;
+    header.seed         = m_seed;
+    header.windowWidth  = m_windowSize.x;
+    header.windowHeight = m_windowSize.y;
+    header.frames       = m_frames.size();
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (const auto &frame : m_frames) {
+        // a frame has at most a handful of events; more than fit in the count are dropped
+        FrameRecord record;
+        record.time   = frame.time;
+        record.mouseX = frame.mouse.x;
+        record.mouseY = frame.mouse.y;
+        record.keys   = frame.keys;
+        record.events = std::min<size_t>(frame.events.size(), 255);
+        file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+
+        for (sf::Uint8 i = 0; i < record.events; i++) {
+            EventRecord event;
+            event.type  = static_cast<sf::Uint8>(frame.events[i].type);
+            event.key   = frame.events[i].key;
+            event.delta = frame.events[i].delta;
+            file.write(reinterpret_cast<const char *>(&event), sizeof(event));
+        }
+    }
+
+    if (!file.good()) {
+        spdlog::error("InputLog::save: failed to write {}", filename);
+        return false;
+    }
+
+    spdlog::info("InputLog::save: saved {} frames to {}", m_frames.size(), filename);
+
+    return true;
+}
+
+bool InputLog::load(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        spdlog::error("InputLog::load: failed to open {}", filename);
+        return false;
+    }
+
+    LogHeader expected;
+    LogHeader header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!file.good() || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version)
+    {
+        spdlog::error("InputLog::load: {} is not an input log this version can read", filename);
+        return false;
+    }
+
+    // every frame is stored as at least a record, so a header that claims more
+    // frames than the rest of the file can hold is corrupt, and nothing is
+    // allocated for it
+    auto start = file.tellg();
+    file.seekg(0, std::ios::end);
+    auto remaining = static_cast<sf::Uint64>(file.tellg() - start);
+    file.seekg(start);
+
+    if (static_cast<sf::Uint64>(header.frames) * sizeof(FrameRecord) > remaining) {
+        spdlog::error("InputLog::load: {} claims {} frames, more than the file holds", filename, header.frames);
+        return false;
+    }
+
+    std::vector<InputFrame> frames(header.frames);
+    for (auto &frame : frames) {
+        FrameRecord record;
+        file.read(reinterpret_cast<char *>(&record), sizeof(record));
+
+        frame.time  = record.time;
+        frame.keys  = record.keys;
+        frame.mouse = sf::Vector2i(record.mouseX, record.mouseY);
+        frame.events.resize(record.events);
+
+        for (auto &event : frame.events) {
+            EventRecord stored;
+            file.read(reinterpret_cast<char *>(&stored), sizeof(stored));
+
+            event.type  = static_cast<InputEvent::Type>(stored.type);
+            event.key   = stored.key;
+            event.delta = stored.delta;
+        }
+
+        if (!file.good()) {
+            spdlog::error("InputLog::load: {} is truncated", filename);
+            return false;
+        }
+    }
+
+    m_seed       = header.seed;
+    m_windowSize = sf::Vector2u(header.windowWidth, header.windowHeight);
+    m_frames     = std::move(frames);
+    m_next       = 0;
+
+    spdlog::info("InputLog::load: loaded {} frames from {}", m_frames.size(), filename);
+
+    return true;
+}
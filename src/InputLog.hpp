@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+// an input event that changes the game, as opposed to the keys held down
+struct InputEvent
+{
+    enum class Type : sf::Uint8
+    {
+        CLOSED,      // the window was closed
+        KEY_PRESSED, // key holds the key code
+        MOUSE_WHEEL, // delta holds the wheel movement
+    };
+
+    Type      type;
+    sf::Int32 key;
+    float     delta;
+};
+
+// the input for one frame of the game
+struct InputFrame
+{
+    // movement keys, as bits of InputFrame::keys
+    static constexpr sf::Uint8 UP    = 1;
+    static constexpr sf::Uint8 DOWN  = 2;
+    static constexpr sf::Uint8 LEFT  = 4;
+    static constexpr sf::Uint8 RIGHT = 8;
+
+    sf::Uint32              time;   // microseconds since recording started
+    sf::Uint8               keys;   // movement keys held down
+    sf::Vector2i            mouse;  // mouse position in the window
+    std::vector<InputEvent> events; // events since the last frame
+};
+
+// InputLog is a recording of everything that drove a run of the game: the maze
+// seed, the window size, and the input of every frame. The game advances one
+// step per frame rather than by elapsed time, so replaying a log repeats the
+// run exactly, however long each frame takes to draw. That makes frame times
+// from a replay comparable across commits and machines.
+//
+// Logs are stored as a small header followed by one record per frame, in the
+// byte order of the machine that recorded them.
+class InputLog
+{
+    private:
+        sf::Uint32              m_seed;       // seed the maze was generated with
+        sf::Vector2u            m_windowSize; // size of the window the log was recorded in
+        std::vector<InputFrame> m_frames;     // input of every frame
+        size_t                  m_next;       // next frame to replay
+
+    public:
+        InputLog();
+        ~InputLog() = default;
+
+        void setSeed(sf::Uint32 seed)
+        {
+            m_seed = seed;
+        }
+
+        sf::Uint32 getSeed() const
+        {
+            return m_seed;
+        }
+
+        void setWindowSize(const sf::Vector2u &size)
+        {
+            m_windowSize = size;
+        }
+
+        sf::Vector2u getWindowSize() const
+        {
+            return m_windowSize;
+        }
+
+        // get the number of frames in the log
+        size_t getFrameCount() const
+        {
+            return m_frames.size();
+        }
+
+        // append the input of a frame while recording
+        void addFrame(const InputFrame &frame);
+
+        // get the input of the next frame while replaying, or false at the end
+        bool nextFrame(InputFrame &frame);
+
+        // save or load the log, returning false on error
+        bool save(const std::string &filename) const;
+        bool load(const std::string &filename);
+};
@@ -0,0 +1,365 @@
+#include "LightMap.hpp"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+LightMap::LightMap(Maze *maze, const sf::Color &ambient)
+{
+    m_maze    = maze;
+    m_size    = maze->getSize();
+    m_ambient = ambient;
+
+    auto cells = m_size.x * m_size.y;
+    m_opaque.resize(cells, 1);
+    m_changedFlag.resize(cells, 0);
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        m_levels[channel].resize(cells, 0);
+        m_sources[channel].resize(cells, 0);
+    }
+
+    rebuild();
+
+    m_maze->addListener(this);
+}
+
+LightMap::~LightMap()
+{
+    m_maze->removeListener(this);
+}
+
+sf::Uint32 LightMap::getNeighbours(sf::Uint32 cell, sf::Uint32 *neighbours) const
+{
+    sf::Uint32 x     = cell % m_size.x;
+    sf::Uint32 y     = cell / m_size.x;
+    sf::Uint32 count = 0;
+
+    if (y > 0) {
+        neighbours[count++] = cell - m_size.x;
+    }
+
+    if (x > 0) {
+        neighbours[count++] = cell - 1;
+    }
+
+    if (x + 1 < m_size.x) {
+        neighbours[count++] = cell + 1;
+    }
+
+    if (y + 1 < m_size.y) {
+        neighbours[count++] = cell + m_size.x;
+    }
+
+    return count;
+}
+
+void LightMap::setLevel(sf::Uint32 channel, sf::Uint32 cell, sf::Uint8 level)
+{
+    m_levels[channel][cell] = level;
+
+    if (!m_changedFlag[cell]) {
+        m_changedFlag[cell] = 1;
+        m_changed.push_back(cell);
+    }
+}
+
+void LightMap::updateSource(sf::Uint32 cell)
+{
+    sf::Uint8 levels[3] = {0, 0, 0};
+
+    for (auto &light : m_lights) {
+        if (light.active && light.position.y * m_size.x + light.position.x == cell) {
+            for (sf::Uint32 channel = 0; channel < 3; channel++) {
+                levels[channel] = std::max(levels[channel], light.levels[channel]);
+            }
+        }
+    }
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        auto previous = m_sources[channel][cell];
+
+        m_sources[channel][cell] = levels[channel];
+
+        // a dimmer source may have been lighting cells the new one cannot reach, so
+        // its light is removed before the cell is lit again
+        if (levels[channel] < previous) {
+            remove(channel, cell);
+        }
+
+        if (m_levels[channel][cell] < levels[channel]) {
+            setLevel(channel, cell, levels[channel]);
+            m_propagate[channel].push_back(cell);
+        }
+    }
+}
+
+void LightMap::remove(sf::Uint32 channel, sf::Uint32 cell)
+{
+    auto level = m_levels[channel][cell];
+    if (level == 0) {
+        return;
+    }
+
+    setLevel(channel, cell, 0);
+    m_remove[channel].push_back(Removal{cell, level});
+
+    if (m_sources[channel][cell] > 0) {
+        m_reseed[channel].push_back(cell);
+    }
+}
+
+void LightMap::refill(sf::Uint32 channel, sf::Uint32 cell)
+{
+    sf::Uint32 neighbours[4];
+    sf::Uint32 count = getNeighbours(cell, neighbours);
+
+    for (sf::Uint32 i = 0; i < count; i++) {
+        if (m_levels[channel][neighbours[i]] > 1) {
+            m_propagate[channel].push_back(neighbours[i]);
+        }
+    }
+}
+
+void LightMap::flush(sf::Uint32 channel)
+{
+    auto &levels    = m_levels[channel];
+    auto &sources   = m_sources[channel];
+    auto &propagate = m_propagate[channel];
+    auto &removals  = m_remove[channel];
+    auto &reseed    = m_reseed[channel];
+
+    sf::Uint32 neighbours[4];
+
+    // Removal: walk outwards from every darkened cell and darken any neighbour that
+    // is dimmer than the light being removed, since that is light which may have
+    // come through it. A neighbour at least as bright is lit from somewhere else
+    // and is queued to spread its light back into the darkened area.
+    for (size_t i = 0; i < removals.size(); i++) {
+        auto removal = removals[i];
+
+        sf::Uint32 count = getNeighbours(removal.cell, neighbours);
+        for (sf::Uint32 n = 0; n < count; n++) {
+            auto neighbour = neighbours[n];
+            auto level     = levels[neighbour];
+
+            if (level == 0) {
+                continue;
+            }
+
+            if (level < removal.level) {
+                setLevel(channel, neighbour, 0);
+                removals.push_back(Removal{neighbour, level});
+
+                if (sources[neighbour] > 0) {
+                    reseed.push_back(neighbour);
+                }
+            } else {
+                propagate.push_back(neighbour);
+            }
+        }
+    }
+
+    removals.clear();
+
+    // light sources caught by the removal are lit again
+    for (auto cell : reseed) {
+        if (levels[cell] < sources[cell]) {
+            setLevel(channel, cell, sources[cell]);
+            propagate.push_back(cell);
+        }
+    }
+
+    reseed.clear();
+
+    // Propagation: breadth first flood fill, one level dimmer per cell. Opaque cells
+    // take light but do not pass it on.
+    for (size_t i = 0; i < propagate.size(); i++) {
+        auto cell  = propagate[i];
+        auto level = levels[cell];
+
+        if (level <= 1 || m_opaque[cell]) {
+            continue;
+        }
+
+        sf::Uint32 count = getNeighbours(cell, neighbours);
+        for (sf::Uint32 n = 0; n < count; n++) {
+            if (levels[neighbours[n]] < level - 1) {
+                setLevel(channel, neighbours[n], level - 1);
+                propagate.push_back(neighbours[n]);
+            }
+        }
+    }
+
+    propagate.clear();
+}
+
+void LightMap::rebuild()
+{
+    auto cells = m_maze->getCells();
+
+    for (sf::Uint32 y = 0; y < m_size.y; y++) {
+        auto row = cells.row(y);
+        for (sf::Uint32 x = 0; x < m_size.x; x++) {
+            m_opaque[y * m_size.x + x] = row[x] == Cell::WALL ? 1 : 0;
+        }
+    }
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        std::fill(m_levels[channel].begin(), m_levels[channel].end(), 0);
+        std::fill(m_sources[channel].begin(), m_sources[channel].end(), 0);
+    }
+
+    // every cell may have changed colour
+    m_changed.clear();
+    for (sf::Uint32 cell = 0; cell < m_size.x * m_size.y; cell++) {
+        m_changed.push_back(cell);
+        m_changedFlag[cell] = 1;
+    }
+
+    for (auto &light : m_lights) {
+        if (light.active) {
+            updateSource(light.position.y * m_size.x + light.position.x);
+        }
+    }
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        flush(channel);
+    }
+}
+
+LightId LightMap::addLight(const sf::Vector2u &position, const sf::Color &color, sf::Uint8 radius)
+{
+    Light light;
+    light.position = sf::Vector2u(std::min(position.x, m_size.x - 1), std::min(position.y, m_size.y - 1));
+    light.active   = true;
+
+    // scale the colour so that its brightest channel reaches radius cells
+    radius                  = std::min(radius, MAX_LEVEL);
+    sf::Uint8 brightest     = std::max({color.r, color.g, color.b});
+    sf::Uint8 components[3] = {color.r, color.g, color.b};
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        light.levels[channel] = brightest == 0 ? 0 : (components[channel] * radius + brightest / 2) / brightest;
+    }
+
+    LightId id;
+    if (!m_freeLights.empty()) {
+        id = m_freeLights.back();
+        m_freeLights.pop_back();
+        m_lights[id] = light;
+    } else {
+        id = m_lights.size();
+        m_lights.push_back(light);
+    }
+
+    updateSource(light.position.y * m_size.x + light.position.x);
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        flush(channel);
+    }
+
+    return id;
+}
+
+void LightMap::removeLight(LightId id)
+{
+    if (id >= m_lights.size() || !m_lights[id].active) {
+        spdlog::error("LightMap::removeLight: no light with id {}", id);
+        return;
+    }
+
+    auto &light  = m_lights[id];
+    light.active = false;
+    m_freeLights.push_back(id);
+
+    updateSource(light.position.y * m_size.x + light.position.x);
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        flush(channel);
+    }
+}
+
+void LightMap::moveLight(LightId id, const sf::Vector2u &position)
+{
+    if (id >= m_lights.size() || !m_lights[id].active) {
+        spdlog::error("LightMap::moveLight: no light with id {}", id);
+        return;
+    }
+
+    auto &light = m_lights[id];
+    auto  from  = light.position;
+    auto  to    = sf::Vector2u(std::min(position.x, m_size.x - 1), std::min(position.y, m_size.y - 1));
+
+    if (from == to) {
+        return;
+    }
+
+    // the removal at the old cell and the light at the new one are queued
+    // together, so that the light between them is only refilled once
+    light.position = to;
+    updateSource(from.y * m_size.x + from.x);
+    updateSource(to.y * m_size.x + to.x);
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        flush(channel);
+    }
+}
+
+sf::Color LightMap::getColor(const sf::Vector2u &position) const
+{
+    if (position.x >= m_size.x || position.y >= m_size.y) {
+        return m_ambient;
+    }
+
+    auto cell  = position.y * m_size.x + position.x;
+    auto scale = [](sf::Uint8 ambient, sf::Uint8 level) {
+        return static_cast<sf::Uint8>(ambient + (255 - ambient) * level / MAX_LEVEL);
+    };
+
+    return sf::Color(scale(m_ambient.r, m_levels[0][cell]),
+                     scale(m_ambient.g, m_levels[1][cell]),
+                     scale(m_ambient.b, m_levels[2][cell]));
+}
+
+void LightMap::apply(Tilemap &tilemap)
+{
+    for (auto cell : m_changed) {
+        auto position = sf::Vector2u(cell % m_size.x, cell / m_size.x);
+        tilemap.setTint(position, getColor(position));
+        m_changedFlag[cell] = 0;
+    }
+
+    m_changed.clear();
+}
+
+void LightMap::onCellChanged(const sf::Vector2u &position, Cell cell)
+{
+    auto index  = position.y * m_size.x + position.x;
+    auto opaque = cell == Cell::WALL ? 1 : 0;
+
+    if (m_opaque[index] == opaque) {
+        return;
+    }
+
+    m_opaque[index] = opaque;
+
+    for (sf::Uint32 channel = 0; channel < 3; channel++) {
+        if (opaque) {
+            // light that passed through the cell has to go, and the cell itself is
+            // lit again, as a wall, by whatever still reaches it
+            remove(channel, index);
+        } else if (m_levels[channel][index] > 1) {
+            // a lit wall that opens up starts passing its light on
+            m_propagate[channel].push_back(index);
+        }
+
+        refill(channel, index);
+        flush(channel);
+    }
+}
+
+void LightMap::onMazeGenerated()
+{
+    rebuild();
+}
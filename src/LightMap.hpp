@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Maze.hpp"
+#include "Tilemap.hpp"
+
+// LightId identifies a light in a LightMap.
+typedef sf::Uint32 LightId;
+
+// LightMap spreads coloured light from torches and other light sources over the
+// cells of a Maze, entirely on the CPU so that it needs no shader support.
+//
+// Light is flood filled breadth first from each source, losing one level per
+// cell, separately for the red, green and blue channels. Walls are lit by the
+// light that reaches them but do not pass it on. Every cell keeps the brightest
+// level that reaches it, which makes incremental updates possible: when a light
+// is removed or moved, or a cell opens or closes, only the light that could have
+// come through that point is removed and the gap is refilled from the
+// surrounding cells, rather than recomputing the whole map.
+//
+// The result is a colour per cell. apply() copies the colours that changed into
+// the tints of a Tilemap, which the renderer uses as vertex colours.
+class LightMap : public MazeListener
+{
+    public:
+        // the brightest level a light can have, which is also its reach in cells
+        static constexpr sf::Uint8 MAX_LEVEL = 31;
+
+    private:
+        struct Light
+        {
+            sf::Vector2u position;  // cell the light is in
+            sf::Uint8    levels[3]; // level of the light in each channel
+            bool         active;    // false once the light has been removed
+        };
+
+        // a cell whose light is being removed, and the level it had
+        struct Removal
+        {
+            sf::Uint32 cell;
+            sf::Uint8  level;
+        };
+
+        Maze                   *m_maze;         // the maze being lit
+        sf::Vector2u            m_size;         // size of the maze in cells
+        sf::Color               m_ambient;      // colour of a cell with no light
+        std::vector<Light>      m_lights;       // every light ever added
+        std::vector<LightId>    m_freeLights;   // removed lights available for reuse
+        std::vector<sf::Uint8>  m_opaque;       // 1 for each cell that blocks light
+        std::vector<sf::Uint8>  m_levels[3];    // light level of each cell, per channel
+        std::vector<sf::Uint8>  m_sources[3];   // level of the brightest light in each cell
+        std::vector<sf::Uint32> m_propagate[3]; // cells to spread light from, per channel
+        std::vector<Removal>    m_remove[3];    // cells to remove light from, per channel
+        std::vector<sf::Uint32> m_reseed[3];    // sources darkened by a removal, per channel
+        std::vector<sf::Uint32> m_changed;      // cells whose colour changed since apply
+        std::vector<sf::Uint8>  m_changedFlag;  // 1 for each cell in m_changed
+
+        // write the orthogonal neighbours of a cell that lie inside the map and return
+        // how many there are
+        sf::Uint32 getNeighbours(sf::Uint32 cell, sf::Uint32 *neighbours) const;
+
+        // set the level of a cell in a channel and remember that its colour changed
+        void setLevel(sf::Uint32 channel, sf::Uint32 cell, sf::Uint8 level);
+
+        // recompute the brightest light in a cell from the lights that are in it
+        void updateSource(sf::Uint32 cell);
+
+        // darken a cell in a channel and queue the removal of the light it passed on
+        void remove(sf::Uint32 channel, sf::Uint32 cell);
+
+        // queue the lit neighbours of a cell so that they spread light into it
+        void refill(sf::Uint32 channel, sf::Uint32 cell);
+
+        // run the queued removals and then the queued propagation for a channel
+        void flush(sf::Uint32 channel);
+
+        // light the whole map from scratch
+        void rebuild();
+
+    public:
+        LightMap(Maze *maze, const sf::Color &ambient = sf::Color(64, 64, 80));
+        ~LightMap();
+
+        LightMap(const LightMap &)            = delete;
+        LightMap &operator=(const LightMap &) = delete;
+
+        // add a light to a cell. The colour is scaled so that its brightest channel
+        // reaches radius cells, up to MAX_LEVEL.
+        LightId addLight(const sf::Vector2u &position, const sf::Color &color, sf::Uint8 radius);
+
+        // remove a light
+        void removeLight(LightId id);
+
+        // move a light to another cell
+        void moveLight(LightId id, const sf::Vector2u &position);
+
+        // get the colour of a cell
+        sf::Color getColor(const sf::Vector2u &position) const;
+
+        // copy the colour of every cell that changed since the last call into the
+        // tints of the tilemap
+        void apply(Tilemap &tilemap);
+
+        // MazeListener
+        void onCellChanged(const sf::Vector2u &position, Cell cell) override;
+        void onMazeGenerated() override;
+};
@@ -1,6 +1,12 @@
 #include "Maze.hpp"
 #include "RoomShape.hpp"
 
+#include "FloodFill.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <memory_resource>
+#include <mutex>
 #include <spdlog/spdlog.h>
 
 // A maze generator that uses the methodology described in
@@ -26,10 +32,65 @@
 // Finally, we randomly place doors between the rooms and corridors until
 // we have joined all the rooms and corridors into a single connected maze.
 
+namespace
+{
+
+const int offsetsX[4] = {0, -1, 1, 0};
+const int offsetsY[4] = {-1, 0, 0, 1};
+
+// find the root of a provisional region label, halving the path on the way
+sf::Uint32 findRoot(std::pmr::vector<sf::Uint32> &parents, sf::Uint32 label)
+{
+    while (parents[label] != label) {
+        parents[label] = parents[parents[label]];
+        label          = parents[label];
+    }
+
+    return label;
+}
+
+// join the sets two provisional labels are in. The smaller root is kept, so a
+// root always comes before every other label in its set.
+void joinRoots(std::pmr::vector<sf::Uint32> &parents, sf::Uint32 a, sf::Uint32 b)
+{
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+
+    if (a < b) {
+        parents[b] = a;
+    } else if (b < a) {
+        parents[a] = b;
+    }
+}
+
+// get the seed of a partition's random numbers from the seed of the maze, mixed
+// with splitmix64 so that neighbouring partitions get unrelated streams
+sf::Uint32 getPartitionSeed(sf::Uint32 seed, sf::Uint32 partition)
+{
+    sf::Uint64 z = (static_cast<sf::Uint64>(seed) << 32 | partition) + 0x9e3779b97f4a7c15ull;
+    z            = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z            = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return static_cast<sf::Uint32>(z ^ (z >> 31));
+}
+
+} // namespace
+
 Maze::Maze(const sf::Vector2u &size)
 {
-    m_size = size;
-    m_cells.resize(size.x * size.y, Cell::WALL);
+    m_size          = size;
+    m_generating    = false;
+    m_parallelRooms = false;
+    m_cells.resize(size, Cell::WALL, 1);
+    m_regions.resize(size, 0, 1);
+    m_visits.resize(size, 0, 1);
+    m_regionSizes.assign(1, 0);
+    m_regionCount = 0;
+    m_visitStamp  = 0;
+    m_nextRegion  = 1;
+
+    // no grid has more regions than a checkerboard, so labelling a whole grid does not
+    // reallocate. Regions added by later edits may still grow it.
+    m_regionSizes.reserve((static_cast<size_t>(size.x) * size.y + 1) / 2 + 1);
 
     // generate a set of prefab rooms
     m_prefabs.push_back(RoomShape(sf::Vector2u(3, 3)));
@@ -45,15 +106,27 @@ Maze::Maze(const sf::Vector2u &size)
     m_prefabs.push_back(RoomShape(sf::Vector2u(5, 9)));
 }
 
-void Maze::generate(sf::Uint32 seed)
+void Maze::regenerate(sf::Uint32 seed)
 {
-    spdlog::info("Maze::generate: generating maze with seed {}", seed);
+    spdlog::debug("Maze::regenerate: generating maze with seed {}", seed);
 
     m_seed = seed;
     m_gen.seed(seed);
+    m_generating = true;
+
+    // start again from solid rock, keeping every buffer from the last run
+    m_cells.fill(Cell::WALL);
+    m_rooms.clear();
+    m_connectors.clear();
+    m_nextRegion = 1;
+    m_context.reset();
 
     // generate the rooms
-    generateRooms(5000);
+    if (m_parallelRooms) {
+        generateRoomsParallel(5000);
+    } else {
+        generateRooms(5000);
+    }
 
     // generate the corridors
     generateCorridors();
@@ -66,11 +139,334 @@ void Maze::generate(sf::Uint32 seed)
 
     // remove dead ends
     removeDeadEnds(100);
+
+    m_generating = false;
+
+    labelRegions(m_context.getThreads());
+    buildRoomGraph();
+
+    for (auto listener : m_listeners) {
+        listener->onMazeGenerated();
+    }
+}
+
+void Maze::generateCaves(sf::Uint32 seed, CaveGenerator &caves)
+{
+    spdlog::debug("Maze::generateCaves: generating caves with seed {}", seed);
+
+    m_seed = seed;
+    m_gen.seed(seed);
+    m_generating = true;
+
+    m_rooms.clear();
+    m_connectors.clear();
+    m_nextRegion = 1;
+    m_context.reset();
+
+    caves.generate(m_size, seed, m_context.getThreads());
+    caves.getCells(m_cells.view(), m_context.getThreads());
+
+    // the caves are found by labelling them, and labelled again if joining them
+    // changed anything
+    labelRegions(m_context.getThreads());
+
+    bool changed = joinRegions(caves.getMinCave(), caves.getConnect());
+
+    m_generating = false;
+
+    if (changed) {
+        labelRegions(m_context.getThreads());
+    }
+
+    buildRoomGraph();
+
+    for (auto listener : m_listeners) {
+        listener->onMazeGenerated();
+    }
+}
+
+void Maze::generateWfc(sf::Uint32 seed, WfcGenerator &wfc)
+{
+    spdlog::debug("Maze::generateWfc: generating rooms with seed {}", seed);
+
+    m_seed = seed;
+    m_gen.seed(seed);
+    m_generating = true;
+
+    m_rooms.clear();
+    m_connectors.clear();
+    m_nextRegion = 1;
+    m_context.reset();
+
+    // the prefabs can be edited between runs, so they are learned every time
+    wfc.learn(m_prefabs);
+    wfc.generate(m_size, seed);
+    wfc.getCells(m_cells.view());
+
+    labelRegions(m_context.getThreads());
+
+    bool changed = joinRegions(1, true);
+
+    m_generating = false;
+
+    if (changed) {
+        labelRegions(m_context.getThreads());
+    }
+
+    buildRoomGraph();
+
+    for (auto listener : m_listeners) {
+        listener->onMazeGenerated();
+    }
+}
+
+bool Maze::joinRegions(sf::Uint32 minSize, bool connect)
+{
+    if (m_regionCount <= 1) {
+        return false;
+    }
+
+    sf::Uint32 largest = std::max_element(m_regionSizes.begin() + 1, m_regionSizes.end()) - m_regionSizes.begin();
+
+    auto isKept = [&](sf::Uint32 region) {
+        return region == largest || (connect && m_regionSizes[region] >= minSize);
+    };
+
+    m_context.reset();
+    auto *arena = m_context.getArena();
+
+    // the first cell of each region that is kept, or -1 for those filled in
+    std::pmr::vector<sf::Int64> starts(m_regionSizes.size(), -1, arena);
+
+    for (sf::Uint32 y = 0; y < m_size.y; y++) {
+        for (sf::Uint32 x = 0; x < m_size.x; x++) {
+            sf::Uint32 region = m_regions(x, y);
+            if (region == 0) {
+                continue;
+            }
+
+            if (!isKept(region)) {
+                m_cells(x, y)   = Cell::WALL;
+                m_regions(x, y) = 0;
+            } else if (starts[region] < 0) {
+                starts[region] = static_cast<sf::Int64>(y) * m_size.x + x;
+            }
+        }
+    }
+
+    if (!connect) {
+        return true;
+    }
+
+    // Each region is joined by a search from its first cell, through rock and open
+    // cells alike, that stops at the first cell of a region already joined. The
+    // rock on the way back is carved into a tunnel, which joins the largest region
+    // too, so later regions can stop at it. Queue entries hold a cell and the entry
+    // it was reached from.
+    std::pmr::vector<sf::Uint8>                          joined(m_regionSizes.size(), 0, arena);
+    std::pmr::vector<std::pair<sf::Vector2i, sf::Int64>> queue(arena);
+    sf::Uint32                                           tunnels = 0;
+
+    joined[largest] = 1;
+
+    for (sf::Uint32 region = 1; region < m_regionSizes.size(); region++) {
+        if (starts[region] < 0 || joined[region]) {
+            continue;
+        }
+
+        if (++m_visitStamp >= (1u << 30)) {
+            m_visits.fill(0);
+            m_visitStamp = 1;
+        }
+
+        sf::Vector2i start(starts[region] % m_size.x, starts[region] / m_size.x);
+        queue.clear();
+        queue.emplace_back(start, -1);
+        m_visits(start.x, start.y) = m_visitStamp << 2;
+
+        for (size_t i = 0; i < queue.size(); i++) {
+            auto cell = queue[i].first;
+
+            if (joined[m_regions(cell.x, cell.y)]) {
+                for (sf::Int64 entry = i; entry >= 0; entry = queue[entry].second) {
+                    auto step = queue[entry].first;
+                    if (m_cells(step.x, step.y) == Cell::WALL) {
+                        m_cells(step.x, step.y)   = Cell::CORRIDOR;
+                        m_regions(step.x, step.y) = largest;
+                    }
+                }
+
+                tunnels++;
+                break;
+            }
+
+            for (int d = 0; d < 4; d++) {
+                int nx = cell.x + offsetsX[d];
+                int ny = cell.y + offsetsY[d];
+
+                if (nx < 0 || ny < 0 || nx >= static_cast<int>(m_size.x) || ny >= static_cast<int>(m_size.y) ||
+                    m_visits(nx, ny) == m_visitStamp << 2)
+                {
+                    continue;
+                }
+
+                m_visits(nx, ny) = m_visitStamp << 2;
+                queue.emplace_back(sf::Vector2i(nx, ny), i);
+            }
+        }
+
+        joined[region] = 1;
+    }
+
+    spdlog::debug("Maze::joinRegions: dug {} tunnels to the largest region", tunnels);
+
+    return true;
+}
+
+void Maze::buildRoomGraph()
+{
+    sf::Clock clock;
+
+    m_roomLinks.clear();
+    m_linkStarts.assign(m_rooms.size() + 1, 0);
+
+    m_context.reset();
+    auto *arena = m_context.getArena();
+
+    std::pmr::vector<sf::IntRect> bounds(arena);
+    bounds.reserve(m_rooms.size());
+    for (const auto &room : m_rooms) {
+        bounds.push_back(room.getBounds());
+    }
+
+    m_roomIndex.build(bounds);
+
+    if (m_rooms.empty()) {
+        return;
+    }
+
+    // Every open cell is claimed by the room it is closest to, by a search from the
+    // cells of all the rooms at once through the corridors and doors. Rooms whose
+    // claims touch are next to each other. Owners are room index + 1, and 0 for
+    // cells no room can reach.
+    std::pmr::vector<sf::Uint32>   owners(static_cast<size_t>(m_size.x) * m_size.y, 0, arena);
+    std::pmr::vector<sf::Vector2i> queue(arena);
+
+    for (sf::Uint32 i = 0; i < m_rooms.size(); i++) {
+        const auto &rect = m_rooms[i].getBounds();
+        for (int y = rect.top; y < rect.top + rect.height; y++) {
+            for (int x = rect.left; x < rect.left + rect.width; x++) {
+                if (m_cells(x, y) != Cell::WALL) {
+                    owners[y * m_size.x + x] = i + 1;
+                    queue.emplace_back(x, y);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < queue.size(); i++) {
+        auto       cell  = queue[i];
+        sf::Uint32 owner = owners[cell.y * m_size.x + cell.x];
+
+        for (int d = 0; d < 4; d++) {
+            int nx = cell.x + offsetsX[d];
+            int ny = cell.y + offsetsY[d];
+
+            // the border of the grid is wall, so neighbours never leave it
+            if (m_cells(nx, ny) == Cell::WALL || owners[ny * m_size.x + nx] != 0) {
+                continue;
+            }
+
+            owners[ny * m_size.x + nx] = owner;
+            queue.emplace_back(nx, ny);
+        }
+    }
+
+    // every pair of owners that meet to the right or below, both ways round
+    std::pmr::vector<std::pair<sf::Uint32, sf::Uint32>> links(arena);
+
+    auto link = [&](sf::Uint32 a, sf::Uint32 b) {
+        if (a != 0 && b != 0 && a != b) {
+            links.emplace_back(a - 1, b - 1);
+            links.emplace_back(b - 1, a - 1);
+        }
+    };
+
+    for (sf::Uint32 y = 0; y < m_size.y; y++) {
+        for (sf::Uint32 x = 0; x < m_size.x; x++) {
+            sf::Uint32 owner = owners[y * m_size.x + x];
+            if (x + 1 < m_size.x) {
+                link(owner, owners[y * m_size.x + x + 1]);
+            }
+            if (y + 1 < m_size.y) {
+                link(owner, owners[(y + 1) * m_size.x + x]);
+            }
+        }
+    }
+
+    std::sort(links.begin(), links.end());
+    links.erase(std::unique(links.begin(), links.end()), links.end());
+
+    m_roomLinks.reserve(links.size());
+    for (const auto &[from, to] : links) {
+        m_linkStarts[from + 1]++;
+        m_roomLinks.push_back(to);
+    }
+
+    for (sf::Uint32 i = 0; i < m_rooms.size(); i++) {
+        m_linkStarts[i + 1] += m_linkStarts[i];
+    }
+
+    spdlog::debug("Maze::buildRoomGraph: linked {} rooms with {} links in {}ms",
+                  m_rooms.size(),
+                  links.size() / 2,
+                  clock.getElapsedTime().asMilliseconds());
+}
+
+sf::Int32 Maze::getRoomAt(const sf::Vector2u &position) const
+{
+    if (position.x >= m_size.x || position.y >= m_size.y || m_cells[position] == Cell::WALL) {
+        return -1;
+    }
+
+    // rooms never overlap, so at most one contains the cell
+    sf::Int32 found = -1;
+    m_roomIndex.query(sf::Vector2i(position), [&](sf::Uint32 room) { found = room; });
+
+    return found;
+}
+
+void Maze::getRoomsIn(const sf::IntRect &rect, std::vector<sf::Uint32> &rooms) const
+{
+    rooms.clear();
+    m_roomIndex.query(rect, [&](sf::Uint32 room) { rooms.push_back(room); });
+}
+
+void Maze::getNearestRooms(const sf::Vector2i                    &position,
+                           sf::Uint32                             count,
+                           std::vector<sf::Uint32>               &rooms,
+                           const std::function<bool(sf::Uint32)> &accept) const
+{
+    m_roomIndex.getNearest(position, count, rooms, accept);
+}
+
+std::span<const sf::Uint32> Maze::getAdjacentRooms(sf::Uint32 room) const
+{
+    if (room >= m_rooms.size()) {
+        spdlog::error("Maze::getAdjacentRooms: room {} out of range", room);
+        return {};
+    }
+
+    return std::span<const sf::Uint32>(m_roomLinks).subspan(m_linkStarts[room],
+                                                             m_linkStarts[room + 1] - m_linkStarts[room]);
 }
 
 void Maze::generateRooms(sf::Uint32 max_attempts)
 {
-    spdlog::info("Maze::generateRooms: generating rooms with {} attempts", max_attempts);
+    spdlog::debug("Maze::generateRooms: generating rooms with {} attempts", max_attempts);
+
+    // every attempt could place a room, so this only allocates the first time
+    m_rooms.reserve(max_attempts);
 
     // generate a room in the maze, up to the maximum number of attempts
     for (sf::Uint32 i = 0; i < max_attempts; i++) {
@@ -78,7 +474,8 @@ void Maze::generateRooms(sf::Uint32 max_attempts)
         sf::Vector2u size(0, 0);
 
         // pick a random prefab room
-        RoomShape room = m_prefabs[m_gen() % m_prefabs.size()];
+        sf::Uint32       prefab = m_gen() % m_prefabs.size();
+        const RoomShape &room   = m_prefabs[prefab];
 
         // pick a random location for the room. It needs to fit in the maze, and not
         // overlap with any other rooms, and it must be an odd number of cells wide
@@ -91,23 +488,119 @@ void Maze::generateRooms(sf::Uint32 max_attempts)
         offset.y = m_gen() % (m_size.y / 2) * 2 + 1;
 
         if (!roomFits(room, offset)) {
-            spdlog::info("Maze::generateRooms: room does not fit at ({}, {})", offset.x, offset.y);
+            spdlog::debug("Maze::generateRooms: room does not fit at ({}, {})", offset.x, offset.y);
             continue;
         }
 
-        // carve out the room
-        for (sf::Uint32 y = 0; y < room.getSize().y; y++) {
-            for (sf::Uint32 x = 0; x < room.getSize().x; x++) {
-                setCell(sf::Vector2u(offset.x + x, offset.y + y), room.getCell(sf::Vector2u(x, y)));
+        carveRoom(room, offset);
+
+        sf::IntRect bounds(sf::Vector2i(offset), sf::Vector2i(room.getSize()));
+        m_rooms.push_back(Room(m_nextRegion++, bounds, prefab));
+
+        spdlog::debug("Maze::generateRooms: generated room at ({}, {}) size ({}, {})",
+                      offset.x,
+                      offset.y,
+                      room.getSize().x,
+                      room.getSize().y);
+    }
+}
+
+void Maze::generateRoomsParallel(sf::Uint32 max_attempts)
+{
+    sf::Clock clock;
+
+    // Partitions are at least as large as the largest prefab, so a room placed in
+    // one reaches no further than the partitions right of and below it. They are
+    // coloured in a 2x2 checkerboard and placed one colour at a time: partitions of
+    // a colour are two apart, so the cells a room in one reads and writes are never
+    // those of a room in another, and they run in parallel without locking. A room
+    // reaching into a partition of a later colour is already there when that
+    // partition is placed, so rooms across partitions are settled by the colour
+    // order alone, and the rooms are the same whichever thread placed them.
+    sf::Uint32 largest = 0;
+    for (const auto &prefab : m_prefabs) {
+        largest = std::max({largest, prefab.getSize().x, prefab.getSize().y});
+    }
+
+    sf::Uint32   size = std::max(64u, (largest + 1) / 2 * 2);
+    sf::Vector2u partitions((m_size.x + size - 1) / size, (m_size.y + size - 1) / size);
+    sf::Uint32   count = partitions.x * partitions.y;
+    sf::Uint64   area  = static_cast<sf::Uint64>(m_size.x) * m_size.y;
+
+    // the lists are kept between runs, so they only allocate the first time
+    if (m_placed.size() < count) {
+        m_placed.resize(count);
+    }
+
+    for (sf::Uint32 i = 0; i < count; i++) {
+        m_placed[i].clear();
+    }
+
+    auto place = [&](sf::Uint32 index) {
+        sf::Vector2u origin(index % partitions.x * size, index / partitions.x * size);
+        sf::Uint32   width  = std::min(size, m_size.x - origin.x);
+        sf::Uint32   height = std::min(size, m_size.y - origin.y);
+
+        // each partition has its share of the attempts and random numbers of its
+        // own, so neither depends on the order partitions are placed in. Shares are
+        // cut from the cells before and after the partition in row order, so they
+        // add up to max_attempts exactly.
+        sf::Uint64   above    = static_cast<sf::Uint64>(origin.y) * m_size.x;
+        sf::Uint64   before   = above + static_cast<sf::Uint64>(origin.x) * height;
+        sf::Uint64   after    = before + width * height;
+        sf::Uint32   attempts = max_attempts * after / area - max_attempts * before / area;
+        std::mt19937 gen(getPartitionSeed(m_seed, index));
+
+        for (sf::Uint32 i = 0; i < attempts; i++) {
+            sf::Uint32       prefab = gen() % m_prefabs.size();
+            const RoomShape &room   = m_prefabs[prefab];
+
+            // an odd cell of the partition, as generateRooms does for the maze
+            sf::Vector2u offset(origin.x + gen() % std::max(1u, width / 2) * 2 + 1,
+                                origin.y + gen() % std::max(1u, height / 2) * 2 + 1);
+
+            if (!roomFits(room, offset)) {
+                continue;
+            }
+
+            carveRoom(room, offset);
+            m_placed[index].push_back(Placement{offset, prefab});
+        }
+    };
+
+    std::pmr::vector<sf::Uint32> partitionsOfColour(m_context.getArena());
+
+    for (sf::Uint32 colour = 0; colour < 4; colour++) {
+        partitionsOfColour.clear();
+        for (sf::Uint32 y = colour / 2; y < partitions.y; y += 2) {
+            for (sf::Uint32 x = colour % 2; x < partitions.x; x += 2) {
+                partitionsOfColour.push_back(y * partitions.x + x);
             }
         }
 
-        spdlog::info("Maze::generateRooms: generated room at ({}, {}) size ({}, {})",
-                     offset.x,
-                     offset.y,
-                     room.getSize().x,
-                     room.getSize().y);
+        parallelForEach(
+            0,
+            partitionsOfColour.size(),
+            [&](sf::Uint32 i) { place(partitionsOfColour[i]); },
+            m_context.getThreads());
     }
+
+    // rooms are numbered partition by partition, in row order
+    for (sf::Uint32 i = 0; i < count; i++) {
+        for (const auto &placement : m_placed[i]) {
+            const auto &room = m_prefabs[placement.prefab];
+            m_rooms.push_back(Room(m_nextRegion++,
+                                   sf::IntRect(sf::Vector2i(placement.offset), sf::Vector2i(room.getSize())),
+                                   placement.prefab));
+        }
+    }
+
+    spdlog::debug("Maze::generateRoomsParallel: placed {} rooms in {} partitions of {}x{} in {}ms",
+                  m_rooms.size(),
+                  count,
+                  size,
+                  size,
+                  clock.getElapsedTime().asMilliseconds());
 }
 
 void Maze::generateCorridors()
@@ -133,10 +626,11 @@ bool Maze::roomFits(const RoomShape &room, const sf::Vector2u &offset) const
         return false;
     }
 
-    // Check if the room overlaps with any other rooms
+    // Check that every cell the room carves is still solid rock, so that it does
+    // not overlap any other room, corridor or door. Its walls are not carved.
     for (sf::Uint32 y = 0; y < room.getSize().y; y++) {
         for (sf::Uint32 x = 0; x < room.getSize().x; x++) {
-            if (room.getCell(sf::Vector2u(x, y)) == Cell::ROOM &&
+            if (room.getCell(sf::Vector2u(x, y)) != Cell::WALL &&
                 getCell(sf::Vector2u(offset.x + x, offset.y + y)) != Cell::WALL)
             {
                 return false;
@@ -147,14 +641,28 @@ bool Maze::roomFits(const RoomShape &room, const sf::Vector2u &offset) const
     return true;
 }
 
+void Maze::carveRoom(const RoomShape &room, const sf::Vector2u &offset)
+{
+    // the walls of the room are left alone, as they may be the floor of a room
+    // next to it, and rock is already a wall
+    for (sf::Uint32 y = 0; y < room.getSize().y; y++) {
+        for (sf::Uint32 x = 0; x < room.getSize().x; x++) {
+            Cell cell = room.getCell(sf::Vector2u(x, y));
+            if (cell != Cell::WALL) {
+                setCell(sf::Vector2u(offset.x + x, offset.y + y), cell);
+            }
+        }
+    }
+}
+
 sf::Vector2u Maze::getSize() const
 {
     return m_size;
 }
 
-std::vector<std::vector<Cell>> Maze::getCells() const
+GridView<const Cell> Maze::getCells() const
 {
-    return std::vector<std::vector<Cell>>();
+    return m_cells.view();
 }
 
 Cell Maze::getCell(const sf::Vector2u &offset) const
@@ -163,7 +671,7 @@ Cell Maze::getCell(const sf::Vector2u &offset) const
         return Cell::WALL;
     }
 
-    return m_cells[m_size.x * offset.y + offset.x];
+    return m_cells[offset];
 }
 
 void Maze::setCell(const sf::Vector2u &offset, Cell cell)
@@ -174,13 +682,447 @@ void Maze::setCell(const sf::Vector2u &offset, Cell cell)
     }
 
     if (cell == Cell::ROOM || cell == Cell::CORRIDOR || cell == Cell::WALL || cell == Cell::DOOR) {
-        m_cells[m_size.x * offset.y + offset.x] = cell;
+        auto &current = m_cells[offset];
+        if (current == cell) {
+            return;
+        }
+
+        bool wasWall = current == Cell::WALL;
+        current      = cell;
+
+        // while generating, the regions are labelled all at once at the end
+        if (!m_generating) {
+            if (wasWall) {
+                openRegion(offset);
+            } else if (cell == Cell::WALL) {
+                closeRegion(offset);
+            }
+
+            for (auto listener : m_listeners) {
+                listener->onCellChanged(offset, cell);
+            }
+        }
     } else {
         spdlog::error("Maze::setCell: invalid cell type");
     }
 }
 
+void Maze::setCells(GridView<const Cell> cells)
+{
+    if (cells.getSize() != m_size) {
+        spdlog::error("Maze::setCells: cells are {}x{} but the maze is {}x{}",
+                      cells.getSize().x,
+                      cells.getSize().y,
+                      m_size.x,
+                      m_size.y);
+        return;
+    }
+
+    for (sf::Uint32 y = 0; y < m_size.y; y++) {
+        auto row = cells.row(y);
+        std::copy(row.begin(), row.end(), &m_cells(0, y));
+    }
+
+    replacedCells();
+}
+
+void Maze::replacedCells()
+{
+    // the cells no longer say where rooms were placed
+    m_rooms.clear();
+
+    labelRegions(m_context.getThreads());
+    buildRoomGraph();
+
+    for (auto listener : m_listeners) {
+        listener->onMazeGenerated();
+    }
+}
+
+bool Maze::fitsWorld(const PagedStore &store, const sf::Vector2u &offset) const
+{
+    return store.isOpen() && static_cast<sf::Uint64>(offset.x) + m_size.x <= store.getSize().x &&
+           static_cast<sf::Uint64>(offset.y) + m_size.y <= store.getSize().y;
+}
+
+bool Maze::loadWindow(PagedStore &store, const sf::Vector2u &offset)
+{
+    if (!fitsWorld(store, offset)) {
+        spdlog::error("Maze::loadWindow: {}x{} at ({}, {}) is not inside the world",
+                      m_size.x,
+                      m_size.y,
+                      offset.x,
+                      offset.y);
+        return false;
+    }
+
+    store.read(offset, m_cells.view());
+    replacedCells();
+
+    return true;
+}
+
+bool Maze::saveWindow(PagedStore &store, const sf::Vector2u &offset) const
+{
+    if (!fitsWorld(store, offset)) {
+        spdlog::error("Maze::saveWindow: {}x{} at ({}, {}) is not inside the world",
+                      m_size.x,
+                      m_size.y,
+                      offset.x,
+                      offset.y);
+        return false;
+    }
+
+    store.write(offset, m_cells.view());
+
+    return true;
+}
+
 bool Maze::isCell(const sf::Vector2u &offset, Cell cell) const
 {
     return getCell(offset) == cell;
 }
+
+void Maze::labelRegions(sf::Uint32 threads)
+{
+    sf::Clock clock;
+
+    if (threads == 0) {
+        threads = getThreadCount();
+    }
+
+    // the temporaries all come from the arena, and are all allocated before any
+    // worker starts
+    m_context.reset();
+    auto *arena = m_context.getArena();
+
+    int        width      = m_size.x;
+    sf::Uint32 runsPerRow = (m_size.x + 1) / 2;
+    size_t     labelCount = static_cast<size_t>(m_size.y) * runsPerRow + 1;
+
+    // provisional labels, one per run of open cells. Every row has its own range
+    // of labels, so bands never hand out the same label. 0 is unused.
+    std::pmr::vector<sf::Uint32> parents(labelCount, 0, arena);
+    std::pmr::vector<sf::Uint32> runSizes(labelCount, 0, arena);
+    std::pmr::vector<sf::Uint32> regions(labelCount, 0, arena);
+    std::pmr::vector<sf::Uint32> bandStarts(arena);
+    std::mutex                   mutex;
+
+    bandStarts.reserve(threads);
+
+    // first pass: label the runs of each row, joining them to the runs they touch
+    // in the row above. Bands only join labels of their own rows.
+    parallelFor(
+        0,
+        m_size.y,
+        [&](sf::Uint32 first, sf::Uint32 last) {
+            {
+                std::lock_guard lock(mutex);
+                bandStarts.push_back(first);
+            }
+
+            for (sf::Uint32 y = first; y < last; y++) {
+                const Cell       *cells  = &m_cells(0, y);
+                sf::Uint32       *labels = &m_regions(0, y);
+                const sf::Uint32 *above  = &m_regions(0, static_cast<int>(y) - 1);
+                sf::Uint32        next   = y * runsPerRow + 1;
+
+                for (int x = 0; x < width;) {
+                    if (cells[x] == Cell::WALL) {
+                        labels[x++] = 0;
+                        continue;
+                    }
+
+                    sf::Uint32 label  = next++;
+                    sf::Uint32 joined = 0;
+                    int        start  = x;
+                    parents[label]    = label;
+
+                    for (; x < width && cells[x] != Cell::WALL; x++) {
+                        labels[x] = label;
+
+                        // a run above touches the whole of this run, so only join it once
+                        if (y > first && above[x] != 0 && above[x] != joined) {
+                            joined = above[x];
+                            joinRoots(parents, label, joined);
+                        }
+                    }
+
+                    runSizes[label] = x - start;
+                }
+            }
+        },
+        threads);
+
+    // join the runs that touch across the seams between bands
+    for (auto y : bandStarts) {
+        if (y == 0) {
+            continue;
+        }
+
+        for (int x = 0; x < width; x++) {
+            sf::Uint32 above = m_regions(x, y - 1);
+            sf::Uint32 below = m_regions(x, y);
+
+            if (above != 0 && below != 0) {
+                joinRoots(parents, above, below);
+            }
+        }
+    }
+
+    // number the sets in order, adding up the runs in each; roots come first in
+    // their sets, so every label's root is numbered before the label is reached
+    sf::Uint32 count = 0;
+    m_regionSizes.assign(1, 0);
+
+    for (sf::Uint32 label = 1; label < parents.size(); label++) {
+        if (parents[label] == 0) {
+            continue;
+        }
+
+        sf::Uint32 root = findRoot(parents, label);
+        if (root == label) {
+            regions[label] = ++count;
+            m_regionSizes.push_back(0);
+        } else {
+            regions[label] = regions[root];
+        }
+
+        m_regionSizes[regions[label]] += runSizes[label];
+    }
+
+    // second pass: replace the provisional labels
+    parallelFor(
+        0,
+        m_size.y,
+        [&](sf::Uint32 first, sf::Uint32 last) {
+            for (sf::Uint32 y = first; y < last; y++) {
+                sf::Uint32 *labels = &m_regions(0, y);
+                for (int x = 0; x < width; x++) {
+                    labels[x] = regions[labels[x]];
+                }
+            }
+        },
+        threads);
+
+    m_regionCount = count;
+
+    spdlog::debug("Maze::labelRegions: labelled {} regions in {}ms", count, clock.getElapsedTime().asMilliseconds());
+}
+
+sf::Uint32 Maze::getRegion(const sf::Vector2u &offset) const
+{
+    if (offset.x >= m_size.x || offset.y >= m_size.y) {
+        return 0;
+    }
+
+    return m_regions[offset];
+}
+
+bool Maze::isReachable(const sf::Vector2u &from, const sf::Vector2u &to) const
+{
+    sf::Uint32 region = getRegion(from);
+    return region != 0 && region == getRegion(to);
+}
+
+sf::Uint32 Maze::getRegionSize(sf::Uint32 region) const
+{
+    if (region >= m_regionSizes.size()) {
+        return 0;
+    }
+
+    return m_regionSizes[region];
+}
+
+sf::Uint32 Maze::addRegion()
+{
+    m_regionSizes.push_back(0);
+    m_regionCount++;
+
+    return m_regionSizes.size() - 1;
+}
+
+void Maze::openRegion(const sf::Vector2u &offset)
+{
+    int x = offset.x;
+    int y = offset.y;
+
+    // the cell joins the largest region next to it, and the others are moved into
+    // that, so merging costs no more than the cells of the smaller regions
+    sf::Uint32 region = 0;
+    for (int d = 0; d < 4; d++) {
+        sf::Uint32 neighbour = m_regions(x + offsetsX[d], y + offsetsY[d]);
+        if (neighbour != 0 && (region == 0 || m_regionSizes[neighbour] > m_regionSizes[region])) {
+            region = neighbour;
+        }
+    }
+
+    if (region == 0) {
+        region = addRegion();
+    }
+
+    m_regions(x, y) = region;
+    m_regionSizes[region]++;
+
+    for (int d = 0; d < 4; d++) {
+        sf::Uint32 neighbour = m_regions(x + offsetsX[d], y + offsetsY[d]);
+        if (neighbour != 0 && neighbour != region) {
+            relabelRegion(sf::Vector2i(x + offsetsX[d], y + offsetsY[d]), neighbour, region);
+        }
+    }
+}
+
+void Maze::closeRegion(const sf::Vector2u &offset)
+{
+    int        x      = offset.x;
+    int        y      = offset.y;
+    sf::Uint32 region = m_regions(x, y);
+
+    m_regions(x, y) = 0;
+    if (--m_regionSizes[region] == 0) {
+        m_regionCount--;
+        return;
+    }
+
+    // The region can only have split between the open neighbours of the cell. A
+    // search is started from each of them, and the searches take turns to visit
+    // one cell each. Searches that meet are joined into a group. A group that runs
+    // out of cells before meeting the others has been cut off, and becomes a new
+    // region; this stops as soon as one group is left, which keeps the old id, so
+    // the cost is about the size of the smaller pieces rather than the region.
+    size_t     heads[4] = {0, 0, 0, 0};
+    sf::Uint32 groups[4];
+    bool       cutOff[4] = {false, false, false, false};
+    sf::Uint32 count     = 0;
+
+    for (auto &queue : m_searches) {
+        queue.clear();
+    }
+
+    if (++m_visitStamp >= (1u << 30)) {
+        m_visits.fill(0);
+        m_visitStamp = 1;
+    }
+
+    for (int d = 0; d < 4; d++) {
+        int nx = x + offsetsX[d];
+        int ny = y + offsetsY[d];
+
+        if (m_regions(nx, ny) == region) {
+            m_visits(nx, ny) = (m_visitStamp << 2) | count;
+            m_searches[count].push_back(sf::Vector2i(nx, ny));
+            groups[count] = count;
+            count++;
+        }
+    }
+
+    auto findGroup = [&](sf::Uint32 search) {
+        while (groups[search] != search) {
+            search = groups[search];
+        }
+        return search;
+    };
+
+    sf::Uint32 remaining = count;
+    while (remaining > 1) {
+        for (sf::Uint32 s = 0; s < count; s++) {
+            if (heads[s] == m_searches[s].size()) {
+                continue;
+            }
+
+            auto cell = m_searches[s][heads[s]++];
+            for (int d = 0; d < 4; d++) {
+                int nx = cell.x + offsetsX[d];
+                int ny = cell.y + offsetsY[d];
+
+                if (m_regions(nx, ny) != region) {
+                    continue;
+                }
+
+                auto &visit = m_visits(nx, ny);
+                if ((visit >> 2) != m_visitStamp) {
+                    visit = (m_visitStamp << 2) | s;
+                    m_searches[s].push_back(sf::Vector2i(nx, ny));
+                    continue;
+                }
+
+                sf::Uint32 a = findGroup(s);
+                sf::Uint32 b = findGroup(visit & 3);
+                if (a != b) {
+                    groups[std::max(a, b)] = std::min(a, b);
+                    remaining--;
+                }
+            }
+        }
+
+        // move every group whose searches have all run out into a region of its own
+        for (sf::Uint32 group = 0; group < count && remaining > 1; group++) {
+            if (groups[group] != group || cutOff[group]) {
+                continue;
+            }
+
+            bool exhausted = true;
+            for (sf::Uint32 s = 0; s < count; s++) {
+                if (findGroup(s) == group && heads[s] < m_searches[s].size()) {
+                    exhausted = false;
+                }
+            }
+
+            if (!exhausted) {
+                continue;
+            }
+
+            sf::Uint32 pocket = addRegion();
+            for (sf::Uint32 s = 0; s < count; s++) {
+                if (findGroup(s) != group) {
+                    continue;
+                }
+
+                for (const auto &cell : m_searches[s]) {
+                    m_regions(cell.x, cell.y) = pocket;
+                }
+
+                m_regionSizes[pocket] += m_searches[s].size();
+                m_regionSizes[region] -= m_searches[s].size();
+            }
+
+            cutOff[group] = true;
+            remaining--;
+        }
+    }
+}
+
+void Maze::relabelRegion(const sf::Vector2i &start, sf::Uint32 from, sf::Uint32 to)
+{
+    floodRelabel(m_regions, start, from, to, m_fillQueue);
+
+    m_regionSizes[to]  += m_fillQueue.size();
+    m_regionSizes[from] = 0;
+    m_regionCount--;
+}
+
+sf::Uint32 Maze::addPrefab(const RoomShape &shape)
+{
+    m_prefabs.push_back(shape);
+    return m_prefabs.size() - 1;
+}
+
+void Maze::setPrefab(sf::Uint32 index, const RoomShape &shape)
+{
+    if (index >= m_prefabs.size()) {
+        spdlog::error("Maze::setPrefab: index out of range");
+        return;
+    }
+
+    m_prefabs[index] = shape;
+}
+
+void Maze::addListener(MazeListener *listener)
+{
+    m_listeners.push_back(listener);
+}
+
+void Maze::removeListener(MazeListener *listener)
+{
+    m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), listener), m_listeners.end());
+}
@@ -1,25 +1,38 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <random>
+#include <span>
 #include <vector>
 
 #include <SFML/Graphics.hpp>
 
+#include "CaveGenerator.hpp"
 #include "Cell.hpp"
+#include "GenerationContext.hpp"
+#include "Grid.hpp"
+#include "PagedStore.hpp"
+#include "RTree.hpp"
 #include "RoomShape.hpp"
+#include "WfcGenerator.hpp"
 
-// Room is a thin representation of a room in the maze. It simply holds the region id
-// of the room. The region id is used to identify the room in the maze.
+// Room is a thin representation of a room in the maze. It holds the region id
+// of the room, which is used to identify the room in the maze, along with where
+// it was placed and the prefab it was made from.
 class Room
 {
     private:
-        sf::Uint32 m_region; // region id
+        sf::Uint32  m_region; // region id
+        sf::IntRect m_bounds; // cells the prefab covers
+        sf::Uint32  m_prefab; // index of the prefab the room was made from
 
     public:
-        Room(sf::Uint32 region)
+        Room(sf::Uint32 region, const sf::IntRect &bounds, sf::Uint32 prefab)
         {
             m_region = region;
+            m_bounds = bounds;
+            m_prefab = prefab;
         };
 
         ~Room() = default;
@@ -35,24 +48,79 @@ class Room
         {
             return m_region;
         };
+
+        // get the rectangle of cells the room's prefab covers
+        const sf::IntRect &getBounds() const
+        {
+            return m_bounds;
+        }
+
+        // get the index of the prefab the room was made from
+        sf::Uint32 getPrefab() const
+        {
+            return m_prefab;
+        }
+};
+
+// MazeListener is notified when cells in a Maze change, so that anything built
+// from the maze (overview maps, light maps, region labels) can be updated
+// incrementally instead of being rebuilt from every cell.
+class MazeListener
+{
+    public:
+        virtual ~MazeListener() = default;
+
+        // onCellChanged is called after the cell at the given position has been set
+        // to a new type by setCell.
+        virtual void onCellChanged(const sf::Vector2u &position, Cell cell) = 0;
+
+        // onMazeGenerated is called after the maze has been generated, when any or
+        // all of the cells may have changed. No onCellChanged calls are made while
+        // the maze is being generated.
+        virtual void onMazeGenerated() = 0;
 };
 
 class Maze
 {
     private:
-        sf::Vector2u              m_size;       // size of the maze
-        std::vector<Cell>         m_cells;      // grid of cells for the maze
-        std::vector<sf::Uint32>   m_regions;    // grid of regions for each cell in the maze
-        std::vector<Room *>       m_rooms;      // list of rooms
-        std::vector<sf::Vector2u> m_connectors; // list of connectors
-        sf::Uint32                m_seed;       // seed used to generate the maze
-        sf::Uint32                m_nextRegion; // next region id
-        std::mt19937              m_gen;        // random number generator
-        std::vector<RoomShape>    m_prefabs;    // list of prefab shapes
+        // a room placed in a partition, before it is given a region
+        struct Placement
+        {
+            sf::Vector2u offset; // top left cell of the room
+            sf::Uint32   prefab; // index of the prefab
+        };
+
+        sf::Vector2u                        m_size;          // size of the maze
+        Grid<Cell>                          m_cells;         // grid of cells for the maze, with a border of walls
+        Grid<sf::Uint32>                    m_regions;       // region id of each cell in the maze, 0 for walls
+        std::vector<Room>                   m_rooms;         // list of rooms
+        std::vector<sf::Vector2u>           m_connectors;    // list of connectors
+        sf::Uint32                          m_seed;          // seed used to generate the maze
+        sf::Uint32                          m_nextRegion;    // next region id
+        std::mt19937                        m_gen;           // random number generator
+        std::vector<RoomShape>              m_prefabs;       // list of prefab shapes
+        std::vector<MazeListener *>         m_listeners;     // listeners told about cell changes
+        bool                                m_generating;    // true while generate is running
+        std::vector<sf::Uint32>             m_regionSizes;   // number of cells in each region, by region id
+        sf::Uint32                          m_regionCount;   // number of regions with any cells
+        Grid<sf::Uint32>                    m_visits;        // search marks used when a region may split
+        sf::Uint32                          m_visitStamp;    // marks from earlier searches are older than this
+        std::vector<sf::Vector2i>           m_searches[4];   // cells found by each search of closeRegion
+        std::vector<sf::Vector2i>           m_fillQueue;     // cells relabelled by the last flood fill
+        GenerationContext                   m_context;       // arena and threads for generation
+        std::vector<sf::Uint32>             m_roomLinks;     // adjacent rooms of every room, one after another
+        std::vector<sf::Uint32>             m_linkStarts;    // where each room's adjacent rooms start in m_roomLinks
+        RTree                               m_roomIndex;     // spatial index of the bounds of the rooms
+        bool                                m_parallelRooms; // place rooms partition by partition on every thread
+        std::vector<std::vector<Placement>> m_placed;        // rooms placed in each partition, in order
 
         // generate a room in the maze, up to the maximum number of attempts
         void generateRooms(sf::Uint32 max_attempts);
 
+        // generate rooms like generateRooms, but in square partitions of the maze
+        // placed in parallel, sharing the attempts out between them by area
+        void generateRoomsParallel(sf::Uint32 max_attempts);
+
         // generates corridors by picking a random wall cell and carving corridors
         void generateCorridors();
 
@@ -65,21 +133,104 @@ class Maze
         // remove dead ends from the maze
         void removeDeadEnds(sf::Uint32 max_iterations);
 
-        // test if a room will fit in the maze at the given location
+        // test if a room will fit in the maze at the given location, without any of
+        // the cells it carves landing on an open cell
         bool roomFits(const RoomShape &room, const sf::Vector2u &offset) const;
 
+        // carve the open cells of a room into the maze at the given location
+        void carveRoom(const RoomShape &room, const sf::Vector2u &offset);
+
+        // start a new empty region and return its id
+        sf::Uint32 addRegion();
+
+        // update the regions after a wall cell was opened, merging the regions it joins
+        void openRegion(const sf::Vector2u &offset);
+
+        // update the regions after an open cell was walled up, splitting its region
+        // if that cut it in two or more
+        void closeRegion(const sf::Vector2u &offset);
+
+        // move the cells of the region from, connected to start, into the region to
+        void relabelRegion(const sf::Vector2i &start, sf::Uint32 from, sf::Uint32 to);
+
+        // fill in the regions smaller than minSize, then either tunnel from each
+        // region left to the nearest one already joined to the largest, or fill in
+        // every region but the largest. Needs labelled regions, and returns true if
+        // any cell changed.
+        bool joinRegions(sf::Uint32 minSize, bool connect);
+
+        // link the rooms that corridors and doors join, and index their bounds
+        void buildRoomGraph();
+
+        // label the regions again after every cell was replaced, which leaves no
+        // rooms, and tell listeners the maze was generated
+        void replacedCells();
+
+        // check if the maze fits inside a world with its top left at offset
+        bool fitsWorld(const PagedStore &store, const sf::Vector2u &offset) const;
+
     public:
         Maze(const sf::Vector2u &size);
         ~Maze() = default;
 
-        // generate a maze using the given seed
-        void generate(sf::Uint32 seed);
+        // generate a maze using the given seed, replacing any maze generated before
+        void generate(sf::Uint32 seed)
+        {
+            regenerate(seed);
+        }
+
+        // generate the maze again with a new seed. Every buffer is reused from the
+        // last run, and temporaries come from the arena of the generation context,
+        // so once a few mazes have been generated and the buffers have grown to fit,
+        // this does not allocate at all if the context is set to use one thread. With
+        // more threads, starting the workers allocates on every run.
+        void regenerate(sf::Uint32 seed);
+
+        // generate caves with a cellular automaton instead of rooms and corridors,
+        // replacing any maze generated before. The generator holds the rule and its
+        // buffers, which are reused by the next call. Caves are ROOM cells and the
+        // tunnels joining them are CORRIDOR cells.
+        void generateCaves(sf::Uint32 seed, CaveGenerator &caves);
+
+        // generate rooms with Wave Function Collapse, from patterns learned from the
+        // prefabs, replacing any maze generated before. Rooms left apart are joined
+        // by CORRIDOR tunnels. If the generator gives up, the cells it could not
+        // decide are left as walls.
+        void generateWfc(sf::Uint32 seed, WfcGenerator &wfc);
+
+        // place rooms in parallel, in partitions of the maze. The rooms differ from
+        // those placed one at a time with the same seed, but are the same for a
+        // seed whatever the number of threads.
+        void setParallelRooms(bool parallel)
+        {
+            m_parallelRooms = parallel;
+        }
+
+        bool getParallelRooms() const
+        {
+            return m_parallelRooms;
+        }
+
+        // get the generation context, to set the threads generation uses
+        GenerationContext &getContext()
+        {
+            return m_context;
+        }
 
         // get the size of the maze
         sf::Vector2u getSize() const;
 
-        // get the cells that make up the maze
-        std::vector<std::vector<Cell>> getCells() const;
+        // get a read-only view of the cells that make up the maze, without copying
+        // them. Cells are changed through setCell so that listeners are told.
+        GridView<const Cell> getCells() const;
+
+        // get the grid of cells. It has a sentinel border one cell wide that is
+        // always WALL, so 3x3 stencils can read the neighbours of any cell,
+        // including those on the edge, without bounds checks.
+        const Grid<Cell> &getGrid() const
+        {
+            return m_cells;
+        }
 
         // get a specific cell in the maze
         Cell getCell(const sf::Vector2u &offset) const;
@@ -87,6 +238,87 @@ class Maze
         // set a specific cell in the maze
         void setCell(const sf::Vector2u &offset, Cell cell);
 
+        // replace every cell at once, for example with a saved level. The cells must
+        // be the size of the maze. Regions are labelled again and listeners are told
+        // the maze was generated, as after generate.
+        void setCells(GridView<const Cell> cells);
+
+        // replace every cell with the rectangle of a world the size of the maze, with
+        // its top left at offset, as setCells does. The store must hold Cells.
+        // Returns false if the rectangle is not inside the world.
+        bool loadWindow(PagedStore &store, const sf::Vector2u &offset);
+
+        // copy every cell into a world, with the top left of the maze at offset.
+        // Returns false if the maze does not fit inside the world there.
+        bool saveWindow(PagedStore &store, const sf::Vector2u &offset) const;
+
         // check the type of a specific cell in the maze
         bool isCell(const sf::Vector2u &offset, Cell cell) const;
+
+        // label every separate open area of the maze with its own region id, from
+        // scratch. The rows are split into bands labelled in parallel on threads
+        // workers, or every hardware thread if 0. generate calls this, and after that
+        // setCell keeps the regions up to date one cell at a time, so it only needs
+        // calling again after changing cells some other way.
+        //
+        // Cells are connected orthogonally, and any cell that is not a wall is open.
+        // Region ids are not kept stable: they change when regions merge or split.
+        void labelRegions(sf::Uint32 threads = 0);
+
+        // get the region id of a cell, or 0 if it is a wall
+        sf::Uint32 getRegion(const sf::Vector2u &offset) const;
+
+        // check if there is an open path between two cells
+        bool isReachable(const sf::Vector2u &from, const sf::Vector2u &to) const;
+
+        // get the number of separate open areas, 1 if the maze is fully connected
+        sf::Uint32 getRegionCount() const
+        {
+            return m_regionCount;
+        }
+
+        // get the number of cells in a region
+        sf::Uint32 getRegionSize(sf::Uint32 region) const;
+
+        // get the rooms placed by the last generate, in the order they were placed.
+        // Rooms are referred to by their index in this list. Only the rooms and
+        // corridors engine places rooms, and rooms are not updated by setCell, and
+        // are cleared by setCells.
+        const std::vector<Room> &getRooms() const
+        {
+            return m_rooms;
+        }
+
+        // get the index of the room a cell is part of, or -1 if it is not in a room
+        sf::Int32 getRoomAt(const sf::Vector2u &position) const;
+
+        // get the rooms whose bounds overlap a rectangle of cells
+        void getRoomsIn(const sf::IntRect &rect, std::vector<sf::Uint32> &rooms) const;
+
+        // get up to count rooms nearest a cell, measured to the nearest cell of their
+        // bounds, closest first. Rooms that accept returns false for are passed over,
+        // for queries like the nearest room not yet explored.
+        void getNearestRooms(const sf::Vector2i                    &position,
+                             sf::Uint32                             count,
+                             std::vector<sf::Uint32>               &rooms,
+                             const std::function<bool(sf::Uint32)> &accept = nullptr) const;
+
+        // get the rooms next to a room. Rooms are next to each other if they touch,
+        // or if corridors and doors lead from one to the other without getting closer
+        // to any other room on the way.
+        std::span<const sf::Uint32> getAdjacentRooms(sf::Uint32 room) const;
+
+        // add a room shape to the prefabs rooms are picked from, returning its index
+        sf::Uint32 addPrefab(const RoomShape &shape);
+
+        // replace a prefab, for example when its file has been edited. Mazes
+        // generated afterwards use the new shape.
+        void setPrefab(sf::Uint32 index, const RoomShape &shape);
+
+        // register a listener to be told about cell changes. The listener is not
+        // owned by the maze and must be removed before it is destroyed.
+        void addListener(MazeListener *listener);
+
+        // unregister a listener added with addListener
+        void removeListener(MazeListener *listener);
 };
\ No newline at end of file
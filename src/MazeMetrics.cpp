@@ -0,0 +1,146 @@
+#include "MazeMetrics.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+const int offsetsX[4] = {0, -1, 1, 0};
+const int offsetsY[4] = {-1, 0, 0, 1};
+
+// Label the orthogonally connected areas of cells that match a predicate, storing
+// area number + 1 for each cell in labels, and return the number of cells in each
+// area. The maze grid has a border of walls, so neither predicate ever lets the
+// fill step off the grid.
+template <typename Match>
+std::vector<sf::Uint32> labelAreas(const Grid<Cell> &cells, Grid<sf::Uint32> &labels, Match match)
+{
+    auto                      size = cells.getSize();
+    std::vector<sf::Uint32>   areas;
+    std::vector<sf::Vector2i> queue;
+
+    for (int y = 0; y < static_cast<int>(size.y); y++) {
+        for (int x = 0; x < static_cast<int>(size.x); x++) {
+            if (labels(x, y) != 0 || !match(cells(x, y))) {
+                continue;
+            }
+
+            sf::Uint32 label = areas.size() + 1;
+            labels(x, y)     = label;
+            queue.assign(1, sf::Vector2i(x, y));
+
+            for (size_t i = 0; i < queue.size(); i++) {
+                auto cell = queue[i];
+                for (int d = 0; d < 4; d++) {
+                    int nx = cell.x + offsetsX[d];
+                    int ny = cell.y + offsetsY[d];
+
+                    if (labels(nx, ny) == 0 && match(cells(nx, ny))) {
+                        labels(nx, ny) = label;
+                        queue.push_back(sf::Vector2i(nx, ny));
+                    }
+                }
+            }
+
+            areas.push_back(queue.size());
+        }
+    }
+
+    return areas;
+}
+
+// breadth first search over the open cells from start, returning the cell
+// furthest from it and its distance
+std::pair<sf::Vector2i, sf::Uint32> findFurthest(const Grid<Cell> &cells, const sf::Vector2i &start)
+{
+    Grid<int>                 distances(cells.getSize(), -1, 1);
+    std::vector<sf::Vector2i> queue(1, start);
+
+    distances(start.x, start.y) = 0;
+
+    sf::Vector2i furthest = start;
+    for (size_t i = 0; i < queue.size(); i++) {
+        auto cell     = queue[i];
+        auto distance = distances(cell.x, cell.y);
+        furthest      = cell;
+
+        for (int d = 0; d < 4; d++) {
+            int nx = cell.x + offsetsX[d];
+            int ny = cell.y + offsetsY[d];
+
+            if (distances(nx, ny) < 0 && cells(nx, ny) != Cell::WALL) {
+                distances(nx, ny) = distance + 1;
+                queue.push_back(sf::Vector2i(nx, ny));
+            }
+        }
+    }
+
+    // the last cell dequeued is one of the furthest
+    return {furthest, static_cast<sf::Uint32>(distances(furthest.x, furthest.y))};
+}
+
+} // namespace
+
+MazeMetrics measureMaze(const Maze &maze)
+{
+    const auto &cells = maze.getGrid();
+    auto        size  = cells.getSize();
+
+    MazeMetrics metrics{};
+    if (size.x == 0 || size.y == 0) {
+        return metrics;
+    }
+
+    Grid<sf::Uint32> labels(size, 0, 1);
+
+    // rooms never touch each other, so every area of room cells is one room
+    metrics.rooms = labelAreas(cells, labels, [](Cell cell) { return cell == Cell::ROOM; }).size();
+
+    labels.fill(0);
+    auto areas = labelAreas(cells, labels, [](Cell cell) { return cell != Cell::WALL; });
+
+    sf::Uint32 open = 0;
+    for (auto area : areas) {
+        open += area;
+    }
+
+    metrics.floorRatio = static_cast<float>(open) / (size.x * size.y);
+    metrics.regions    = areas.size();
+
+    if (open == 0) {
+        return metrics;
+    }
+
+    auto       largest     = std::max_element(areas.begin(), areas.end());
+    sf::Uint32 largestArea = largest - areas.begin() + 1;
+    metrics.connectivity   = static_cast<float>(*largest) / open;
+
+    sf::Vector2i start;
+    for (int y = 0; y < static_cast<int>(size.y); y++) {
+        for (int x = 0; x < static_cast<int>(size.x); x++) {
+            if (cells(x, y) == Cell::WALL) {
+                continue;
+            }
+
+            if (labels(x, y) == largestArea) {
+                start = sf::Vector2i(x, y);
+            }
+
+            int neighbours = 0;
+            for (int d = 0; d < 4; d++) {
+                neighbours += cells(x + offsetsX[d], y + offsetsY[d]) != Cell::WALL;
+            }
+
+            if (neighbours == 1) {
+                metrics.deadEnds++;
+            }
+        }
+    }
+
+    auto end            = findFurthest(cells, start).first;
+    metrics.longestPath = findFurthest(cells, end).second;
+
+    return metrics;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+
+#include "Maze.hpp"
+
+// MazeMetrics summarises the layout of a generated Maze, so that seeds can be
+// compared and picked without looking at every level.
+struct MazeMetrics
+{
+    sf::Uint32 rooms;        // number of separate rooms
+    float      floorRatio;   // fraction of the cells that are not walls
+    sf::Uint32 regions;      // number of separate open areas, 1 if fully connected
+    float      connectivity; // fraction of the open cells in the largest area
+    sf::Uint32 deadEnds;     // open cells with exactly one open neighbour
+    sf::Uint32 longestPath;  // steps between the two cells furthest apart in the largest area
+};
+
+// measure the layout of a maze. Open cells are connected orthogonally.
+//
+// The longest path is found with a double sweep: a breadth first search from
+// any cell of the largest area finds the cell furthest from it, and a second
+// search from there finds the length. That is exact for tree-like corridors and
+// a close lower bound for areas with loops.
+MazeMetrics measureMaze(const Maze &maze);
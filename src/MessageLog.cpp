@@ -0,0 +1,74 @@
+#include "MessageLog.hpp"
+
+#include <algorithm>
+#include <fmt/format.h>
+
+namespace
+{
+
+// space between the edge of the panel and the text
+const float padding = 6;
+
+} // namespace
+
+MessageLog::MessageLog(size_t limit)
+{
+    m_limit  = std::max<size_t>(1, limit);
+    m_scroll = 0;
+}
+
+void MessageLog::add(const std::string &text, const sf::Color &color)
+{
+    if (!m_messages.empty() && m_messages.back().plain == text && m_messages.back().color == color) {
+        auto &last = m_messages.back();
+        last.count++;
+        last.text = fmt::format("{} (x{})", text, last.count);
+        return;
+    }
+
+    m_messages.push_back(Message{text, text, color, 1});
+
+    // keep the messages on screen where they are while scrolled back
+    if (m_scroll > 0) {
+        m_scroll++;
+    }
+
+    if (m_messages.size() > m_limit) {
+        m_messages.pop_front();
+    }
+
+    m_scroll = std::min(m_scroll, m_messages.size() - 1);
+}
+
+void MessageLog::scroll(int messages)
+{
+    if (m_messages.empty()) {
+        return;
+    }
+
+    auto scroll = static_cast<long long>(m_scroll) + messages;
+    m_scroll    = std::clamp<long long>(scroll, 0, m_messages.size() - 1);
+}
+
+void MessageLog::draw(TextRenderer &renderer, const sf::FloatRect &area) const
+{
+    renderer.addRect(area, sf::Color(0, 0, 0, 160));
+
+    float wrap   = area.width - padding * 2;
+    float bottom = area.top + area.height - padding;
+    float top    = area.top + padding;
+
+    // lay out from the newest message shown upwards, stopping at the first that
+    // does not fit, so the rest of the history is never touched
+    for (size_t i = m_messages.size() - std::min(m_scroll, m_messages.size()); i-- > 0;) {
+        const auto &message = m_messages[i];
+        const auto &layout  = renderer.getLayout(message.text, wrap);
+
+        if (bottom - layout.size.y < top) {
+            break;
+        }
+
+        bottom -= layout.size.y;
+        renderer.addLayout(layout, sf::Vector2f(area.left + padding, bottom), message.color);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <deque>
+#include <string>
+
+#include <SFML/Graphics.hpp>
+
+#include "TextRenderer.hpp"
+
+// MessageLog keeps the history of messages shown to the player, newest last,
+// and draws the end of it into a panel through a TextRenderer.
+//
+// The history can hold thousands of messages, but only those that fit in the
+// panel are laid out: drawing starts from the newest message shown and works up
+// the panel until it is full, so the cost of a frame depends on the size of the
+// panel and not on the length of the history. Each message is wrapped to the
+// width of the panel, and the layouts of the messages on screen are cached by
+// the renderer, so a log that is not scrolling costs a copy of its vertices.
+//
+// The same message repeated straight away is counted rather than added again,
+// and shown as "message (x3)".
+class MessageLog
+{
+    private:
+        struct Message
+        {
+            std::string text;  // the message, with its repeat count if above 1
+            std::string plain; // the message as added, to spot repeats
+            sf::Color   color; // colour to draw it in
+            sf::Uint32  count; // times it was added in a row
+        };
+
+        std::deque<Message> m_messages; // the history, newest last
+        size_t              m_limit;    // most messages kept
+        size_t              m_scroll;   // messages scrolled back from the newest
+
+    public:
+        MessageLog(size_t limit = 1000);
+        ~MessageLog() = default;
+
+        // add a message to the end of the history, dropping the oldest if it is full
+        void add(const std::string &text, const sf::Color &color = sf::Color::White);
+
+        // scroll back through the history by a number of messages, or forward if
+        // negative. Adding a message does not scroll, so the player keeps their place.
+        void scroll(int messages);
+
+        // go back to the newest message
+        void scrollToEnd()
+        {
+            m_scroll = 0;
+        }
+
+        // get the number of messages in the history
+        size_t getCount() const
+        {
+            return m_messages.size();
+        }
+
+        // add the panel and as many of the messages as fit in it to the renderer's
+        // batch, newest at the bottom
+        void draw(TextRenderer &renderer, const sf::FloatRect &area) const;
+};
@@ -0,0 +1,227 @@
+#include "Minimap.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// Cells are ranked by how much they matter on the overview. When a block of cells
+// is reduced to a single pixel the highest ranked explored cell wins, so doors
+// and one-cell corridors never vanish when the map is downsampled.
+sf::Uint8 rank(Cell cell)
+{
+    switch (cell) {
+    case Cell::DOOR:
+        return 4;
+    case Cell::ROOM:
+        return 3;
+    case Cell::CORRIDOR:
+        return 2;
+    case Cell::WALL:
+        return 1;
+    }
+
+    return 0;
+}
+
+// colour of each rank, with rank 0 being unexplored
+const sf::Color colors[] = {
+    sf::Color(16, 16, 16, 200),
+    sf::Color(64, 64, 64),
+    sf::Color(140, 140, 140),
+    sf::Color(200, 200, 200),
+    sf::Color(200, 140, 60),
+};
+
+} // namespace
+
+Minimap::Minimap(Maze *maze, sf::Uint32 cellsPerPixel)
+{
+    m_maze          = maze;
+    m_cellsPerPixel = std::max(cellsPerPixel, 1u);
+
+    auto mazeSize = m_maze->getSize();
+    m_size.x      = (mazeSize.x + m_cellsPerPixel - 1) / m_cellsPerPixel;
+    m_size.y      = (mazeSize.y + m_cellsPerPixel - 1) / m_cellsPerPixel;
+
+    m_explored.resize(mazeSize.x * mazeSize.y, 0);
+    m_pixels.resize(m_size.x * m_size.y * 4, 0);
+    m_rebuild = true;
+
+    if (!m_texture.create(m_size.x, m_size.y)) {
+        spdlog::error("Minimap::Minimap: failed to create {}x{} texture", m_size.x, m_size.y);
+    }
+
+    m_maze->addListener(this);
+
+    spdlog::info("Minimap::Minimap: created {}x{} minimap", m_size.x, m_size.y);
+}
+
+Minimap::~Minimap()
+{
+    m_maze->removeListener(this);
+}
+
+void Minimap::markDirty(const sf::Vector2u &position)
+{
+    int x = position.x / m_cellsPerPixel;
+    int y = position.y / m_cellsPerPixel;
+
+    if (m_dirty.width == 0) {
+        m_dirty = sf::IntRect(x, y, 1, 1);
+        return;
+    }
+
+    int right  = std::max(m_dirty.left + m_dirty.width, x + 1);
+    int bottom = std::max(m_dirty.top + m_dirty.height, y + 1);
+
+    m_dirty.left   = std::min(m_dirty.left, x);
+    m_dirty.top    = std::min(m_dirty.top, y);
+    m_dirty.width  = right - m_dirty.left;
+    m_dirty.height = bottom - m_dirty.top;
+}
+
+void Minimap::reduce(sf::Uint32 first, sf::Uint32 last, sf::Uint32 left, sf::Uint32 right)
+{
+    auto mazeSize = m_maze->getSize();
+    auto cells    = m_maze->getCells();
+
+    for (sf::Uint32 py = first; py < last; py++) {
+        sf::Uint32 cellTop    = py * m_cellsPerPixel;
+        sf::Uint32 cellBottom = std::min(cellTop + m_cellsPerPixel, mazeSize.y);
+
+        for (sf::Uint32 px = left; px < right; px++) {
+            sf::Uint32 cellLeft  = px * m_cellsPerPixel;
+            sf::Uint32 cellRight = std::min(cellLeft + m_cellsPerPixel, mazeSize.x);
+
+            // reduce the block of cells under this pixel to its highest ranked cell
+            sf::Uint8 best = 0;
+            for (sf::Uint32 y = cellTop; y < cellBottom; y++) {
+                auto  row      = cells.row(y);
+                auto *explored = &m_explored[y * mazeSize.x];
+
+                for (sf::Uint32 x = cellLeft; x < cellRight; x++) {
+                    if (explored[x]) {
+                        best = std::max(best, rank(row[x]));
+                    }
+                }
+            }
+
+            auto &color = colors[best];
+            auto *pixel = &m_pixels[(py * m_size.x + px) * 4];
+
+            pixel[0] = color.r;
+            pixel[1] = color.g;
+            pixel[2] = color.b;
+            pixel[3] = color.a;
+        }
+    }
+}
+
+void Minimap::update()
+{
+    if (m_rebuild) {
+        // every band of rows is reduced independently, so they can run in parallel
+        parallelFor(0, m_size.y, [this](sf::Uint32 first, sf::Uint32 last) { reduce(first, last, 0, m_size.x); });
+
+        m_texture.update(m_pixels.data());
+        m_rebuild = false;
+        m_dirty   = sf::IntRect();
+        return;
+    }
+
+    if (m_dirty.width == 0) {
+        return;
+    }
+
+    sf::Uint32 left   = m_dirty.left;
+    sf::Uint32 top    = m_dirty.top;
+    sf::Uint32 width  = m_dirty.width;
+    sf::Uint32 height = m_dirty.height;
+
+    reduce(top, top + height, left, left + width);
+
+    // copy the dirty rectangle out of the pixel buffer so that only it is uploaded
+    m_patch.resize(width * height * 4);
+    for (sf::Uint32 y = 0; y < height; y++) {
+        std::memcpy(&m_patch[y * width * 4], &m_pixels[((top + y) * m_size.x + left) * 4], width * 4);
+    }
+
+    m_texture.update(m_patch.data(), width, height, left, top);
+    m_dirty = sf::IntRect();
+}
+
+void Minimap::explore(const sf::Vector2u &position)
+{
+    auto mazeSize = m_maze->getSize();
+    if (position.x >= mazeSize.x || position.y >= mazeSize.y) {
+        return;
+    }
+
+    auto &explored = m_explored[position.y * mazeSize.x + position.x];
+    if (!explored) {
+        explored = 1;
+        markDirty(position);
+    }
+}
+
+void Minimap::explore(const sf::IntRect &area)
+{
+    auto mazeSize = m_maze->getSize();
+
+    sf::Uint32 left   = std::clamp(area.left, 0, static_cast<int>(mazeSize.x));
+    sf::Uint32 top    = std::clamp(area.top, 0, static_cast<int>(mazeSize.y));
+    sf::Uint32 right  = std::clamp(area.left + area.width, 0, static_cast<int>(mazeSize.x));
+    sf::Uint32 bottom = std::clamp(area.top + area.height, 0, static_cast<int>(mazeSize.y));
+
+    for (sf::Uint32 y = top; y < bottom; y++) {
+        for (sf::Uint32 x = left; x < right; x++) {
+            explore(sf::Vector2u(x, y));
+        }
+    }
+}
+
+void Minimap::exploreAll()
+{
+    std::fill(m_explored.begin(), m_explored.end(), 1);
+    m_rebuild = true;
+}
+
+void Minimap::forgetAll()
+{
+    std::fill(m_explored.begin(), m_explored.end(), 0);
+    m_rebuild = true;
+}
+
+const sf::Texture &Minimap::getTexture()
+{
+    update();
+    return m_texture;
+}
+
+void Minimap::draw(sf::RenderTarget &target, const sf::FloatRect &area)
+{
+    update();
+
+    sf::Sprite sprite(m_texture);
+    sprite.setPosition(area.left, area.top);
+    sprite.setScale(area.width / m_size.x, area.height / m_size.y);
+    target.draw(sprite);
+}
+
+void Minimap::onCellChanged(const sf::Vector2u &position, Cell)
+{
+    if (m_explored[position.y * m_maze->getSize().x + position.x]) {
+        markDirty(position);
+    }
+}
+
+void Minimap::onMazeGenerated()
+{
+    // a freshly generated maze is a new level that nobody has explored yet
+    forgetAll();
+}
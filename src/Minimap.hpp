@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Maze.hpp"
+
+// Minimap is an overview of a Maze drawn as a texture with one pixel per cell,
+// or one pixel per square block of cells when downsampled.
+//
+// The texture is built once from the cells of the maze, reducing each block of
+// cells to its most significant cell type (doors over rooms over corridors over
+// walls) in parallel across bands of rows. After that only the pixels covered by
+// changed or newly explored cells are recomputed, and only the rectangle around
+// them is uploaded, so keeping the minimap current costs a small sub-rect
+// texture update instead of a full re-upload.
+class Minimap : public MazeListener
+{
+    private:
+        Maze                  *m_maze;          // the maze being shown
+        sf::Uint32             m_cellsPerPixel; // width and height of the block of cells in a pixel
+        sf::Vector2u           m_size;          // size of the minimap in pixels
+        std::vector<sf::Uint8> m_explored;      // 1 for each cell the player has seen
+        std::vector<sf::Uint8> m_pixels;        // RGBA pixels of the minimap
+        std::vector<sf::Uint8> m_patch;         // scratch buffer for sub-rect uploads
+        sf::Texture            m_texture;       // texture the pixels are uploaded to
+        sf::IntRect            m_dirty;         // pixels that need recomputing
+        bool                   m_rebuild;       // true if every pixel needs recomputing
+
+        // mark the pixel covering a cell as needing to be recomputed
+        void markDirty(const sf::Vector2u &position);
+
+        // recompute the pixels in rows [first, last) inside the columns [left, right)
+        void reduce(sf::Uint32 first, sf::Uint32 last, sf::Uint32 left, sf::Uint32 right);
+
+    public:
+        Minimap(Maze *maze, sf::Uint32 cellsPerPixel = 1);
+        ~Minimap();
+
+        Minimap(const Minimap &)            = delete;
+        Minimap &operator=(const Minimap &) = delete;
+
+        // mark a cell, or every cell in a rectangle, as explored
+        void explore(const sf::Vector2u &position);
+        void explore(const sf::IntRect &area);
+
+        // mark every cell as explored, or forget every explored cell
+        void exploreAll();
+        void forgetAll();
+
+        // bring the texture up to date with the maze. Called by draw, but can be
+        // called earlier to keep the upload out of the draw.
+        void update();
+
+        // draw the minimap scaled to fit the given rectangle of the target
+        void draw(sf::RenderTarget &target, const sf::FloatRect &area);
+
+        // get the texture holding the minimap
+        const sf::Texture &getTexture();
+
+        // MazeListener
+        void onCellChanged(const sf::Vector2u &position, Cell cell) override;
+        void onMazeGenerated() override;
+};
@@ -0,0 +1,288 @@
+#include "Noise.hpp"
+
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUANTUM_NOISE_AVX2 1
+#endif
+
+namespace
+{
+
+// most octaves summed; past this they are finer than a tile anyway
+const sf::Uint32 maxOctaves = 16;
+
+// multipliers the lattice coordinates are hashed with
+const sf::Uint32 primeX = 0x27d4eb2du;
+const sf::Uint32 primeY = 0x165667b1u;
+
+// the 8 gradients, (1, 2) rotated and mirrored. Integer components keep the dot
+// products exact in the low bits, and 8 of them fit one AVX2 permute.
+const std::array<float, 8> gradientX = {1, 2, 2, 1, -1, -2, -2, -1};
+const std::array<float, 8> gradientY = {2, 1, -1, -2, -2, -1, 1, 2};
+
+// the weighted average of the octaves stays within about -1.1 to 1.1 in
+// practice, and this brings it to roughly -1 to 1
+const float normalise = 0.9f;
+
+// the lattice row and fade of one octave along a row of samples, which every
+// sample in the row shares
+struct RowOctave
+{
+    float      frequency; // lattice cells per tile
+    float      offset;    // lattice cells added to x, so octaves do not share zeros
+    float      amplitude; // weight of the octave in the sum
+    sf::Uint32 above;     // hash of the lattice row above the samples
+    sf::Uint32 below;     // hash of the lattice row below the samples
+    float      top;       // distance of the samples below the row above
+    float      bottom;    // distance of the samples below the row below, negative
+    float      fade;      // fade of top, the weight of the row below
+};
+
+// finish a lattice hash, leaving a gradient index from 0 to 7
+inline sf::Uint32 hash(sf::Uint32 x, sf::Uint32 row)
+{
+    sf::Uint32 h = x * primeX + row;
+
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h >> 29;
+}
+
+// splitmix32, to give each octave an unrelated seed
+inline sf::Uint32 mix(sf::Uint32 z)
+{
+    z += 0x9e3779b9u;
+    z  = (z ^ (z >> 16)) * 0x85ebca6bu;
+    z  = (z ^ (z >> 13)) * 0xc2b2ae35u;
+    return z ^ (z >> 16);
+}
+
+// the quintic fade 6t^5 - 15t^4 + 10t^3, written in the exact order the vector
+// path evaluates it
+inline float fade(float t)
+{
+    return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+// add octave to samples [first, count) of a row starting at column x
+void addOctave(float *out, sf::Int32 x, sf::Uint32 first, sf::Uint32 count, const RowOctave &octave)
+{
+    for (sf::Uint32 i = first; i < count; i++) {
+        float      fx   = static_cast<float>(x + static_cast<sf::Int32>(i)) * octave.frequency + octave.offset;
+        float      cell = std::floor(fx);
+        float      tx   = fx - cell;
+        sf::Uint32 ix   = static_cast<sf::Uint32>(static_cast<sf::Int32>(cell));
+
+        sf::Uint32 g00 = hash(ix, octave.above);
+        sf::Uint32 g10 = hash(ix + 1, octave.above);
+        sf::Uint32 g01 = hash(ix, octave.below);
+        sf::Uint32 g11 = hash(ix + 1, octave.below);
+
+        float right = tx - 1.f;
+        float d00   = gradientX[g00] * tx + gradientY[g00] * octave.top;
+        float d10   = gradientX[g10] * right + gradientY[g10] * octave.top;
+        float d01   = gradientX[g01] * tx + gradientY[g01] * octave.bottom;
+        float d11   = gradientX[g11] * right + gradientY[g11] * octave.bottom;
+
+        float u = fade(tx);
+        float a = d00 + u * (d10 - d00);
+        float b = d01 + u * (d11 - d01);
+        float n = a + octave.fade * (b - a);
+
+        out[i] = out[i] + n * octave.amplitude;
+    }
+}
+
+#ifdef QUANTUM_NOISE_AVX2
+
+bool hasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+
+__attribute__((target("avx2"))) inline __m256i hash8(__m256i x, __m256i row)
+{
+    __m256i h = _mm256_add_epi32(_mm256_mullo_epi32(x, _mm256_set1_epi32(primeX)), row);
+    h         = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h         = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x2c1b3c6du));
+    h         = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+    h         = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x297a2d39u));
+    h         = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    return _mm256_srli_epi32(h, 29);
+}
+
+__attribute__((target("avx2"))) inline __m256 dot8(__m256i g, __m256 tx, __m256 ty, __m256 gx, __m256 gy)
+{
+    __m256 x = _mm256_mul_ps(_mm256_permutevar8x32_ps(gx, g), tx);
+    __m256 y = _mm256_mul_ps(_mm256_permutevar8x32_ps(gy, g), ty);
+    return _mm256_add_ps(x, y);
+}
+
+__attribute__((target("avx2"))) inline __m256 fade8(__m256 t)
+{
+    __m256 cube = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+    __m256 p    = _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.f)), _mm256_set1_ps(15.f));
+    p           = _mm256_add_ps(_mm256_mul_ps(t, p), _mm256_set1_ps(10.f));
+    return _mm256_mul_ps(cube, p);
+}
+
+__attribute__((target("avx2"))) inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+// addOctave, 8 samples at a time, with the tail of the row done by addOctave
+__attribute__((target("avx2"))) void addOctaveAvx2(float            *out,
+                                                   sf::Int32         x,
+                                                   sf::Uint32        count,
+                                                   const RowOctave &octave)
+{
+    const __m256  gx        = _mm256_loadu_ps(gradientX.data());
+    const __m256  gy        = _mm256_loadu_ps(gradientY.data());
+    const __m256i lanes     = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i one       = _mm256_set1_epi32(1);
+    const __m256i above     = _mm256_set1_epi32(octave.above);
+    const __m256i below     = _mm256_set1_epi32(octave.below);
+    const __m256  top       = _mm256_set1_ps(octave.top);
+    const __m256  bottom    = _mm256_set1_ps(octave.bottom);
+    const __m256  fade      = _mm256_set1_ps(octave.fade);
+    const __m256  frequency = _mm256_set1_ps(octave.frequency);
+    const __m256  offset    = _mm256_set1_ps(octave.offset);
+    const __m256  amplitude = _mm256_set1_ps(octave.amplitude);
+
+    sf::Uint32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i column = _mm256_add_epi32(_mm256_set1_epi32(x + static_cast<sf::Int32>(i)), lanes);
+        __m256  fx     = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(column), frequency), offset);
+        __m256  cell   = _mm256_floor_ps(fx);
+        __m256  tx     = _mm256_sub_ps(fx, cell);
+        __m256  right  = _mm256_sub_ps(tx, _mm256_set1_ps(1.f));
+        __m256i ix     = _mm256_cvttps_epi32(cell);
+        __m256i ix1    = _mm256_add_epi32(ix, one);
+
+        __m256 d00 = dot8(hash8(ix, above), tx, top, gx, gy);
+        __m256 d10 = dot8(hash8(ix1, above), right, top, gx, gy);
+        __m256 d01 = dot8(hash8(ix, below), tx, bottom, gx, gy);
+        __m256 d11 = dot8(hash8(ix1, below), right, bottom, gx, gy);
+
+        __m256 u = fade8(tx);
+        __m256 n = lerp8(lerp8(d00, d10, u), lerp8(d01, d11, u), fade);
+
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(out + i), _mm256_mul_ps(n, amplitude));
+        _mm256_storeu_ps(out + i, sum);
+    }
+
+    addOctave(out, x, i, count, octave);
+}
+
+#else
+
+bool hasAvx2()
+{
+    return false;
+}
+
+void addOctaveAvx2(float *out, sf::Int32 x, sf::Uint32 count, const RowOctave &octave)
+{
+    addOctave(out, x, 0, count, octave);
+}
+
+#endif
+
+} // namespace
+
+Noise::Noise(sf::Uint32 seed, float frequency, sf::Uint32 octaves)
+{
+    m_seed       = seed;
+    m_frequency  = frequency;
+    m_octaves    = octaves;
+    m_lacunarity = 2;
+    m_gain       = 0.5f;
+    m_vectorised = true;
+}
+
+bool Noise::isVectorised() const
+{
+    return m_vectorised && hasAvx2();
+}
+
+float Noise::get(sf::Int32 x, sf::Int32 y) const
+{
+    float sample;
+    getRow(&sample, x, y, 1);
+    return sample;
+}
+
+void Noise::getRow(float *out, sf::Int32 x, sf::Int32 y, sf::Uint32 count) const
+{
+    std::fill_n(out, count, 0.f);
+
+    sf::Uint32 octaves = std::clamp(m_octaves, 1u, maxOctaves);
+    bool       vector  = isVectorised();
+
+    float total  = 0;
+    float weight = 1;
+    for (sf::Uint32 o = 0; o < octaves; o++, weight *= m_gain) {
+        total += weight;
+    }
+
+    float frequency = m_frequency;
+    float amplitude = normalise / total;
+
+    for (sf::Uint32 o = 0; o < octaves; o++) {
+        sf::Uint32 seed = mix(m_seed + o);
+        sf::Uint32 bits = mix(seed);
+
+        // the offsets keep octaves from all passing through zero at the same tiles
+        RowOctave octave;
+        octave.frequency = frequency;
+        octave.offset    = (bits & 0xffff) / 64.f;
+        octave.amplitude = amplitude;
+
+        float fy   = static_cast<float>(y) * frequency + (bits >> 16) / 64.f;
+        float cell = std::floor(fy);
+        auto  iy   = static_cast<sf::Uint32>(static_cast<sf::Int32>(cell));
+
+        octave.above  = iy * primeY + seed;
+        octave.below  = (iy + 1) * primeY + seed;
+        octave.top    = fy - cell;
+        octave.bottom = octave.top - 1.f;
+        octave.fade   = fade(octave.top);
+
+        if (vector) {
+            addOctaveAvx2(out, x, count, octave);
+        } else {
+            addOctave(out, x, 0, count, octave);
+        }
+
+        frequency *= m_lacunarity;
+        amplitude *= m_gain;
+    }
+}
+
+void Noise::fill(GridView<float> out, const sf::Vector2i &origin, sf::Uint32 threads) const
+{
+    if (out.empty()) {
+        return;
+    }
+
+    parallelFor(
+        0,
+        out.getSize().y,
+        [&](sf::Uint32 first, sf::Uint32 last) {
+            for (sf::Uint32 y = first; y < last; y++) {
+                getRow(out.row(y).data(), origin.x, origin.y + static_cast<sf::Int32>(y), out.getSize().x);
+            }
+        },
+        threads);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "GridView.hpp"
+
+// Noise is fractal gradient noise: a sum of octaves of 2D Perlin noise, each at
+// twice the frequency and half the amplitude of the one before, for heightmaps,
+// moisture maps and anything else that should vary smoothly over a world.
+//
+// Samples are taken at whole tile coordinates, and every sample is a pure
+// function of the seed and its position. The lattice is hashed from integer
+// coordinates rather than looked up in a permutation table, so the world has no
+// repeat, and a chunk evaluated on its own is identical to the same chunk cut out
+// of a whole map, whichever thread or order it was evaluated in.
+//
+// Noise is evaluated a row at a time. On CPUs with AVX2 the row is done 8 samples
+// at a time, hashing the four corners of each cell with integer vector multiplies
+// and picking gradients with a permute. The vector and scalar paths do the same
+// float operations in the same order, and Noise.cpp is built without contraction
+// into fused multiply-adds, so both give bit-identical results and the scalar
+// path doubles as the reference.
+class Noise
+{
+    private:
+        sf::Uint32 m_seed;       // seed every octave is hashed with
+        float      m_frequency;  // lattice cells per tile of the first octave
+        sf::Uint32 m_octaves;    // number of octaves summed
+        float      m_lacunarity; // frequency of an octave over the one before
+        float      m_gain;       // amplitude of an octave over the one before
+        bool       m_vectorised; // true to use AVX2 where the CPU has it
+
+    public:
+        // noise with features about 64 tiles across, over 5 octaves
+        Noise(sf::Uint32 seed = 0, float frequency = 1.f / 64, sf::Uint32 octaves = 5);
+        ~Noise() = default;
+
+        void setSeed(sf::Uint32 seed)
+        {
+            m_seed = seed;
+        }
+
+        sf::Uint32 getSeed() const
+        {
+            return m_seed;
+        }
+
+        // set the frequency of the first octave in lattice cells per tile, which is
+        // one over the size of the largest features in tiles
+        void setFrequency(float frequency)
+        {
+            m_frequency = frequency;
+        }
+
+        float getFrequency() const
+        {
+            return m_frequency;
+        }
+
+        // set the number of octaves, from 1 up. Each one adds finer detail.
+        void setOctaves(sf::Uint32 octaves)
+        {
+            m_octaves = octaves;
+        }
+
+        sf::Uint32 getOctaves() const
+        {
+            return m_octaves;
+        }
+
+        // set how the frequency and amplitude change from one octave to the next,
+        // 2 and 0.5 by default
+        void setFractal(float lacunarity, float gain)
+        {
+            m_lacunarity = lacunarity;
+            m_gain       = gain;
+        }
+
+        // set whether rows are evaluated with AVX2 when the CPU supports it. The
+        // results are the same either way.
+        void setVectorised(bool vectorised)
+        {
+            m_vectorised = vectorised;
+        }
+
+        // check if rows are evaluated with AVX2
+        bool isVectorised() const;
+
+        // get the noise at a tile, roughly from -1 to 1
+        float get(sf::Int32 x, sf::Int32 y) const;
+
+        // get count samples of row y, starting at column x
+        void getRow(float *out, sf::Int32 x, sf::Int32 y, sf::Uint32 count) const;
+
+        // fill a grid with the noise of the tiles from origin onwards, splitting the
+        // rows between threads workers, or every hardware thread if 0
+        void fill(GridView<float> out, const sf::Vector2i &origin, sf::Uint32 threads = 0) const;
+};
@@ -0,0 +1,467 @@
+#include "PagedStore.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+const sf::Uint32 storeVersion = 1;
+
+// world files start with this header, padded to a whole OS page, followed by the
+// pages of the chunks in row order
+struct StoreHeader
+{
+    char       magic[4] = {'Q', 'P', 'G', 'S'};
+    sf::Uint32 version  = storeVersion;
+    sf::Uint32 width;
+    sf::Uint32 height;
+    sf::Uint32 elementSize;
+    sf::Uint32 chunk;
+    sf::Uint64 headerBytes;
+    sf::Uint64 pageBytes;
+};
+
+size_t roundUp(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+} // namespace
+
+PagedStore::PagedStore()
+{
+    m_file          = -1;
+    m_map           = nullptr;
+    m_mapBytes      = 0;
+    m_headerBytes   = 0;
+    m_pageBytes     = 0;
+    m_size          = sf::Vector2u(0, 0);
+    m_elementSize   = 0;
+    m_chunks        = sf::Vector2u(0, 0);
+    m_hand          = 0;
+    m_maxSlots      = 0;
+    m_residentLimit = 256 * 1024 * 1024;
+    m_busy          = false;
+    m_stopping      = false;
+}
+
+PagedStore::~PagedStore()
+{
+    close();
+}
+
+bool PagedStore::open(const std::string &path, const sf::Vector2u &size, sf::Uint32 elementSize)
+{
+    close();
+
+    if (size.x == 0 || size.y == 0 || elementSize == 0) {
+        spdlog::error("PagedStore::open: {} needs a size and an element size", path);
+        return false;
+    }
+
+    // pages are whole OS pages, so each can be dropped and written on its own
+    size_t       osPage = sysconf(_SC_PAGESIZE);
+    sf::Vector2u chunks((size.x + CHUNK - 1) / CHUNK, (size.y + CHUNK - 1) / CHUNK);
+
+    StoreHeader header;
+    header.width       = size.x;
+    header.height      = size.y;
+    header.elementSize = elementSize;
+    header.chunk       = CHUNK;
+    header.headerBytes = roundUp(sizeof(StoreHeader), osPage);
+    header.pageBytes   = roundUp(static_cast<size_t>(CHUNK) * CHUNK * elementSize, osPage);
+
+    int file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (file < 0) {
+        spdlog::error("PagedStore::open: cannot open {}: {}", path, std::strerror(errno));
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        spdlog::error("PagedStore::open: cannot read the size of {}: {}", path, std::strerror(errno));
+        ::close(file);
+        return false;
+    }
+
+    if (info.st_size == 0) {
+        // a new world: every chunk is a hole in the file until it is written
+        size_t fileBytes = header.headerBytes + static_cast<size_t>(chunks.x) * chunks.y * header.pageBytes;
+
+        if (pwrite(file, &header, sizeof(header), 0) != sizeof(header) || ftruncate(file, fileBytes) != 0) {
+            spdlog::error("PagedStore::open: cannot create {}: {}", path, std::strerror(errno));
+            ::close(file);
+            return false;
+        }
+    } else {
+        // a world made on a machine with larger OS pages can still be opened, so
+        // the layout is taken from the file
+        StoreHeader saved;
+        if (pread(file, &saved, sizeof(saved), 0) != sizeof(saved) ||
+            std::memcmp(saved.magic, header.magic, sizeof(saved.magic)) != 0 || saved.version != storeVersion)
+        {
+            spdlog::error("PagedStore::open: {} is not a world file", path);
+            ::close(file);
+            return false;
+        }
+
+        if (saved.width != size.x || saved.height != size.y || saved.elementSize != elementSize ||
+            saved.chunk != CHUNK || saved.headerBytes % osPage != 0 || saved.pageBytes % osPage != 0 ||
+            saved.pageBytes < static_cast<size_t>(CHUNK) * CHUNK * elementSize)
+        {
+            spdlog::error("PagedStore::open: {} holds a {}x{} world of {} byte elements, not {}x{} of {}",
+                          path,
+                          saved.width,
+                          saved.height,
+                          saved.elementSize,
+                          size.x,
+                          size.y,
+                          elementSize);
+            ::close(file);
+            return false;
+        }
+
+        header = saved;
+
+        size_t fileBytes = header.headerBytes + static_cast<size_t>(chunks.x) * chunks.y * header.pageBytes;
+        if (static_cast<size_t>(info.st_size) != fileBytes) {
+            spdlog::error("PagedStore::open: {} is {} bytes but should be {}", path, info.st_size, fileBytes);
+            ::close(file);
+            return false;
+        }
+    }
+
+    size_t mapBytes = header.headerBytes + static_cast<size_t>(chunks.x) * chunks.y * header.pageBytes;
+    void  *map      = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (map == MAP_FAILED) {
+        spdlog::error("PagedStore::open: cannot map {}: {}", path, std::strerror(errno));
+        ::close(file);
+        return false;
+    }
+
+    // chunks are used in no particular order, so reading ahead of each fault only
+    // fills memory with pages that are not wanted
+    madvise(map, mapBytes, MADV_RANDOM);
+
+    m_path        = path;
+    m_file        = file;
+    m_map         = static_cast<sf::Uint8 *>(map);
+    m_mapBytes    = mapBytes;
+    m_headerBytes = header.headerBytes;
+    m_pageBytes   = header.pageBytes;
+    m_size        = size;
+    m_elementSize = elementSize;
+    m_chunks      = chunks;
+    m_hand        = 0;
+    m_slots.clear();
+    m_resident.clear();
+
+    setResidentLimit(m_residentLimit);
+
+    m_busy     = false;
+    m_stopping = false;
+    m_thread   = std::thread(&PagedStore::run, this);
+
+    spdlog::info("PagedStore::open: opened {}, {}x{} elements in {}x{} chunks, {} MB",
+                 path,
+                 size.x,
+                 size.y,
+                 chunks.x,
+                 chunks.y,
+                 mapBytes >> 20);
+
+    return true;
+}
+
+void PagedStore::close()
+{
+    if (m_file < 0) {
+        return;
+    }
+
+    flush();
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_one();
+    m_thread.join();
+
+    munmap(m_map, m_mapBytes);
+    ::close(m_file);
+
+    spdlog::debug("PagedStore::close: closed {}", m_path);
+
+    m_file     = -1;
+    m_map      = nullptr;
+    m_mapBytes = 0;
+    m_slots.clear();
+    m_resident.clear();
+}
+
+void PagedStore::setResidentLimit(size_t bytes)
+{
+    m_residentLimit = bytes;
+
+    if (m_file < 0) {
+        return;
+    }
+
+    m_maxSlots = std::max<size_t>(1, bytes / m_pageBytes);
+
+    // drop the pages over the new limit
+    while (m_slots.size() > m_maxSlots) {
+        evict(m_slots.size() - 1);
+        m_slots.pop_back();
+    }
+
+    if (m_hand >= m_slots.size()) {
+        m_hand = 0;
+    }
+}
+
+sf::Vector2u PagedStore::getChunkSize(const sf::Vector2u &chunk) const
+{
+    if (chunk.x >= m_chunks.x || chunk.y >= m_chunks.y) {
+        return sf::Vector2u(0, 0);
+    }
+
+    return sf::Vector2u(std::min(CHUNK, m_size.x - chunk.x * CHUNK), std::min(CHUNK, m_size.y - chunk.y * CHUNK));
+}
+
+sf::Uint8 *PagedStore::getChunkData(const sf::Vector2u &chunk, size_t elementSize, bool write)
+{
+    if (m_file < 0) {
+        spdlog::error("PagedStore::getChunkData: the store is not open");
+        return nullptr;
+    }
+
+    if (elementSize != m_elementSize) {
+        spdlog::error("PagedStore::getChunkData: elements are {} bytes, not {}", m_elementSize, elementSize);
+        return nullptr;
+    }
+
+    if (chunk.x >= m_chunks.x || chunk.y >= m_chunks.y) {
+        spdlog::error("PagedStore::getChunkData: chunk ({}, {}) is outside the world", chunk.x, chunk.y);
+        return nullptr;
+    }
+
+    sf::Uint64 page = static_cast<sf::Uint64>(chunk.y) * m_chunks.x + chunk.x;
+    touch(page, write);
+
+    return getPage(page);
+}
+
+void PagedStore::touch(sf::Uint64 page, bool write)
+{
+    auto found = m_resident.find(page);
+    if (found != m_resident.end()) {
+        auto &slot      = m_slots[found->second];
+        slot.referenced = true;
+        slot.dirty     |= write;
+        return;
+    }
+
+    sf::Uint32 index;
+
+    if (m_slots.size() < m_maxSlots) {
+        index = m_slots.size();
+        m_slots.push_back(Slot());
+    } else {
+        // second chance: pages touched since the hand last passed are kept, and
+        // passed over again next time unless they are touched again
+        while (m_slots[m_hand].referenced) {
+            m_slots[m_hand].referenced = false;
+            m_hand                     = (m_hand + 1) % m_slots.size();
+        }
+
+        index  = m_hand;
+        m_hand = (m_hand + 1) % m_slots.size();
+        evict(index);
+    }
+
+    m_slots[index]   = Slot{page, true, write};
+    m_resident[page] = index;
+}
+
+void PagedStore::evict(sf::Uint32 slot)
+{
+    const auto &evicted = m_slots[slot];
+
+    if (evicted.dirty) {
+        queue(std::span<const sf::Uint64>(&evicted.page, 1));
+    }
+
+    // for a shared mapping this only unmaps the page; changes to it stay in the
+    // page cache for the flusher or the kernel to write
+    madvise(getPage(evicted.page), m_pageBytes, MADV_DONTNEED);
+    m_resident.erase(evicted.page);
+}
+
+void PagedStore::prefetch(const sf::IntRect &view, const sf::Vector2i &ahead)
+{
+    if (m_file < 0) {
+        return;
+    }
+
+    auto advise = [&](const sf::IntRect &rect) {
+        int left   = std::clamp(rect.left, 0, static_cast<int>(m_size.x));
+        int top    = std::clamp(rect.top, 0, static_cast<int>(m_size.y));
+        int right  = std::clamp(rect.left + rect.width, 0, static_cast<int>(m_size.x));
+        int bottom = std::clamp(rect.top + rect.height, 0, static_cast<int>(m_size.y));
+
+        if (right <= left || bottom <= top) {
+            return;
+        }
+
+        for (sf::Uint32 y = top / CHUNK; y <= (bottom - 1) / CHUNK; y++) {
+            for (sf::Uint32 x = left / CHUNK; x <= (right - 1) / CHUNK; x++) {
+                sf::Uint64 page = static_cast<sf::Uint64>(y) * m_chunks.x + x;
+                if (!m_resident.contains(page)) {
+                    madvise(getPage(page), m_pageBytes, MADV_WILLNEED);
+                }
+            }
+        }
+    };
+
+    advise(view);
+
+    if (ahead != sf::Vector2i(0, 0)) {
+        advise(sf::IntRect(view.left + ahead.x, view.top + ahead.y, view.width, view.height));
+    }
+}
+
+void PagedStore::copy(const sf::Vector2u &offset,
+                      const sf::Vector2u &size,
+                      sf::Uint8          *data,
+                      size_t              stride,
+                      size_t              elementSize,
+                      bool                write)
+{
+    if (static_cast<sf::Uint64>(offset.x) + size.x > m_size.x ||
+        static_cast<sf::Uint64>(offset.y) + size.y > m_size.y)
+    {
+        spdlog::error("PagedStore::copy: {}x{} at ({}, {}) is outside the world", size.x, size.y, offset.x, offset.y);
+        return;
+    }
+
+    if (size.x == 0 || size.y == 0) {
+        return;
+    }
+
+    sf::Uint32 right  = offset.x + size.x;
+    sf::Uint32 bottom = offset.y + size.y;
+
+    for (sf::Uint32 cy = offset.y / CHUNK; cy <= (bottom - 1) / CHUNK; cy++) {
+        for (sf::Uint32 cx = offset.x / CHUNK; cx <= (right - 1) / CHUNK; cx++) {
+            auto *chunk = getChunkData(sf::Vector2u(cx, cy), elementSize, write);
+            if (chunk == nullptr) {
+                return;
+            }
+
+            // the part of the rectangle inside this chunk
+            sf::Uint32 x0    = std::max(offset.x, cx * CHUNK);
+            sf::Uint32 x1    = std::min(right, (cx + 1) * CHUNK);
+            sf::Uint32 y0    = std::max(offset.y, cy * CHUNK);
+            sf::Uint32 y1    = std::min(bottom, (cy + 1) * CHUNK);
+            size_t     bytes = (x1 - x0) * elementSize;
+
+            for (sf::Uint32 y = y0; y < y1; y++) {
+                auto *world = chunk + ((y - cy * CHUNK) * CHUNK + (x0 - cx * CHUNK)) * elementSize;
+                auto *cells = data + (y - offset.y) * stride + (x0 - offset.x) * elementSize;
+
+                if (write) {
+                    std::memcpy(world, cells, bytes);
+                } else {
+                    std::memcpy(cells, world, bytes);
+                }
+            }
+        }
+    }
+}
+
+void PagedStore::flush()
+{
+    if (m_file < 0) {
+        return;
+    }
+
+    std::vector<sf::Uint64> pages;
+    for (auto &slot : m_slots) {
+        if (slot.dirty) {
+            pages.push_back(slot.page);
+            slot.dirty = false;
+        }
+    }
+
+    if (!pages.empty()) {
+        queue(pages);
+    }
+}
+
+void PagedStore::sync()
+{
+    if (m_file < 0) {
+        return;
+    }
+
+    flush();
+
+    std::unique_lock lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+void PagedStore::queue(std::span<const sf::Uint64> pages)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_queue.insert(m_queue.end(), pages.begin(), pages.end());
+    }
+
+    m_wake.notify_one();
+}
+
+void PagedStore::run()
+{
+    std::vector<sf::Uint64> pages;
+
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_busy = false;
+            m_idle.notify_all();
+
+            m_wake.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+
+            std::swap(pages, m_queue);
+            m_busy = true;
+        }
+
+        // in file order, which lets the disk write runs of neighbouring chunks
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+        for (auto page : pages) {
+            if (msync(getPage(page), m_pageBytes, MS_SYNC) != 0) {
+                spdlog::error("PagedStore::run: cannot write page {} of {}: {}", page, m_path, std::strerror(errno));
+            }
+        }
+
+        spdlog::debug("PagedStore::run: wrote {} pages", pages.size());
+        pages.clear();
+    }
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "GridView.hpp"
+
+// PagedStore keeps a world too large for memory, such as the cells of an edited
+// maze or the tiles of one tilemap layer hundreds of gigabytes across, in a file,
+// and brings in only the parts being looked at. A Maze holds the part of the
+// world around the player as usual, copied in from the store with loadWindow and
+// copied back after editing with saveWindow. A tilemap layer can be filled the
+// same way, reading a rectangle with read and handing it to Tilemap::setTiles.
+// quantum-gen --world builds a world out of generated mazes and pans across it.
+//
+// The world is split into square chunks of CHUNK x CHUNK elements, each stored
+// row by row as one page of the file, chunks in row order after a header. The
+// file is created sparse, so chunks never written take no disk space and read
+// back as zeroes. The whole file is mapped at once, which needs only address
+// space; memory is used only by the pages touched.
+//
+// The pages touched are tracked in a fixed number of slots. When every slot is
+// taken, a clock sweep picks one not touched since the sweep last passed it, and
+// its page is dropped from memory, which keeps the store's resident memory below
+// its limit however much of the world is visited. Dropping a page never loses
+// edits: they stay in the page cache until the kernel writes them back.
+//
+// Pages written through getChunk are marked dirty, and flush hands them to a
+// background thread that writes them to disk, so saving never blocks the frame.
+// A page dropped while dirty is handed over the same way.
+//
+// prefetch asks the kernel to start reading the chunks the camera is heading
+// towards, so they are in the page cache by the time they are drawn.
+//
+// The store is not thread safe, apart from its own flushing thread.
+class PagedStore
+{
+    public:
+        static constexpr sf::Uint32 CHUNK = 64; // width and height of a chunk in elements
+
+    private:
+        // a page held in memory
+        struct Slot
+        {
+            sf::Uint64 page;       // index of the page
+            bool       referenced; // touched since the clock hand last passed
+            bool       dirty;      // written since it was last handed to the flusher
+        };
+
+        // used by the main thread
+        std::string                                m_path;          // path of the world file
+        int                                        m_file;          // file descriptor, or -1 when closed
+        sf::Uint8                                 *m_map;           // start of the mapped file
+        size_t                                     m_mapBytes;      // size of the mapped file
+        size_t                                     m_headerBytes;   // bytes before the first page
+        size_t                                     m_pageBytes;     // bytes of one page, a multiple of the OS page
+        sf::Vector2u                               m_size;          // size of the world in elements
+        sf::Uint32                                 m_elementSize;   // bytes of one element
+        sf::Vector2u                               m_chunks;        // size of the world in chunks
+        std::vector<Slot>                          m_slots;         // pages held in memory
+        std::unordered_map<sf::Uint64, sf::Uint32> m_resident;      // slot of each page held in memory
+        sf::Uint32                                 m_hand;          // next slot the clock sweep looks at
+        sf::Uint32                                 m_maxSlots;      // most pages held in memory at once
+        size_t                                     m_residentLimit; // most bytes of pages held in memory
+
+        // shared between the threads
+        std::thread             m_thread;   // flushing thread
+        std::mutex              m_mutex;    // guards the queue and stopping flag
+        std::condition_variable m_wake;     // wakes the flusher when there is work
+        std::condition_variable m_idle;     // tells waiters the queue is empty
+        std::vector<sf::Uint64> m_queue;    // pages waiting to be written
+        bool                    m_busy;     // true while the flusher writes pages it took
+        bool                    m_stopping; // true when the flusher should finish up and stop
+
+        // get the first byte of a page in the mapping
+        sf::Uint8 *getPage(sf::Uint64 page) const
+        {
+            return m_map + m_headerBytes + page * m_pageBytes;
+        }
+
+        // note that a page is in use, dropping another from memory if need be
+        void touch(sf::Uint64 page, bool write);
+
+        // drop the page of a slot from memory, handing it to the flusher if dirty
+        void evict(sf::Uint32 slot);
+
+        // hand pages to the flusher
+        void queue(std::span<const sf::Uint64> pages);
+
+        // write queued pages until told to stop
+        void run();
+
+        // get a chunk's elements, marking it dirty if it is to be written, or null if
+        // the store is closed, the chunk is outside the world or the element is the
+        // wrong size
+        sf::Uint8 *getChunkData(const sf::Vector2u &chunk, size_t elementSize, bool write);
+
+        // copy a rectangle of the world to or from rows of elements, stride bytes apart
+        void copy(const sf::Vector2u &offset,
+                  const sf::Vector2u &size,
+                  sf::Uint8          *data,
+                  size_t              stride,
+                  size_t              elementSize,
+                  bool                write);
+
+    public:
+        PagedStore();
+        ~PagedStore();
+
+        PagedStore(const PagedStore &)            = delete;
+        PagedStore &operator=(const PagedStore &) = delete;
+
+        // open the world file at path, creating it if there is none. An existing
+        // file must hold a world of the same size and element size. Returns false
+        // if the file cannot be opened or mapped, or does not match.
+        bool open(const std::string &path, const sf::Vector2u &size, sf::Uint32 elementSize);
+
+        // write every dirty page to disk and close the file
+        void close();
+
+        bool isOpen() const
+        {
+            return m_file >= 0;
+        }
+
+        // set the most memory the pages held at once may take, which is always
+        // enough for at least one page
+        void setResidentLimit(size_t bytes);
+
+        size_t getResidentLimit() const
+        {
+            return m_residentLimit;
+        }
+
+        // get the number of pages held in memory
+        size_t getResidentPages() const
+        {
+            return m_resident.size();
+        }
+
+        // get the size of the world in elements
+        sf::Vector2u getSize() const
+        {
+            return m_size;
+        }
+
+        // get the size of the world in chunks
+        sf::Vector2u getChunks() const
+        {
+            return m_chunks;
+        }
+
+        // get a chunk to read. Chunks at the right and bottom edges of the world are
+        // cut to fit it. The view stays valid until the store is closed, though its
+        // page may be dropped from memory, and read back in when next used, once
+        // enough other chunks have been asked for.
+        template <typename T>
+        GridView<const T> readChunk(const sf::Vector2u &chunk)
+        {
+            auto *data = getChunkData(chunk, sizeof(T), false);
+            if (data == nullptr) {
+                return GridView<const T>();
+            }
+
+            return GridView<const T>(reinterpret_cast<const T *>(data), getChunkSize(chunk), CHUNK);
+        }
+
+        // get a chunk to write, marking it dirty. Write through the view before asking
+        // for many other chunks: writes made after its page was dropped still reach
+        // the file, but are left for the kernel to write back rather than flushed.
+        template <typename T>
+        GridView<T> getChunk(const sf::Vector2u &chunk)
+        {
+            auto *data = getChunkData(chunk, sizeof(T), true);
+            if (data == nullptr) {
+                return GridView<T>();
+            }
+
+            return GridView<T>(reinterpret_cast<T *>(data), getChunkSize(chunk), CHUNK);
+        }
+
+        // get the size of a chunk, which is smaller than CHUNK at the edges
+        sf::Vector2u getChunkSize(const sf::Vector2u &chunk) const;
+
+        // copy a rectangle of the world, starting at offset, into cells. The
+        // rectangle must be inside the world.
+        template <typename T>
+        void read(const sf::Vector2u &offset, GridView<T> cells)
+        {
+            copy(offset,
+                 cells.getSize(),
+                 reinterpret_cast<sf::Uint8 *>(cells.data()),
+                 cells.getStride() * sizeof(T),
+                 sizeof(T),
+                 false);
+        }
+
+        // copy cells into the world, starting at offset
+        template <typename T>
+        void write(const sf::Vector2u &offset, GridView<const T> cells)
+        {
+            copy(offset,
+                 cells.getSize(),
+                 reinterpret_cast<sf::Uint8 *>(const_cast<T *>(cells.data())),
+                 cells.getStride() * sizeof(T),
+                 sizeof(T),
+                 true);
+        }
+
+        // start reading the chunks under view, a rectangle of elements, and those
+        // under the view moved by ahead, which is where the camera will be soon,
+        // such as its velocity times the time it takes to read a chunk. The chunks
+        // are read in the background and do not count towards the resident limit
+        // until they are used.
+        void prefetch(const sf::IntRect &view, const sf::Vector2i &ahead);
+
+        // hand every dirty page to the background thread to be written to disk
+        void flush();
+
+        // flush, and wait until every page handed over so far is on disk
+        void sync();
+};
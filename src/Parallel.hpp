@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <SFML/Config.hpp>
+
+// getThreadCount returns the number of worker threads to use for parallel work,
+// which is the number of hardware threads, or 1 if that cannot be determined.
+inline sf::Uint32 getThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// parallelFor splits the range [begin, end) into contiguous bands, one per
+// thread, and calls fn(bandBegin, bandEnd) for each band. The calling thread
+// works on the last band itself, and the call returns once every band is done.
+// Bands never overlap, so fn may write to anything indexed by its band without
+// locking.
+template <typename Fn>
+void parallelFor(sf::Uint32 begin, sf::Uint32 end, Fn fn, sf::Uint32 threads = 0)
+{
+    if (end <= begin) {
+        return;
+    }
+
+    if (threads == 0) {
+        threads = getThreadCount();
+    }
+
+    sf::Uint32 count = std::min(threads, end - begin);
+    sf::Uint32 band  = (end - begin + count - 1) / count;
+
+    std::vector<std::thread> workers;
+    workers.reserve(count - 1);
+
+    for (sf::Uint32 first = begin; first < end; first += band) {
+        sf::Uint32 last = std::min(first + band, end);
+
+        if (last == end) {
+            fn(first, last);
+        } else {
+            workers.emplace_back(fn, first, last);
+        }
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+// parallelForEach calls fn(i) for every i in [begin, end), handing out indices
+// one at a time to whichever thread is free next. Unlike parallelFor it balances
+// work whose cost varies a lot from one index to the next, at the price of an
+// atomic increment per index, so it suits coarse jobs rather than cells.
+template <typename Fn>
+void parallelForEach(sf::Uint32 begin, sf::Uint32 end, Fn fn, sf::Uint32 threads = 0)
+{
+    if (end <= begin) {
+        return;
+    }
+
+    if (threads == 0) {
+        threads = getThreadCount();
+    }
+
+    std::atomic<sf::Uint32> next(begin);
+
+    auto worker = [&]() {
+        for (sf::Uint32 i = next++; i < end; i = next++) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(std::min(threads, end - begin) - 1);
+
+    for (sf::Uint32 i = 1; i < std::min(threads, end - begin); i++) {
+        workers.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto &thread : workers) {
+        thread.join();
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+
+// appendQuad appends a textured rectangle to a vertex array as two triangles.
+// Everything that batches sprites into an sf::Triangles vertex array goes
+// through here, so the winding and vertex order stay the same everywhere.
+inline void appendQuad(sf::VertexArray    &vertices,
+                       const sf::Vector2f &position,
+                       const sf::Vector2f &size,
+                       const sf::Vector2f &texCoords,
+                       const sf::Vector2f &texSize,
+                       const sf::Color    &color = sf::Color::White)
+{
+    sf::Vertex topLeft(position, color, texCoords);
+    sf::Vertex topRight(sf::Vector2f(position.x + size.x, position.y),
+                        color,
+                        sf::Vector2f(texCoords.x + texSize.x, texCoords.y));
+    sf::Vertex bottomLeft(sf::Vector2f(position.x, position.y + size.y),
+                          color,
+                          sf::Vector2f(texCoords.x, texCoords.y + texSize.y));
+    sf::Vertex bottomRight(position + size, color, texCoords + texSize);
+
+    vertices.append(topLeft);
+    vertices.append(topRight);
+    vertices.append(bottomLeft);
+    vertices.append(bottomLeft);
+    vertices.append(topRight);
+    vertices.append(bottomRight);
+}
@@ -0,0 +1,165 @@
+#include "RTree.hpp"
+
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+
+sf::IntRect getUnion(const sf::IntRect &a, const sf::IntRect &b)
+{
+    int left   = std::min(a.left, b.left);
+    int top    = std::min(a.top, b.top);
+    int right  = std::max(a.left + a.width, b.left + b.width);
+    int bottom = std::max(a.top + a.height, b.top + b.height);
+
+    return sf::IntRect(left, top, right - left, bottom - top);
+}
+
+// squared distance from a point to the nearest cell of a rectangle
+sf::Int64 getDistance(const sf::Vector2i &point, const sf::IntRect &rect)
+{
+    sf::Int64 dx = std::max({rect.left - point.x, 0, point.x - (rect.left + rect.width - 1)});
+    sf::Int64 dy = std::max({rect.top - point.y, 0, point.y - (rect.top + rect.height - 1)});
+
+    return dx * dx + dy * dy;
+}
+
+} // namespace
+
+RTree::RTree()
+{
+    m_leaves = 0;
+}
+
+void RTree::sortTiles(std::span<const sf::IntRect> boxes)
+{
+    // centres are compared doubled, which keeps them whole numbers
+    auto centreX = [&](sf::Uint32 i) { return boxes[i].left * 2 + boxes[i].width; };
+    auto centreY = [&](sf::Uint32 i) { return boxes[i].top * 2 + boxes[i].height; };
+
+    m_order.resize(boxes.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+
+    // about sqrt(runs) slices, each a whole number of runs
+    size_t runs  = (boxes.size() + FANOUT - 1) / FANOUT;
+    size_t slice = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(runs)))) * FANOUT;
+
+    std::sort(m_order.begin(), m_order.end(), [&](sf::Uint32 a, sf::Uint32 b) { return centreX(a) < centreX(b); });
+
+    for (size_t first = 0; first < m_order.size(); first += slice) {
+        auto last = m_order.begin() + std::min(first + slice, m_order.size());
+        std::sort(m_order.begin() + first, last, [&](sf::Uint32 a, sf::Uint32 b) { return centreY(a) < centreY(b); });
+    }
+}
+
+void RTree::build(std::span<const sf::IntRect> rects)
+{
+    m_nodes.clear();
+    m_rects.clear();
+    m_ids.clear();
+    m_leaves = 0;
+
+    if (rects.empty()) {
+        return;
+    }
+
+    // the rectangles, tiled into leaves
+    sortTiles(rects);
+
+    for (auto i : m_order) {
+        m_rects.push_back(rects[i]);
+        m_ids.push_back(i);
+    }
+
+    m_level.clear();
+    for (sf::Uint32 first = 0; first < m_rects.size(); first += FANOUT) {
+        sf::Uint32 count = std::min<sf::Uint32>(FANOUT, m_rects.size() - first);
+        Node       node  = {m_rects[first], first, count};
+        for (sf::Uint32 i = first + 1; i < first + count; i++) {
+            node.bounds = getUnion(node.bounds, m_rects[i]);
+        }
+        m_level.push_back(node);
+    }
+
+    m_leaves = m_level.size();
+
+    // each level is tiled in turn, stored, and grouped into the level above
+    while (m_level.size() > 1) {
+        m_boxes.clear();
+        for (const auto &node : m_level) {
+            m_boxes.push_back(node.bounds);
+        }
+
+        sortTiles(m_boxes);
+
+        sf::Uint32 start = m_nodes.size();
+        for (auto i : m_order) {
+            m_nodes.push_back(m_level[i]);
+        }
+
+        m_level.clear();
+        for (sf::Uint32 first = start; first < m_nodes.size(); first += FANOUT) {
+            sf::Uint32 count = std::min<sf::Uint32>(FANOUT, m_nodes.size() - first);
+            Node       node  = {m_nodes[first].bounds, first, count};
+            for (sf::Uint32 i = first + 1; i < first + count; i++) {
+                node.bounds = getUnion(node.bounds, m_nodes[i].bounds);
+            }
+            m_level.push_back(node);
+        }
+    }
+
+    m_nodes.push_back(m_level[0]);
+}
+
+void RTree::getNearest(const sf::Vector2i                    &point,
+                       sf::Uint32                             count,
+                       std::vector<sf::Uint32>               &nearest,
+                       const std::function<bool(sf::Uint32)> &accept) const
+{
+    nearest.clear();
+
+    if (m_nodes.empty() || count == 0) {
+        return;
+    }
+
+    // best first: nodes and rectangles are taken in order of distance, so when a
+    // rectangle comes off the queue nothing left can be closer than it
+    struct Entry
+    {
+        sf::Int64  distance; // squared distance to the point
+        sf::Uint32 index;    // node, or rectangle if item is set
+        bool       item;     // true for a rectangle
+
+        bool operator<(const Entry &other) const
+        {
+            return distance > other.distance;
+        }
+    };
+
+    std::vector<Entry> queue;
+    sf::Uint32         root = m_nodes.size() - 1;
+    queue.push_back(Entry{getDistance(point, m_nodes[root].bounds), root, false});
+
+    while (!queue.empty() && nearest.size() < count) {
+        std::pop_heap(queue.begin(), queue.end());
+        Entry entry = queue.back();
+        queue.pop_back();
+
+        if (entry.item) {
+            if (!accept || accept(m_ids[entry.index])) {
+                nearest.push_back(m_ids[entry.index]);
+            }
+            continue;
+        }
+
+        const Node &node = m_nodes[entry.index];
+        bool        leaf = entry.index < m_leaves;
+
+        for (sf::Uint32 i = node.first; i < node.first + node.count; i++) {
+            const auto &bounds = leaf ? m_rects[i] : m_nodes[i].bounds;
+            queue.push_back(Entry{getDistance(point, bounds), i, leaf});
+            std::push_heap(queue.begin(), queue.end());
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+
+// RTree is a static spatial index of rectangles, such as the bounds of the rooms
+// in a Maze, answering which rectangles contain a point, overlap a rectangle, or
+// are nearest a point, in time logarithmic in the number of rectangles.
+//
+// It is bulk loaded with Sort-Tile-Recursive: the rectangles are sorted into
+// vertical slices by the x of their centres, each slice is sorted by y, and runs
+// of them become the leaves, and the same is done with the leaves to make each
+// level above until one node is left. That packs every node full and keeps
+// siblings close together, which a tree built by inserting one at a time does
+// not. Nodes are stored in one array, leaves first and the root last, and each
+// node's children are next to each other in it.
+//
+// Rectangles are identified by their index in the span the tree was built from.
+// The tree does not change after it is built; build it again when they change.
+// Building keeps its buffers, so rebuilding a tree of a similar size does not
+// allocate.
+class RTree
+{
+    private:
+        static constexpr sf::Uint32 FANOUT = 16; // most children of a node
+        static constexpr sf::Uint32 DEPTH  = 8;  // most levels, enough for FANOUT^8 rectangles
+
+        struct Node
+        {
+            sf::IntRect bounds; // bounds of everything below the node
+            sf::Uint32  first;  // first child node, or first item for a leaf
+            sf::Uint32  count;  // number of children or items
+        };
+
+        std::vector<Node>        m_nodes;  // leaves first, then each level above, the root last
+        std::vector<sf::IntRect> m_rects;  // rectangles in the order of the leaves
+        std::vector<sf::Uint32>  m_ids;    // index each rectangle was built with
+        sf::Uint32               m_leaves; // nodes before this index are leaves
+        std::vector<sf::Uint32>  m_order;  // tile order of the level being built
+        std::vector<Node>        m_level;  // nodes of the level being built
+        std::vector<sf::IntRect> m_boxes;  // bounds of the nodes of the level being built
+
+        // set m_order to the order that tiles boxes into runs of FANOUT that are
+        // close together
+        void sortTiles(std::span<const sf::IntRect> boxes);
+
+        static bool overlaps(const sf::IntRect &a, const sf::IntRect &b)
+        {
+            return a.left < b.left + b.width && b.left < a.left + a.width && a.top < b.top + b.height &&
+                   b.top < a.top + a.height;
+        }
+
+    public:
+        RTree();
+        ~RTree() = default;
+
+        // build the tree from a set of rectangles, replacing what it held before
+        void build(std::span<const sf::IntRect> rects);
+
+        // get the number of rectangles in the tree
+        size_t getSize() const
+        {
+            return m_rects.size();
+        }
+
+        // call fn(index) for every rectangle that overlaps rect
+        template <typename Fn>
+        void query(const sf::IntRect &rect, Fn fn) const
+        {
+            if (m_nodes.empty()) {
+                return;
+            }
+
+            // a node is only pushed while its parent is popped, so the stack never
+            // holds more than FANOUT nodes from each level
+            sf::Uint32 stack[FANOUT * DEPTH];
+            sf::Uint32 size = 0;
+
+            stack[size++] = m_nodes.size() - 1;
+
+            while (size > 0) {
+                sf::Uint32  index = stack[--size];
+                const Node &node  = m_nodes[index];
+                if (!overlaps(node.bounds, rect)) {
+                    continue;
+                }
+
+                if (index < m_leaves) {
+                    for (sf::Uint32 i = node.first; i < node.first + node.count; i++) {
+                        if (overlaps(m_rects[i], rect)) {
+                            fn(m_ids[i]);
+                        }
+                    }
+                } else {
+                    for (sf::Uint32 i = node.first; i < node.first + node.count; i++) {
+                        stack[size++] = i;
+                    }
+                }
+            }
+        }
+
+        // call fn(index) for every rectangle that contains point
+        template <typename Fn>
+        void query(const sf::Vector2i &point, Fn fn) const
+        {
+            query(sf::IntRect(point.x, point.y, 1, 1), fn);
+        }
+
+        // get up to count rectangles nearest to point, closest first, measuring to
+        // the nearest cell of each. Rectangles that accept returns false for are
+        // skipped, so "the nearest that ..." costs no more than it has to.
+        void getNearest(const sf::Vector2i                    &point,
+                        sf::Uint32                             count,
+                        std::vector<sf::Uint32>               &nearest,
+                        const std::function<bool(sf::Uint32)> &accept = nullptr) const;
+};
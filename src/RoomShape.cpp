@@ -9,29 +9,23 @@ RoomShape::RoomShape()
 
 RoomShape::RoomShape(const sf::Vector2u &size)
 {
-    spdlog::info("RoomShape::PrefabRoomShape(const sf::Vector2u &size)");
+    spdlog::debug("RoomShape::PrefabRoomShape(const sf::Vector2u &size)");
 
     // A room must be odd in size, so if the size is even then we add 1 to the
-    // width and height to make it odd. We also reserve the cells vector to
-    // avoid reallocations when adding cells to the room.
+    // width and height to make it odd.
 
     m_size.x = size.x % 2 == 0 ? size.x + 1 : size.x;
     m_size.y = size.y % 2 == 0 ? size.y + 1 : size.y;
-    m_cells.reserve(size.x * size.y);
 
     // by default, if you provide a size then a room will be created of that size.
     // The room will be a solid block of room cells, with no walls around the edge.
 
-    for (unsigned int y = 0; y < size.y; y++) {
-        for (unsigned int x = 0; x < size.x; x++) {
-            m_cells.push_back(Cell::ROOM);
-        }
-    }
+    m_cells.resize(m_size, Cell::ROOM);
 
-    spdlog::info("PrefabRoomShape::PrefabRoomShape: created room of size ({}, {})", m_size.x, m_size.y);
+    spdlog::debug("PrefabRoomShape::PrefabRoomShape: created room of size ({}, {})", m_size.x, m_size.y);
 }
 
-void RoomShape::loadPrefab(const std::string &prefab)
+bool RoomShape::loadPrefab(const std::string &prefab)
 {
     // a prefab is a text file that contains the cells that make up the room;
     // the file is a plain ascii file with each line being a row of the room
@@ -45,14 +39,14 @@ void RoomShape::loadPrefab(const std::string &prefab)
 
     if (!std::filesystem::exists(prefab)) {
         spdlog::error("PrefabRoom::loadPrefab: prefab file does not exist");
-        return;
+        return false;
     }
 
     // open the file for reading
     std::ifstream file(prefab);
     if (!file.is_open()) {
         spdlog::error("PrefabRoom::loadPrefab: failed to open prefab file");
-        return;
+        return false;
     }
 
     // read the file to get the dimensions of the room. We also check that the
@@ -73,14 +67,14 @@ void RoomShape::loadPrefab(const std::string &prefab)
             m_size.x = line.size();
         } else if (m_size.x != line.size()) {
             spdlog::error("PrefabRoom::loadPrefab: inconsistent line length in prefab file");
-            return;
+            return false;
         }
 
-        // all lines should contain only spaces and asterisks
+        // all lines should contain only periods and asterisks
         for (auto c : line) {
             if (c != '*' && c != '.') {
                 spdlog::error("PrefabRoom::loadPrefab: invalid character in prefab file");
-                return;
+                return false;
             }
         }
 
@@ -89,52 +83,62 @@ void RoomShape::loadPrefab(const std::string &prefab)
 
     if (m_size.x == 0 || m_size.y == 0) {
         spdlog::error("PrefabRoom::loadPrefab: empty prefab file");
-        return;
+        return false;
     }
 
     if (m_size.x % 2 == 0 || m_size.y % 2 == 0) {
         spdlog::error("PrefabRoom::loadPrefab: room dimensions are not odd");
-        return;
+        return false;
     }
 
     // read the file again to get the cells that make up the room
     file.clear();
     file.seekg(0, std::ios::beg);
 
-    m_cells.clear();
-    m_cells.reserve(m_size.x * m_size.y);
+    m_cells.resize(m_size, Cell::WALL);
 
-    for (unsigned int y = 0; y < m_size.y; y++) {
-        std::getline(file, line);
+    unsigned int y = 0;
+    while (y < m_size.y && std::getline(file, line)) {
+        // empty lines were skipped when the file was validated
+        if (line.empty()) {
+            continue;
+        }
 
         for (unsigned int x = 0; x < m_size.x; x++) {
-            if (line[x] == ' ') {
-                m_cells[y * m_size.x + x] = Cell::ROOM;
-            } else {
-                m_cells[y * m_size.x + x] = Cell::WALL;
+            if (line[x] == '.') {
+                m_cells(x, y) = Cell::ROOM;
             }
         }
+
+        y++;
     }
+
+    return true;
 }
 
 void RoomShape::setCell(const sf::Vector2u &offset, Cell cell)
 {
-    m_cells[offset.y * m_size.x + offset.x] = cell;
+    m_cells[offset] = cell;
 }
 
 Cell RoomShape::getCell(const sf::Vector2u &offset) const
 {
-    return m_cells[offset.y * m_size.x + offset.x];
+    return m_cells[offset];
 }
 
 bool RoomShape::isCell(const sf::Vector2u &offset, Cell cell) const
 {
-    return m_cells[offset.y * m_size.x + offset.x] == cell;
+    return m_cells[offset] == cell;
+}
+
+GridView<const Cell> RoomShape::getCells() const
+{
+    return m_cells.view();
 }
 
-std::vector<Cell> RoomShape::getCells() const
+GridView<Cell> RoomShape::getCells()
 {
-    return m_cells;
+    return m_cells.view();
 }
 
 sf::Vector2u RoomShape::getSize() const
@@ -9,25 +9,27 @@
  */
 
 #include "Cell.hpp"
+#include "Grid.hpp"
 #include <SFML/Graphics.hpp>
 #include <vector>
 
 class RoomShape
 {
     private:
-        sf::Vector2u      m_size;
-        std::vector<Cell> m_cells;
+        sf::Vector2u m_size;
+        Grid<Cell>   m_cells;
 
     public:
         RoomShape();
         RoomShape(const sf::Vector2u &size);
         ~RoomShape() = default;
 
-        void loadPrefab(const std::string &prefab);               // load a prefab from a file
+        bool loadPrefab(const std::string &prefab);               // load a prefab from a file, false on error
         void setCell(const sf::Vector2u &offset, Cell cell);      // set a cell in the room
         Cell getCell(const sf::Vector2u &offset) const;           // get the cell at the specified offset
         bool isCell(const sf::Vector2u &offset, Cell cell) const; // check if the location contains the specified cell
 
-        std::vector<Cell> getCells() const; // get the cells that make up the room
-        sf::Vector2u      getSize() const;  // get the size of the room
+        GridView<const Cell> getCells() const; // get a view of the cells that make up the room
+        GridView<Cell>       getCells();       // get a mutable view of the cells that make up the room
+        sf::Vector2u         getSize() const;  // get the size of the room
 };
@@ -0,0 +1,220 @@
+#include "ScrollCache.hpp"
+#include "Quad.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// positive modulo, so that tiles left of or above the origin wrap correctly
+int wrap(int value, int size)
+{
+    int result = value % size;
+    return result < 0 ? result + size : result;
+}
+
+} // namespace
+
+ScrollCache::ScrollCache(Tilemap *tilemap)
+{
+    m_tilemap = tilemap;
+    m_scale   = sf::Vector2u(0, 0);
+    m_slots   = sf::Vector2u(0, 0);
+    m_valid   = false;
+
+    m_clear.setPrimitiveType(sf::Triangles);
+    m_vertices.setPrimitiveType(sf::Triangles);
+    m_compose.setPrimitiveType(sf::Triangles);
+
+    m_tilemap->addListener(this);
+}
+
+ScrollCache::~ScrollCache()
+{
+    m_tilemap->removeListener(this);
+}
+
+void ScrollCache::invalidate()
+{
+    m_valid = false;
+    m_dirty.clear();
+}
+
+void ScrollCache::onTileChanged(sf::Uint32, const sf::Vector2u &position, sf::Uint32)
+{
+    // tiles outside the ring buffer will be drawn fresh when they scroll into view
+    if (m_valid && m_window.contains(static_cast<int>(position.x), static_cast<int>(position.y))) {
+        m_dirty.push_back(position);
+    }
+}
+
+void ScrollCache::redrawTile(int x, int y)
+{
+    auto tileSize = sf::Vector2f(m_tilemap->getTileSize());
+    auto slot     = sf::Vector2f(wrap(x, m_slots.x) * tileSize.x, wrap(y, m_slots.y) * tileSize.y);
+
+    // the slot still holds whatever tile wrapped into it last, so it is cleared
+    // to transparent before the layers of the new tile are drawn on top
+    appendQuad(m_clear, slot, tileSize, sf::Vector2f(0, 0), sf::Vector2f(0, 0), sf::Color::Transparent);
+    m_tilemap->appendTiles(m_vertices, sf::IntRect(x, y, 1, 1), slot, sf::Vector2u(1, 1));
+}
+
+void ScrollCache::update(const sf::IntRect &window)
+{
+    int left   = window.left;
+    int top    = window.top;
+    int right  = window.left + window.width;
+    int bottom = window.top + window.height;
+
+    m_clear.clear();
+    m_vertices.clear();
+
+    if (!m_valid) {
+        for (int y = top; y < bottom; y++) {
+            for (int x = left; x < right; x++) {
+                redrawTile(x, y);
+            }
+        }
+    } else {
+        int oldLeft   = m_window.left;
+        int oldTop    = m_window.top;
+        int oldRight  = m_window.left + m_window.width;
+        int oldBottom = m_window.top + m_window.height;
+
+        // rows that were not in the old window are redrawn whole; in the rows that
+        // were, only the newly exposed columns on either side are redrawn
+        for (int y = top; y < bottom; y++) {
+            if (y < oldTop || y >= oldBottom) {
+                for (int x = left; x < right; x++) {
+                    redrawTile(x, y);
+                }
+                continue;
+            }
+
+            for (int x = left; x < std::min(right, oldLeft); x++) {
+                redrawTile(x, y);
+            }
+
+            for (int x = std::max(left, oldRight); x < right; x++) {
+                redrawTile(x, y);
+            }
+        }
+
+        // a tile can be reported more than once, for several layers or its tint,
+        // and tiles in the newly exposed strips were redrawn above. Drawing one
+        // twice would blend its translucent layers over themselves.
+        auto before = [](const sf::Vector2u &a, const sf::Vector2u &b) { return a.y != b.y ? a.y < b.y : a.x < b.x; };
+
+        std::sort(m_dirty.begin(), m_dirty.end(), before);
+        m_dirty.erase(std::unique(m_dirty.begin(), m_dirty.end()), m_dirty.end());
+
+        for (auto &position : m_dirty) {
+            int  x       = static_cast<int>(position.x);
+            int  y       = static_cast<int>(position.y);
+            bool exposed = x < oldLeft || x >= oldRight || y < oldTop || y >= oldBottom;
+
+            if (window.contains(x, y) && !exposed) {
+                redrawTile(x, y);
+            }
+        }
+    }
+
+    m_dirty.clear();
+    m_window = window;
+    m_valid  = true;
+
+    if (m_clear.getVertexCount() == 0) {
+        return;
+    }
+
+    m_texture.draw(m_clear, sf::RenderStates(sf::BlendNone));
+    m_texture.draw(m_vertices, sf::RenderStates(&m_tilemap->getTilesheet()->getTexture()));
+    m_texture.display();
+}
+
+void ScrollCache::draw(sf::RenderTarget    &target,
+                       const sf::FloatRect &viewPort,
+                       const sf::Vector2f  &viewPosition,
+                       const sf::Vector2u   scale)
+{
+    auto tileSize = m_tilemap->getTileSize();
+    auto tilePx   = sf::Vector2f(tileSize.x * scale.x, tileSize.y * scale.y);
+
+    // The ring buffer holds one more row and column than fit in the viewport, so
+    // that a view at any fractional offset is fully covered.
+    sf::Vector2u slots(static_cast<sf::Uint32>(std::ceil(viewPort.width / tilePx.x)) + 1,
+                       static_cast<sf::Uint32>(std::ceil(viewPort.height / tilePx.y)) + 1);
+
+    if (scale != m_scale || slots != m_slots) {
+        if (!m_texture.create(slots.x * tileSize.x, slots.y * tileSize.y)) {
+            spdlog::error("ScrollCache::draw: failed to create render texture");
+            m_tilemap->draw(target, viewPort, viewPosition, scale);
+            return;
+        }
+
+        spdlog::debug("ScrollCache::draw: created {}x{} tile ring buffer", slots.x, slots.y);
+
+        m_scale = scale;
+        m_slots = slots;
+        invalidate();
+    }
+
+    sf::IntRect window(static_cast<int>(std::floor(viewPosition.x - viewPort.width / 2 / tilePx.x)),
+                       static_cast<int>(std::floor(viewPosition.y - viewPort.height / 2 / tilePx.y)),
+                       slots.x,
+                       slots.y);
+
+    update(window);
+
+    // Compose the frame. The window is cut where it wraps around the edges of the
+    // ring buffer, giving up to two spans on each axis and four quads in total.
+    struct Span
+    {
+        int tile;  // first tile in the span
+        int count; // number of tiles in the span
+        int slot;  // slot holding the first tile
+    };
+
+    auto split = [](int start, int length, int size, Span *spans) {
+        int slot  = wrap(start, size);
+        int first = std::min(length, size - slot);
+
+        spans[0] = Span{start, first, slot};
+        spans[1] = Span{start + first, length - first, 0};
+    };
+
+    Span columns[2];
+    Span rows[2];
+    split(window.left, window.width, m_slots.x, columns);
+    split(window.top, window.height, m_slots.y, rows);
+
+    m_compose.clear();
+
+    for (auto &row : rows) {
+        for (auto &column : columns) {
+            if (row.count == 0 || column.count == 0) {
+                continue;
+            }
+
+            sf::Vector2f position((column.tile - viewPosition.x) * tilePx.x + viewPort.width / 2,
+                                  (row.tile - viewPosition.y) * tilePx.y + viewPort.height / 2);
+
+            appendQuad(m_compose,
+                       position,
+                       sf::Vector2f(column.count * tilePx.x, row.count * tilePx.y),
+                       sf::Vector2f(column.slot * tileSize.x, row.slot * tileSize.y),
+                       sf::Vector2f(column.count * tileSize.x, row.count * tileSize.y),
+                       sf::Color::White);
+        }
+    }
+
+    target.draw(m_compose, sf::RenderStates(&m_texture.getTexture()));
+}
+
+void ScrollCache::onTintChanged(const sf::Vector2u &position)
+{
+    onTileChanged(0, position, 0);
+}
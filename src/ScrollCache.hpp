@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Tilemap.hpp"
+
+// ScrollCache is an optional cached render path for a Tilemap. The tiles around
+// the view are rendered once into an oversized render texture that is used as a
+// toroidal ring buffer: tile (x, y) always lives in slot (x mod columns, y mod
+// rows). When the view scrolls only the rows and columns that were newly exposed
+// are drawn into the buffer, and the frame is composed from at most four quads
+// cut at the wrap seams, positioned with sub-pixel precision.
+//
+// Tile changes reported by the tilemap are redrawn lazily on the next draw, so
+// the steady-state cost of panning is proportional to the edge tiles rather
+// than to every tile on the screen.
+class ScrollCache : public TilemapListener
+{
+    private:
+        Tilemap                  *m_tilemap;  // the tilemap being cached
+        sf::RenderTexture         m_texture;  // ring buffer holding the cached tiles
+        sf::Vector2u              m_scale;    // scale the cache was built for
+        sf::Vector2u              m_slots;    // number of tile slots in the ring buffer
+        sf::IntRect               m_window;   // tiles currently held in the ring buffer
+        bool                      m_valid;    // false if the whole buffer must be redrawn
+        std::vector<sf::Vector2u> m_dirty;    // changed tiles waiting to be redrawn
+        sf::VertexArray           m_clear;    // quads that clear slots before redrawing
+        sf::VertexArray           m_vertices; // tiles to draw into the ring buffer
+        sf::VertexArray           m_compose;  // quads that draw the ring buffer to the target
+
+        // queue the tile at the given position to be redrawn into its slot
+        void redrawTile(int x, int y);
+
+        // bring the ring buffer up to date for the given window of tiles
+        void update(const sf::IntRect &window);
+
+    public:
+        ScrollCache(Tilemap *tilemap);
+        ~ScrollCache();
+
+        ScrollCache(const ScrollCache &)            = delete;
+        ScrollCache &operator=(const ScrollCache &) = delete;
+
+        // draw the tilemap to the target. The arguments have the same meaning as
+        // in Tilemap::draw.
+        void draw(sf::RenderTarget    &target,
+                  const sf::FloatRect &viewPort,
+                  const sf::Vector2f  &viewPosition,
+                  const sf::Vector2u   scale);
+
+        // throw away the cached tiles so that the next draw redraws everything
+        void invalidate();
+
+        // TilemapListener
+        void onTileChanged(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id) override;
+        void onTintChanged(const sf::Vector2u &position) override;
+};
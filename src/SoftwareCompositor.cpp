@@ -0,0 +1,283 @@
+#include "SoftwareCompositor.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+
+#include <png.h>
+#include <spdlog/spdlog.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// x / 255, rounded, exact for every product of two 8 bit values
+inline sf::Uint32 div255(sf::Uint32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Blend count source pixels, modulated by tint, over the destination pixels. This
+// matches sf::BlendAlpha with a vertex colour: the colour channels are blended by
+// the source alpha, and the alpha channel accumulates coverage.
+void blendScalar(sf::Uint8 *dst, const sf::Uint8 *src, sf::Uint32 count, const sf::Color &tint)
+{
+    for (sf::Uint32 i = 0; i < count; i++, dst += 4, src += 4) {
+        sf::Uint32 a = div255(src[3] * tint.a);
+        if (a == 0) {
+            continue;
+        }
+
+        sf::Uint32 inverse = 255 - a;
+
+        dst[0] = div255(div255(src[0] * tint.r) * a + dst[0] * inverse);
+        dst[1] = div255(div255(src[1] * tint.g) * a + dst[1] * inverse);
+        dst[2] = div255(div255(src[2] * tint.b) * a + dst[2] * inverse);
+        dst[3] = div255(a * 255 + dst[3] * inverse);
+    }
+}
+
+#if defined(__SSE2__)
+
+inline __m128i div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// the same blend as blendScalar for two pixels widened to 16 bits per channel
+inline __m128i blendPair(__m128i src, __m128i dst, __m128i tint)
+{
+    const __m128i full      = _mm_set1_epi16(255);
+    const __m128i colorMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    const __m128i alphaOne  = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+
+    src = div255(_mm_mullo_epi16(src, tint));
+
+    // spread the alpha of each pixel over its four channels. The alpha channel
+    // itself is weighted by 255 rather than by alpha.
+    __m128i alpha   = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+    __m128i factor  = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne);
+    __m128i inverse = _mm_sub_epi16(full, alpha);
+
+    return div255(_mm_add_epi16(_mm_mullo_epi16(src, factor), _mm_mullo_epi16(dst, inverse)));
+}
+
+void blend(sf::Uint8 *dst, const sf::Uint8 *src, sf::Uint32 count, const sf::Color &tint)
+{
+    const __m128i zero      = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+    const __m128i tint16    = _mm_setr_epi16(tint.r, tint.g, tint.b, tint.a, tint.r, tint.g, tint.b, tint.a);
+
+    sf::Uint32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+
+        // fully transparent runs are common in tilesheets and leave the destination alone
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), zero)) == 0xFFFF) {
+            continue;
+        }
+
+        __m128i d  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i * 4));
+        __m128i lo = blendPair(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), tint16);
+        __m128i hi = blendPair(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), tint16);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+
+    blendScalar(dst + i * 4, src + i * 4, count - i, tint);
+}
+
+#else
+
+void blend(sf::Uint8 *dst, const sf::Uint8 *src, sf::Uint32 count, const sf::Color &tint)
+{
+    blendScalar(dst, src, count, tint);
+}
+
+#endif
+
+} // namespace
+
+SoftwareCompositor::SoftwareCompositor(Tilemap *tilemap, const sf::Color &background)
+{
+    m_tilemap    = tilemap;
+    m_background = background;
+}
+
+sf::IntRect SoftwareCompositor::clip(const sf::IntRect &area) const
+{
+    auto mapSize = m_tilemap->getMapSize();
+
+    int left   = std::clamp(area.left, 0, static_cast<int>(mapSize.x));
+    int top    = std::clamp(area.top, 0, static_cast<int>(mapSize.y));
+    int right  = std::clamp(area.left + area.width, 0, static_cast<int>(mapSize.x));
+    int bottom = std::clamp(area.top + area.height, 0, static_cast<int>(mapSize.y));
+
+    return sf::IntRect(left, top, std::max(right - left, 0), std::max(bottom - top, 0));
+}
+
+void SoftwareCompositor::compositeArea(sf::Uint8 *pixels, sf::Uint32 stride, const sf::IntRect &area) const
+{
+    auto       *tilesheet  = m_tilemap->getTilesheet();
+    auto       &image      = tilesheet->getImage();
+    auto        tileSize   = m_tilemap->getTileSize();
+    auto        tints      = m_tilemap->getTints();
+    auto        topOpaque  = m_tilemap->getTopOpaque();
+    auto        tileCount  = tilesheet->getTileCount();
+    const auto *sheet      = image.getPixelsPtr();
+    sf::Uint32  sheetWidth = image.getSize().x;
+    sf::Uint32  columns    = area.width;
+
+    if (sheet == nullptr) {
+        return;
+    }
+
+    sf::Uint8 background[4] = {m_background.r, m_background.g, m_background.b, m_background.a};
+
+    std::vector<GridView<const sf::Uint32>> layers;
+    for (sf::Uint32 layer = 0; layer < m_tilemap->getLayerCount(); layer++) {
+        layers.push_back(m_tilemap->getLayer(layer));
+    }
+
+    // every tile covers its own block of pixels, so tiles are independent work
+    parallelFor(0, area.width * area.height, [&](sf::Uint32 first, sf::Uint32 last) {
+        for (sf::Uint32 index = first; index < last; index++) {
+            sf::Uint32   column = index % columns;
+            sf::Uint32   row    = index / columns;
+            sf::Vector2u position(area.left + column, area.top + row);
+            sf::Color    tint  = tints[position];
+            sf::Uint8   *block = pixels + static_cast<size_t>(row) * tileSize.y * stride + column * tileSize.x * 4;
+
+            for (sf::Uint32 y = 0; y < tileSize.y; y++) {
+                for (sf::Uint32 x = 0; x < tileSize.x; x++) {
+                    std::copy(background, background + 4, block + y * stride + x * 4);
+                }
+            }
+
+            // layers under an opaque tile are covered, unless the tint is translucent
+            sf::Uint32 lowest = tint.a == 255 ? topOpaque[position] : 0;
+
+            for (sf::Uint32 layer = lowest; layer < layers.size(); layer++) {
+                auto id = layers[layer][position];
+                if (id == 0 || id >= tileCount || tilesheet->getOpacity(id) == Tilesheet::EMPTY) {
+                    continue;
+                }
+
+                auto rect = tilesheet->getTileRect(id);
+                for (sf::Uint32 y = 0; y < tileSize.y; y++) {
+                    blend(block + y * stride, sheet + ((rect.top + y) * sheetWidth + rect.left) * 4, tileSize.x, tint);
+                }
+            }
+        }
+    });
+}
+
+void SoftwareCompositor::composite(sf::Image &image, const sf::IntRect &area) const
+{
+    auto clipped  = clip(area);
+    auto tileSize = m_tilemap->getTileSize();
+
+    if (clipped.width == 0 || clipped.height == 0) {
+        image = sf::Image();
+        return;
+    }
+
+    sf::Uint32             width  = clipped.width * tileSize.x;
+    sf::Uint32             height = clipped.height * tileSize.y;
+    std::vector<sf::Uint8> pixels(width * height * 4);
+
+    compositeArea(pixels.data(), width * 4, clipped);
+    image.create(width, height, pixels.data());
+}
+
+bool SoftwareCompositor::exportPng(const std::string &filename, const sf::IntRect &area, sf::Uint32 stripRows) const
+{
+    sf::Clock clock;
+
+    auto clipped  = clip(area);
+    auto tileSize = m_tilemap->getTileSize();
+
+    if (clipped.width == 0 || clipped.height == 0) {
+        spdlog::error("SoftwareCompositor::exportPng: nothing to export to {}", filename);
+        return false;
+    }
+
+    stripRows = std::max(stripRows, 1u);
+
+    sf::Uint32 width  = clipped.width * tileSize.x;
+    sf::Uint32 height = clipped.height * tileSize.y;
+    sf::Uint32 stride = width * 4;
+
+    FILE *file = std::fopen(filename.c_str(), "wb");
+    if (file == nullptr) {
+        spdlog::error("SoftwareCompositor::exportPng: failed to open {}", filename);
+        return false;
+    }
+
+    png_structp png  = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop   info = png != nullptr ? png_create_info_struct(png) : nullptr;
+
+    if (info == nullptr) {
+        spdlog::error("SoftwareCompositor::exportPng: failed to create PNG writer");
+        png_destroy_write_struct(&png, nullptr);
+        std::fclose(file);
+        return false;
+    }
+
+    // the strip buffer is sized before setjmp and not touched by it afterwards, so
+    // it is still valid, and freed, if libpng jumps back here on an error
+    std::vector<sf::Uint8> strip(static_cast<size_t>(stride) * tileSize.y * std::min<int>(stripRows, clipped.height));
+
+    if (setjmp(png_jmpbuf(png))) {
+        spdlog::error("SoftwareCompositor::exportPng: failed to write {}", filename);
+        png_destroy_write_struct(&png, &info);
+        std::fclose(file);
+        return false;
+    }
+
+    png_init_io(png, file);
+    png_set_IHDR(png,
+                 info,
+                 width,
+                 height,
+                 8,
+                 PNG_COLOR_TYPE_RGB_ALPHA,
+                 PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+
+    for (int top = clipped.top; top < clipped.top + clipped.height; top += stripRows) {
+        int rows = std::min<int>(stripRows, clipped.top + clipped.height - top);
+
+        compositeArea(strip.data(), stride, sf::IntRect(clipped.left, top, clipped.width, rows));
+
+        for (sf::Uint32 y = 0; y < rows * tileSize.y; y++) {
+            png_write_row(png, strip.data() + static_cast<size_t>(y) * stride);
+        }
+    }
+
+    png_write_end(png, nullptr);
+    png_destroy_write_struct(&png, &info);
+    std::fclose(file);
+
+    spdlog::info("SoftwareCompositor::exportPng: wrote {}x{} image to {} in {}ms",
+                 width,
+                 height,
+                 filename,
+                 clock.getElapsedTime().asMilliseconds());
+
+    return true;
+}
+
+bool SoftwareCompositor::exportPng(const std::string &filename) const
+{
+    auto mapSize = m_tilemap->getMapSize();
+    return exportPng(filename, sf::IntRect(0, 0, mapSize.x, mapSize.y));
+}
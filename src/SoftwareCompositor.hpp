@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Tilemap.hpp"
+
+// SoftwareCompositor draws a Tilemap on the CPU, blending tiles out of the
+// tilesheet image with the same alpha blending and tint modulation the GPU
+// render paths use. It needs no window or render target, so map images can be
+// produced on headless machines.
+//
+// Tiles are composited at their native size, one tilesheet pixel per image
+// pixel, with every tile written by exactly one thread, so the tiles of an area
+// are composited in parallel. Blending uses SSE2 where it is available and a
+// scalar loop that gives identical results elsewhere.
+//
+// exportPng streams the map to a PNG file a strip of tile rows at a time, so a
+// map far larger than memory can be exported: a 4096x4096 map of 16x16 tiles is
+// a 65536x65536 pixel image, but only one strip of it is ever held in memory.
+class SoftwareCompositor
+{
+    private:
+        Tilemap  *m_tilemap;    // the tilemap being composited
+        sf::Color m_background; // colour of pixels no tile covers
+
+        // composite the tiles in area, which must lie inside the map, into an RGBA
+        // buffer that is stride bytes per row and holds exactly that area
+        void compositeArea(sf::Uint8 *pixels, sf::Uint32 stride, const sf::IntRect &area) const;
+
+        // clip an area to the map
+        sf::IntRect clip(const sf::IntRect &area) const;
+
+    public:
+        SoftwareCompositor(Tilemap *tilemap, const sf::Color &background = sf::Color::Black);
+
+        // composite the tiles in the given rectangle of tile coordinates into an
+        // image, replacing its contents. The area is clipped to the map, and an
+        // empty image is returned if nothing is left.
+        void composite(sf::Image &image, const sf::IntRect &area) const;
+
+        // composite the tiles in the given rectangle of tile coordinates to a PNG
+        // file, stripRows rows of tiles at a time. Returns false and logs an error
+        // if the file could not be written.
+        bool exportPng(const std::string &filename, const sf::IntRect &area, sf::Uint32 stripRows = 4) const;
+
+        // export the whole map to a PNG file
+        bool exportPng(const std::string &filename) const;
+};
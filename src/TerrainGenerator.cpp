@@ -0,0 +1,140 @@
+#include "TerrainGenerator.hpp"
+
+#include "Parallel.hpp"
+
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+namespace
+{
+
+// Stand-ins from the dungeon tilesheet until it has overworld tiles. The real
+// ones are set with setTile.
+constexpr std::array<sf::Uint32, TerrainGenerator::TERRAIN_COUNT> defaultTiles = {
+    55, // DEEP_WATER
+    87, // WATER
+    23, // SAND
+    7,  // GRASS
+    39, // FOREST
+    24, // DESERT
+    20, // HILLS
+    1,  // MOUNTAIN
+    40, // SNOW
+};
+
+// Heights above the sea level, as a fraction of the way from the sea level up to
+// 1, where each band of land starts. Water deeper than deepWater below the sea
+// level is deep.
+const float deepWater     = 0.2f;
+const float hillsStart    = 0.3f;
+const float mountainStart = 0.45f;
+const float snowStart     = 0.6f;
+const float beachWidth    = 0.04f;
+
+// moisture below which lowland is desert, and above which it is forest
+const float dryLand = -0.3f;
+const float wetLand = 0.2f;
+
+// seed of the moisture, mixed into the seed of the world
+const sf::Uint32 moistureSeed = 0x5bd1e995u;
+
+} // namespace
+
+TerrainGenerator::TerrainGenerator()
+{
+    m_seaLevel = -0.1f;
+    m_tiles    = defaultTiles;
+
+    m_moisture.setOctaves(3);
+
+    setSeed(0);
+    setScale(256);
+}
+
+void TerrainGenerator::setSeed(sf::Uint32 seed)
+{
+    m_height.setSeed(seed);
+    m_moisture.setSeed(seed ^ moistureSeed);
+}
+
+void TerrainGenerator::setScale(float tiles)
+{
+    m_height.setFrequency(1 / tiles);
+    m_moisture.setFrequency(0.5f / tiles);
+}
+
+TerrainGenerator::Terrain TerrainGenerator::classify(float height, float moisture) const
+{
+    if (height < m_seaLevel) {
+        return height < m_seaLevel - deepWater ? DEEP_WATER : WATER;
+    }
+
+    float land = (height - m_seaLevel) / (1 - m_seaLevel);
+
+    if (land >= snowStart) {
+        return SNOW;
+    }
+    if (land >= mountainStart) {
+        return MOUNTAIN;
+    }
+    if (land >= hillsStart) {
+        return HILLS;
+    }
+    if (land < beachWidth) {
+        return SAND;
+    }
+
+    return moisture < dryLand ? DESERT : moisture > wetLand ? FOREST : GRASS;
+}
+
+void TerrainGenerator::generateTiles(const sf::Vector2i &origin, GridView<sf::Uint32> tiles) const
+{
+    sf::Uint32 width = tiles.getSize().x;
+
+    std::vector<float> height(width);
+    std::vector<float> moisture(width);
+
+    for (sf::Uint32 y = 0; y < tiles.getSize().y; y++) {
+        sf::Int32 row = origin.y + static_cast<sf::Int32>(y);
+
+        m_height.getRow(height.data(), origin.x, row, width);
+        m_moisture.getRow(moisture.data(), origin.x, row, width);
+
+        auto out = tiles.row(y);
+        for (sf::Uint32 x = 0; x < width; x++) {
+            out[x] = m_tiles[classify(height[x], moisture[x])];
+        }
+    }
+}
+
+void TerrainGenerator::generate(GridView<sf::Uint32> tiles, const sf::Vector2i &origin, sf::Uint32 threads) const
+{
+    if (tiles.empty()) {
+        return;
+    }
+
+    sf::Clock clock;
+
+    auto       size    = tiles.getSize();
+    sf::Uint32 columns = (size.x + CHUNK - 1) / CHUNK;
+    sf::Uint32 rows    = (size.y + CHUNK - 1) / CHUNK;
+
+    parallelForEach(
+        0,
+        columns * rows,
+        [&](sf::Uint32 chunk) {
+            sf::Vector2i position((chunk % columns) * CHUNK, (chunk / columns) * CHUNK);
+            generateTiles(origin + position, tiles.sub(sf::IntRect(position, sf::Vector2i(CHUNK, CHUNK))));
+        },
+        threads);
+
+    auto elapsed = clock.getElapsedTime();
+
+    spdlog::debug("TerrainGenerator::generate: {}x{} tiles in {} ms, {:.1f} million tiles per second",
+                  size.x,
+                  size.y,
+                  elapsed.asMilliseconds(),
+                  size.x * size.y / std::max(elapsed.asSeconds(), 1e-6f) / 1e6f);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+
+#include <SFML/Config.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "GridView.hpp"
+#include "Noise.hpp"
+
+// TerrainGenerator generates the tiles of overworld terrain: seas, beaches,
+// grassland, forest, desert, hills and mountains, as an alternative to the mazes
+// Autotile draws for dungeons.
+//
+// Every tile takes two samples of fractal noise, a height and a moisture. Height
+// against the sea level decides between water, lowland, hills and mountains, and
+// moisture picks the biome of the lowland. Both are evaluated a row at a time by
+// Noise, with AVX2 where the CPU has it.
+//
+// The world is a pure function of the seed and the tile position, so any chunk of
+// it can be generated on its own, on any thread, and matches the same tiles of a
+// whole map generated in one go. Chunk streaming uses generateTiles for each
+// chunk as it comes into range; generate fills a whole map, splitting it into
+// chunks that are generated in parallel, to be set on a tilemap layer with
+// Tilemap::setTiles. quantum-gen --engine terrain checks that every thread count
+// and both noise paths give the same tiles, and measures the samples per second.
+class TerrainGenerator
+{
+    public:
+        // the kinds of terrain, each drawn with a tile of its own
+        enum Terrain : sf::Uint8
+        {
+            DEEP_WATER,
+            WATER,
+            SAND,
+            GRASS,
+            FOREST,
+            DESERT,
+            HILLS,
+            MOUNTAIN,
+            SNOW,
+            TERRAIN_COUNT
+        };
+
+        static constexpr sf::Uint32 CHUNK = 64; // width and height of the chunks generate splits a map into
+
+    private:
+        Noise                                 m_height;   // height of the land, -1 to 1
+        Noise                                 m_moisture; // moisture of the lowland, -1 to 1
+        float                                 m_seaLevel; // height below which land is under water
+        std::array<sf::Uint32, TERRAIN_COUNT> m_tiles;    // tile drawn for each terrain
+
+    public:
+        TerrainGenerator();
+        ~TerrainGenerator() = default;
+
+        // set the seed of the world. The same seed always gives the same terrain.
+        void setSeed(sf::Uint32 seed);
+
+        // set the size in tiles of the largest features, such as continents.
+        // Biomes are twice as large.
+        void setScale(float tiles);
+
+        // set the height below which land is under water, from -1 to 1. Lower sea
+        // levels give more land.
+        void setSeaLevel(float seaLevel)
+        {
+            m_seaLevel = seaLevel;
+        }
+
+        float getSeaLevel() const
+        {
+            return m_seaLevel;
+        }
+
+        // set the tile drawn for a kind of terrain
+        void setTile(Terrain terrain, sf::Uint32 id)
+        {
+            m_tiles[terrain] = id;
+        }
+
+        sf::Uint32 getTile(Terrain terrain) const
+        {
+            return m_tiles[terrain];
+        }
+
+        // set whether the noise is evaluated with AVX2 when the CPU supports it. The
+        // tiles are the same either way.
+        void setVectorised(bool vectorised)
+        {
+            m_height.setVectorised(vectorised);
+            m_moisture.setVectorised(vectorised);
+        }
+
+        // check if the noise is evaluated with AVX2
+        bool isVectorised() const
+        {
+            return m_height.isVectorised();
+        }
+
+        // get the terrain of a tile from its height and moisture
+        Terrain classify(float height, float moisture) const;
+
+        // write the tiles of the world from origin onwards to tiles. Safe to call
+        // from several threads at once, for different chunks.
+        void generateTiles(const sf::Vector2i &origin, GridView<sf::Uint32> tiles) const;
+
+        // write the tiles of the world from origin onwards to tiles, a chunk at a
+        // time on threads workers, or every hardware thread if 0
+        void generate(GridView<sf::Uint32> tiles,
+                      const sf::Vector2i  &origin  = sf::Vector2i(0, 0),
+                      sf::Uint32           threads = 0) const;
+};
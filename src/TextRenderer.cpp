@@ -0,0 +1,240 @@
+#include "TextRenderer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+#include "Quad.hpp"
+
+namespace
+{
+
+// layouts not used for this many frames are dropped
+const sf::Uint64 keepFrames = 300;
+
+sf::Uint64 getKey(std::string_view text, float wrap)
+{
+    sf::Uint32 bits;
+    std::memcpy(&bits, &wrap, sizeof(bits));
+
+    return std::hash<std::string_view>()(text) ^ (bits * 0x9e3779b97f4a7c15ull);
+}
+
+// decode the UTF-8 character at i and move i past it. Malformed characters
+// decode to '?'.
+sf::Uint32 nextCodePoint(std::string_view text, size_t &i)
+{
+    sf::Uint8 lead = text[i++];
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    int extra = lead >= 0xf0 ? 3 : lead >= 0xe0 ? 2 : lead >= 0xc0 ? 1 : -1;
+    if (extra < 0 || i + extra > text.size()) {
+        return '?';
+    }
+
+    sf::Uint32 codePoint = lead & (0x3f >> extra);
+    for (int k = 0; k < extra; k++, i++) {
+        sf::Uint8 byte = text[i];
+        if ((byte & 0xc0) != 0x80) {
+            return '?';
+        }
+
+        codePoint = codePoint << 6 | (byte & 0x3f);
+    }
+
+    return codePoint;
+}
+
+} // namespace
+
+TextRenderer::TextRenderer(const sf::Font *font, unsigned characterSize)
+{
+    m_font        = font;
+    m_size        = characterSize;
+    m_lineSpacing = 0;
+    m_frame       = 1;
+
+    m_batch.setPrimitiveType(sf::Triangles);
+
+    if (m_font == nullptr) {
+        spdlog::warn("TextRenderer::TextRenderer: no font, so no text will be drawn");
+        return;
+    }
+
+    // asking for a glyph renders it into the atlas, so this bakes every printable
+    // ASCII character now rather than during a frame
+    for (sf::Uint32 c = ' '; c < 127; c++) {
+        m_ascii[c] = m_font->getGlyph(c, m_size, false);
+    }
+
+    m_lineSpacing = m_font->getLineSpacing(m_size);
+
+    spdlog::info("TextRenderer::TextRenderer: baked ASCII at {}px into a {}x{} atlas",
+                 m_size,
+                 m_font->getTexture(m_size).getSize().x,
+                 m_font->getTexture(m_size).getSize().y);
+}
+
+const sf::Glyph &TextRenderer::getGlyph(sf::Uint32 codePoint) const
+{
+    if (codePoint >= ' ' && codePoint < 127) {
+        return m_ascii[codePoint];
+    }
+
+    return m_font->getGlyph(codePoint, m_size, false);
+}
+
+void TextRenderer::layOut(Layout &layout) const
+{
+    layout.vertices.clear();
+    layout.vertices.setPrimitiveType(sf::Triangles);
+    layout.size = sf::Vector2f(0, 0);
+
+    if (m_font == nullptr) {
+        return;
+    }
+
+    std::string_view text = layout.text;
+
+    // the pen starts on the baseline of the first line. The glyphs of the word
+    // being laid out start at vertex wordStart and pen position wordX, which is
+    // negative between words.
+    float      x         = 0;
+    float      y         = m_size;
+    float      width     = 0;
+    sf::Uint32 lines     = 1;
+    size_t     wordStart = 0;
+    float      wordX     = -1;
+    sf::Uint32 previous  = 0;
+
+    for (size_t i = 0; i < text.size();) {
+        sf::Uint32 codePoint = nextCodePoint(text, i);
+
+        if (codePoint == '\n') {
+            x  = 0;
+            y += m_lineSpacing;
+            lines++;
+            wordX    = -1;
+            previous = 0;
+            continue;
+        }
+
+        x       += m_font->getKerning(previous, codePoint, m_size);
+        previous = codePoint;
+
+        if (codePoint == ' ' || codePoint == '\t') {
+            x    += getGlyph(' ').advance * (codePoint == '\t' ? 4 : 1);
+            wordX = -1;
+            continue;
+        }
+
+        const sf::Glyph &glyph = getGlyph(codePoint);
+
+        if (wordX < 0) {
+            wordStart = layout.vertices.getVertexCount();
+            wordX     = x;
+        }
+
+        if (layout.wrap > 0 && x > 0 && x + glyph.bounds.left + glyph.bounds.width > layout.wrap) {
+            if (wordX > 0) {
+                // move the word so far to the start of the next line
+                for (size_t v = wordStart; v < layout.vertices.getVertexCount(); v++) {
+                    layout.vertices[v].position += sf::Vector2f(-wordX, m_lineSpacing);
+                }
+                x -= wordX;
+            } else {
+                // the word is wider than a line, so it is broken here
+                x         = 0;
+                wordStart = layout.vertices.getVertexCount();
+            }
+
+            y += m_lineSpacing;
+            lines++;
+            wordX = 0;
+        }
+
+        appendQuad(layout.vertices,
+                   sf::Vector2f(x + glyph.bounds.left, y + glyph.bounds.top),
+                   sf::Vector2f(glyph.bounds.width, glyph.bounds.height),
+                   sf::Vector2f(glyph.textureRect.left, glyph.textureRect.top),
+                   sf::Vector2f(glyph.textureRect.width, glyph.textureRect.height));
+
+        x    += glyph.advance;
+        width = std::max(width, x);
+    }
+
+    layout.size = sf::Vector2f(width, lines * m_lineSpacing);
+}
+
+const TextRenderer::Layout &TextRenderer::getLayout(std::string_view text, float wrap)
+{
+    auto [it, inserted] = m_layouts.try_emplace(getKey(text, wrap));
+    auto &layout        = it->second;
+
+    // a new text, or a different one with the same hash, which replaces it
+    if (inserted || layout.text != text || layout.wrap != wrap) {
+        layout.text = text;
+        layout.wrap = wrap;
+        layOut(layout);
+    }
+
+    layout.lastUsed = m_frame;
+
+    return layout;
+}
+
+const TextRenderer::Layout &TextRenderer::getScratchLayout(std::string_view text, float wrap)
+{
+    m_scratch.text = text;
+    m_scratch.wrap = wrap;
+    layOut(m_scratch);
+
+    return m_scratch;
+}
+
+sf::Vector2f TextRenderer::addText(std::string_view    text,
+                                   const sf::Vector2f &position,
+                                   const sf::Color    &color,
+                                   float               wrap)
+{
+    const auto &layout = getLayout(text, wrap);
+    addLayout(layout, position, color);
+
+    return layout.size;
+}
+
+void TextRenderer::addLayout(const Layout &layout, const sf::Vector2f &position, const sf::Color &color)
+{
+    // glyphs are only sharp when they start on a whole pixel
+    sf::Vector2f origin(std::round(position.x), std::round(position.y));
+
+    for (size_t v = 0; v < layout.vertices.getVertexCount(); v++) {
+        sf::Vertex vertex = layout.vertices[v];
+        vertex.position  += origin;
+        vertex.color      = color;
+        m_batch.append(vertex);
+    }
+}
+
+void TextRenderer::addRect(const sf::FloatRect &rect, const sf::Color &color)
+{
+    // every font page has a 2x2 block of white texels in its top left corner
+    appendQuad(m_batch, rect.getPosition(), rect.getSize(), sf::Vector2f(1, 1), sf::Vector2f(0, 0), color);
+}
+
+void TextRenderer::draw(sf::RenderTarget &target)
+{
+    if (m_font != nullptr && m_batch.getVertexCount() > 0) {
+        target.draw(m_batch, sf::RenderStates(&m_font->getTexture(m_size)));
+    }
+
+    m_batch.clear();
+    m_frame++;
+
+    if (m_frame % keepFrames == 0) {
+        std::erase_if(m_layouts, [this](const auto &entry) { return entry.second.lastUsed + keepFrames < m_frame; });
+    }
+}
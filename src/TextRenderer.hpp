@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+#include <unordered_map>
+
+#include <SFML/Graphics.hpp>
+
+// TextRenderer draws every piece of text on screen in a frame, such as the HUD,
+// tooltips and the message log, as one batch of triangles from a glyph atlas,
+// instead of an sf::Text and a draw call for each line.
+//
+// The atlas is the texture the font keeps for the character size. The printable
+// ASCII glyphs are baked into it up front, so the texture does not grow in the
+// middle of a frame for common text, and their metrics are kept in a table. Other
+// characters are added to the atlas the first time they are used.
+//
+// Laying out a line, looking up each glyph, applying kerning and wrapping words,
+// is done once per distinct text and wrap width. The result is cached as vertices
+// relative to the top left of the text, so text that does not change from frame
+// to frame only costs copying its vertices into the batch with the position and
+// colour it is drawn with. Layouts not used for a while are dropped. Text that
+// changes every frame is laid out into a scratch layout instead, so it does not
+// fill the cache with layouts that are never used again.
+//
+// Panels behind the text are drawn into the same batch with the white texels
+// SFML keeps in every font page, so they do not need a batch of their own.
+class TextRenderer
+{
+    public:
+        // text laid out at the origin, in white
+        struct Layout
+        {
+            std::string     text;     // the text laid out
+            float           wrap;     // width the text was wrapped to, 0 for none
+            sf::VertexArray vertices; // glyph triangles, relative to the top left
+            sf::Vector2f    size;     // width of the widest line and height of every line
+            sf::Uint64      lastUsed; // frame the layout was last used
+        };
+
+    private:
+        const sf::Font                        *m_font;        // font the atlas belongs to
+        unsigned                               m_size;        // character size in pixels
+        std::array<sf::Glyph, 128>             m_ascii;       // metrics of the ASCII glyphs
+        float                                  m_lineSpacing; // distance between baselines
+        std::unordered_map<sf::Uint64, Layout> m_layouts;     // cached layouts, by hash of text and wrap
+        sf::VertexArray                        m_batch;       // every glyph to draw this frame
+        sf::Uint64                             m_frame;       // number of the current frame
+        Layout                                 m_scratch;     // layout of text that is not cached
+
+        // get the metrics and atlas rectangle of a character
+        const sf::Glyph &getGlyph(sf::Uint32 codePoint) const;
+
+        // lay out text at the origin, wrapping words that would pass the wrap width
+        void layOut(Layout &layout) const;
+
+    public:
+        // the font must outlive the renderer. Without a font nothing is drawn.
+        TextRenderer(const sf::Font *font, unsigned characterSize);
+        ~TextRenderer() = default;
+
+        // get the distance between the baselines of two lines
+        float getLineSpacing() const
+        {
+            return m_lineSpacing;
+        }
+
+        // get the layout of text, making it if it is not cached. The layout stays
+        // valid until the next draw.
+        const Layout &getLayout(std::string_view text, float wrap = 0);
+
+        // lay out text that changes every frame, such as a counter, without caching
+        // it. The layout stays valid until the next call.
+        const Layout &getScratchLayout(std::string_view text, float wrap = 0);
+
+        // add text to this frame's batch with its top left at position. Lines
+        // longer than wrap are wrapped at spaces, or anywhere in a word longer than
+        // wrap, unless wrap is 0. Returns the size of the text.
+        sf::Vector2f addText(std::string_view    text,
+                             const sf::Vector2f &position,
+                             const sf::Color    &color = sf::Color::White,
+                             float               wrap  = 0);
+
+        // add text already laid out to this frame's batch, with its top left at
+        // position
+        void addLayout(const Layout &layout, const sf::Vector2f &position, const sf::Color &color = sf::Color::White);
+
+        // add a filled rectangle to this frame's batch, such as a panel behind text
+        void addRect(const sf::FloatRect &rect, const sf::Color &color);
+
+        // draw this frame's batch in one draw call and start the next frame
+        void draw(sf::RenderTarget &target);
+
+        // get the number of layouts cached
+        size_t getCachedCount() const
+        {
+            return m_layouts.size();
+        }
+};
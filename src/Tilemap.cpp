@@ -1,4 +1,6 @@
 #include "Tilemap.hpp"
+#include <algorithm>
+#include <cmath>
 #include <spdlog/spdlog.h>
 
 Tilemap::Tilemap(const std::string  &filename,
@@ -6,13 +8,35 @@ Tilemap::Tilemap(const std::string  &filename,
                  const sf::Vector2u &mapSize,
                  const sf::Uint32    layers)
     : m_tilesheet(filename, tileSize)
+{
+    create(tileSize, mapSize, layers);
+}
+
+Tilemap::Tilemap(const sf::Image    &image,
+                 const sf::Vector2u &tileSize,
+                 const sf::Vector2u &mapSize,
+                 const sf::Uint32    layers)
+    : m_tilesheet(image, tileSize)
+{
+    create(tileSize, mapSize, layers);
+}
+
+void Tilemap::create(const sf::Vector2u &tileSize, const sf::Vector2u &mapSize, const sf::Uint32 layers)
 {
     m_tileSize = tileSize;
     m_mapSize  = mapSize;
-    m_layers.resize(layers);
+
+    if (layers > MAX_LAYERS) {
+        spdlog::error("Tilemap::create: {} layers requested, only {} are supported", layers, MAX_LAYERS);
+    }
+
+    m_layers.resize(std::min(layers, MAX_LAYERS));
+    m_tints.resize(mapSize, sf::Color::White);
+    m_topOpaque.resize(mapSize, 0);
+    m_vertices.setPrimitiveType(sf::Triangles);
 
     for (auto &layer : m_layers) {
-        layer.resize(mapSize.x * mapSize.y);
+        layer.resize(mapSize);
     }
 }
 
@@ -32,7 +56,179 @@ void Tilemap::setTile(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32
         return;
     }
 
-    m_layers[layer][position.y * m_mapSize.x + position.x] = id;
+    auto &tile = m_layers[layer][position];
+    if (tile == id) {
+        return;
+    }
+
+    tile = id;
+    updateTopOpaque(layer, position);
+
+    for (auto listener : m_listeners) {
+        listener->onTileChanged(layer, position, id);
+    }
+}
+
+void Tilemap::updateTopOpaque(sf::Uint32 layer, const sf::Vector2u &position)
+{
+    auto &top = m_topOpaque[position];
+
+    // a tile under the topmost opaque one is hidden whatever it is
+    if (layer < top) {
+        return;
+    }
+
+    if (layer > top) {
+        if (isOpaque(m_layers[layer][position])) {
+            top = layer;
+        }
+        return;
+    }
+
+    // the tile that hid the layers below changed, so look down for the next one
+    while (layer > 0 && !isOpaque(m_layers[layer][position])) {
+        layer--;
+    }
+
+    top = layer;
+}
+
+void Tilemap::findTopOpaque()
+{
+    auto view = m_topOpaque.view();
+
+    for (sf::Uint32 y = 0; y < m_mapSize.y; y++) {
+        auto row = view.row(y);
+        std::fill(row.begin(), row.end(), 0);
+
+        for (sf::Uint32 layer = 1; layer < m_layers.size(); layer++) {
+            auto tiles = m_layers[layer].view().row(y);
+
+            for (sf::Uint32 x = 0; x < m_mapSize.x; x++) {
+                if (isOpaque(tiles[x])) {
+                    row[x] = layer;
+                }
+            }
+        }
+    }
+}
+
+void Tilemap::setTiles(sf::Uint32 layer, const sf::Vector2u &position, GridView<const sf::Uint32> tiles)
+{
+    if (layer >= m_layers.size()) {
+        spdlog::error("Tilemap::setTiles: layer out of bounds");
+        return;
+    }
+
+    if (position.x >= m_mapSize.x || position.y >= m_mapSize.y) {
+        return;
+    }
+
+    auto       view   = m_layers[layer].view();
+    sf::Uint32 width  = std::min(tiles.getSize().x, m_mapSize.x - position.x);
+    sf::Uint32 height = std::min(tiles.getSize().y, m_mapSize.y - position.y);
+
+    for (sf::Uint32 y = 0; y < height; y++) {
+        auto from = tiles.row(y);
+        auto to   = view.row(position.y + y).subspan(position.x, width);
+
+        for (sf::Uint32 x = 0; x < width; x++) {
+            if (to[x] == from[x]) {
+                continue;
+            }
+
+            to[x] = from[x];
+            updateTopOpaque(layer, sf::Vector2u(position.x + x, position.y + y));
+
+            for (auto listener : m_listeners) {
+                listener->onTileChanged(layer, sf::Vector2u(position.x + x, position.y + y), from[x]);
+            }
+        }
+    }
+}
+
+GridView<const sf::Uint32> Tilemap::getLayer(sf::Uint32 layer) const
+{
+    if (layer >= m_layers.size()) {
+        spdlog::error("Tilemap::getLayer: layer out of bounds");
+        return GridView<const sf::Uint32>();
+    }
+
+    return m_layers[layer].view();
+}
+
+void Tilemap::setTint(const sf::Vector2u &position, const sf::Color &color)
+{
+    if (position.x >= m_mapSize.x || position.y >= m_mapSize.y) {
+        return;
+    }
+
+    auto &tint = m_tints[position];
+    if (tint == color) {
+        return;
+    }
+
+    tint = color;
+
+    for (auto listener : m_listeners) {
+        listener->onTintChanged(position);
+    }
+}
+
+sf::Color Tilemap::getTint(const sf::Vector2u &position) const
+{
+    if (position.x >= m_mapSize.x || position.y >= m_mapSize.y) {
+        return sf::Color::White;
+    }
+
+    return m_tints[position];
+}
+
+void Tilemap::reloadTilesheet(const sf::Image &image)
+{
+    auto changed = m_tilesheet.setImage(image);
+    if (changed.empty()) {
+        return;
+    }
+
+    // tiles that changed may have become opaque or stopped being so
+    findTopOpaque();
+
+    std::vector<bool> isChanged(m_tilesheet.getTileCount(), false);
+    for (auto id : changed) {
+        isChanged[id] = true;
+    }
+
+    sf::Uint32 tiles = 0;
+    for (sf::Uint32 layer = 0; layer < m_layers.size(); layer++) {
+        auto view = m_layers[layer].view();
+
+        for (sf::Uint32 y = 0; y < m_mapSize.y; y++) {
+            auto row = view.row(y);
+
+            for (sf::Uint32 x = 0; x < m_mapSize.x; x++) {
+                if (row[x] < isChanged.size() && isChanged[row[x]]) {
+                    tiles++;
+
+                    for (auto listener : m_listeners) {
+                        listener->onTileChanged(layer, sf::Vector2u(x, y), row[x]);
+                    }
+                }
+            }
+        }
+    }
+
+    spdlog::info("Tilemap::reloadTilesheet: {} tile IDs changed, {} map tiles invalidated", changed.size(), tiles);
+}
+
+void Tilemap::addListener(TilemapListener *listener)
+{
+    m_listeners.push_back(listener);
+}
+
+void Tilemap::removeListener(TilemapListener *listener)
+{
+    m_listeners.erase(std::remove(m_listeners.begin(), m_listeners.end(), listener), m_listeners.end());
 }
 
 sf::Uint32 Tilemap::getTile(sf::Uint32 layer, const sf::Vector2u &position) const
@@ -45,7 +241,7 @@ sf::Uint32 Tilemap::getTile(sf::Uint32 layer, const sf::Vector2u &position) cons
         return 0;
     }
 
-    return m_layers[layer][position.y * m_mapSize.x + position.x];
+    return m_layers[layer][position];
 }
 
 void Tilemap::draw(sf::RenderTarget    &target,
@@ -69,45 +265,31 @@ void Tilemap::draw(sf::RenderTarget    &target,
 
     // Calculate the range of tiles that are visible in the view including the scale, and the
     // viewPosition of the camera in tile coordinates.
-    sf::Vector2f viewSize(viewPort.width / m_tileSize.x, viewPort.height / m_tileSize.y);
+    sf::Vector2f tilePx(m_tileSize.x * scale.x, m_tileSize.y * scale.y);
+    sf::Vector2f viewSize(viewPort.width / tilePx.x, viewPort.height / tilePx.y);
     sf::Vector2f viewStart(viewPosition - viewSize / 2.f);
     sf::Vector2f viewEnd(viewPosition + viewSize / 2.f);
 
     // Clamp the viewStart and viewEnd to the bounds of the map so that we do not draw tiles
     // that are outside of the map.
-    viewStart.x = std::max(0.f, std::min(static_cast<float>(m_mapSize.x), viewStart.x));
-    viewStart.y = std::max(0.f, std::min(static_cast<float>(m_mapSize.y), viewStart.y));
-    viewEnd.x   = std::max(0.f, std::min(static_cast<float>(m_mapSize.x), viewEnd.x));
-    viewEnd.y   = std::max(0.f, std::min(static_cast<float>(m_mapSize.y), viewEnd.y));
-
-    // Calculate the range of tiles that are visible in the view including the scale and
-    // the viewPosition of the camera in tile coordinates.
-    sf::Vector2u start(static_cast<sf::Uint32>(viewStart.x), static_cast<sf::Uint32>(viewStart.y));
-    sf::Vector2u end(static_cast<sf::Uint32>(viewEnd.x), static_cast<sf::Uint32>(viewEnd.y));
-
-    // Draw the visible tiles to the target, making sure that we draw the tiles inside the viewPort
-    // centering the viewport on the viewPosition
-    for (sf::Uint32 layer = 0; layer < m_layers.size(); layer++) {
-        for (sf::Uint32 y = start.y; y < end.y + 1; y++) {
-            for (sf::Uint32 x = start.x; x < end.x; x++) {
-                auto id = getTile(layer, sf::Vector2u(x, y));
-                if (id != 0) {
-                    auto tilePosition =
-                        sf::Vector2f((x - viewPosition.x) * m_tileSize.x * scale.x + viewPort.width / 2,
-                                     (y - viewPosition.y) * m_tileSize.y * scale.y + viewPort.height / 2);
-
-                    // check if the tile is either inside the viewPort or overlaps the edge of the viewPort
-                    if (tilePosition.x + m_tileSize.x * scale.x > viewPort.left &&
-                        tilePosition.x < viewPort.left + viewPort.width &&
-                        tilePosition.y + m_tileSize.y * scale.y > viewPort.top &&
-                        tilePosition.y < viewPort.top + viewPort.height)
-                    {
-                        m_tilesheet.drawTile(target, id, tilePosition, scale);
-                    }
-                }
-            }
-        }
-    }
+    viewStart.x = std::max(0.f, std::min(static_cast<float>(m_mapSize.x), std::floor(viewStart.x)));
+    viewStart.y = std::max(0.f, std::min(static_cast<float>(m_mapSize.y), std::floor(viewStart.y)));
+    viewEnd.x   = std::max(0.f, std::min(static_cast<float>(m_mapSize.x), std::ceil(viewEnd.x)));
+    viewEnd.y   = std::max(0.f, std::min(static_cast<float>(m_mapSize.y), std::ceil(viewEnd.y)));
+
+    sf::IntRect area(static_cast<int>(viewStart.x),
+                     static_cast<int>(viewStart.y),
+                     static_cast<int>(viewEnd.x - viewStart.x),
+                     static_cast<int>(viewEnd.y - viewStart.y));
+
+    // Batch every visible tile into a single vertex array, centering the viewport on the
+    // viewPosition, and draw it with one call.
+    sf::Vector2f origin((area.left - viewPosition.x) * tilePx.x + viewPort.width / 2,
+                        (area.top - viewPosition.y) * tilePx.y + viewPort.height / 2);
+
+    m_vertices.clear();
+    appendTiles(m_vertices, area, origin, scale);
+    target.draw(m_vertices, sf::RenderStates(&m_tilesheet.getTexture()));
 
     // draw a box around the viewPort
     sf::RectangleShape box(sf::Vector2f(viewPort.width, viewPort.height));
@@ -117,3 +299,34 @@ void Tilemap::draw(sf::RenderTarget    &target,
     box.setOutlineThickness(1);
     target.draw(box);
 }
+
+void Tilemap::appendTiles(sf::VertexArray    &vertices,
+                          const sf::IntRect  &area,
+                          const sf::Vector2f &origin,
+                          const sf::Vector2u  scale) const
+{
+    sf::Vector2f tilePx(m_tileSize.x * scale.x, m_tileSize.y * scale.y);
+
+    // clip the area to the map
+    int left   = std::clamp(area.left, 0, static_cast<int>(m_mapSize.x));
+    int top    = std::clamp(area.top, 0, static_cast<int>(m_mapSize.y));
+    int right  = std::clamp(area.left + area.width, 0, static_cast<int>(m_mapSize.x));
+    int bottom = std::clamp(area.top + area.height, 0, static_cast<int>(m_mapSize.y));
+
+    for (int y = top; y < bottom; y++) {
+        for (int x = left; x < right; x++) {
+            sf::Vector2f position(origin.x + (x - area.left) * tilePx.x, origin.y + (y - area.top) * tilePx.y);
+            sf::Color    tint = m_tints(x, y);
+
+            // a translucent tint lets the layers under an opaque tile show through
+            sf::Uint32 first = tint.a == 255 ? m_topOpaque(x, y) : 0;
+
+            for (sf::Uint32 layer = first; layer < m_layers.size(); layer++) {
+                auto id = m_layers[layer](x, y);
+                if (id != 0 && m_tilesheet.getOpacity(id) != Tilesheet::EMPTY) {
+                    m_tilesheet.appendTile(vertices, id, position, scale, tint);
+                }
+            }
+        }
+    }
+}
@@ -1,35 +1,136 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 
+#include "Grid.hpp"
 #include "Tilesheet.hpp"
 
+// TilemapListener is notified whenever a tile in a Tilemap changes, so that
+// anything built from the tilemap (render caches, overviews, journals) can
+// update only the tiles that changed instead of rebuilding from scratch.
+class TilemapListener
+{
+    public:
+        virtual ~TilemapListener() = default;
+
+        // onTileChanged is called after the tile at the given position in the given
+        // layer has been set to a new ID.
+        virtual void onTileChanged(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id) = 0;
+
+        // onTintChanged is called after the tint of the tile at the given position
+        // has changed. Listeners that do not cache colours can ignore it.
+        virtual void onTintChanged(const sf::Vector2u &)
+        {
+        }
+};
+
 // A tilemap is a layered grid of tiles. Each layer is a 2D array of tile IDs
 // that correspond to tiles in a tilesheet. The tilemap also has a position and
 // a size, and it can be drawn to a render target.
+//
+// For every tile position the tilemap keeps the topmost layer whose tile is fully
+// opaque, updated as tiles are set. Nothing under that layer can be seen, so the
+// renderers start drawing from it, and skip fully transparent tiles too, which on
+// maps with many layers cuts most of the overdraw and the vertices.
 class Tilemap
 {
+    public:
+        static constexpr sf::Uint32 MAX_LAYERS = 0x10000; // the topmost opaque layer is kept in 16 bits
+
     private:
-        sf::Vector2u                         m_tileSize;
-        sf::Vector2u                         m_mapSize;
-        std::vector<std::vector<sf::Uint32>> m_layers;
-        Tilesheet                            m_tilesheet;
+        sf::Vector2u                   m_tileSize;
+        sf::Vector2u                   m_mapSize;
+        std::vector<Grid<sf::Uint32>>  m_layers;
+        Tilesheet                      m_tilesheet;
+        Grid<sf::Color>                m_tints;
+        Grid<sf::Uint16>               m_topOpaque; // topmost layer with an opaque tile, 0 if none
+        std::vector<TilemapListener *> m_listeners;
+        sf::VertexArray                m_vertices;
+
+        // size the layers and tints for the map
+        void create(const sf::Vector2u &tileSize, const sf::Vector2u &mapSize, const sf::Uint32 layers);
+
+        // check if a tile ID hides everything under it
+        bool isOpaque(sf::Uint32 id) const
+        {
+            return id != 0 && m_tilesheet.getOpacity(id) == Tilesheet::SOLID;
+        }
+
+        // update the topmost opaque layer at a position after its tile in a layer
+        // changed
+        void updateTopOpaque(sf::Uint32 layer, const sf::Vector2u &position);
+
+        // find the topmost opaque layer at every position, after the opacity of the
+        // tiles changed
+        void findTopOpaque();
 
     public:
         Tilemap() = delete;
         // The constructor takes a filename for the tilesheet, a tile size and a map
-        // size.
+        // size. Maps have at most MAX_LAYERS layers; asking for more logs an error
+        // and creates that many.
         Tilemap(const std::string  &filename,
                 const sf::Vector2u &tileSize,
                 const sf::Vector2u &mapSize,
                 const sf::Uint32    layers = 1);
+
+        // This constructor takes the tilesheet image already decoded, for example by
+        // the AssetLoader.
+        Tilemap(const sf::Image    &image,
+                const sf::Vector2u &tileSize,
+                const sf::Vector2u &mapSize,
+                const sf::Uint32    layers = 1);
         ~Tilemap();
 
         // setTile sets the tile ID at the given position in the given layer.
         void setTile(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id);
 
+        // setTiles copies a rectangle of tile IDs into a layer with its top left at
+        // the given position, clipped to the map. Only tiles whose ID changes are
+        // written and reported to listeners, so regenerating a layer that is mostly
+        // the same stays cheap for caches built from it.
+        void setTiles(sf::Uint32 layer, const sf::Vector2u &position, GridView<const sf::Uint32> tiles);
+
         // getTile returns the tile ID at the given position in the given layer.
         sf::Uint32 getTile(sf::Uint32 layer, const sf::Vector2u &position) const;
 
+        // getLayer returns a read-only view of the tile IDs of a layer, without
+        // copying them, for consumers that walk whole rows of tiles. Tiles are
+        // changed through setTile so that listeners are told. An empty view is
+        // returned if the layer does not exist.
+        GridView<const sf::Uint32> getLayer(sf::Uint32 layer) const;
+
+        // getTopOpaque returns a read-only view of the topmost layer at each position
+        // whose tile is fully opaque, or 0 if there is none. Layers under it cannot
+        // be seen, unless the tint of the tile is translucent.
+        GridView<const sf::Uint16> getTopOpaque() const
+        {
+            return m_topOpaque.view();
+        }
+
+        // getTints returns a read-only view of the tint of every tile.
+        GridView<const sf::Color> getTints() const
+        {
+            return m_tints.view();
+        }
+
+        // setTint sets the colour every layer of the tile at the given position is
+        // modulated with when drawn, which is how lighting reaches the renderer as
+        // vertex colours. Tiles are white, and so drawn unchanged, by default.
+        void setTint(const sf::Vector2u &position, const sf::Color &color);
+
+        // getTint returns the tint of the tile at the given position.
+        sf::Color getTint(const sf::Vector2u &position) const;
+
+        // appendTiles appends every visible tile of every layer inside the given
+        // rectangle of tile coordinates to a vertex array, bottom layer first. The
+        // top left tile of the rectangle is placed at origin, in pixel coordinates.
+        // Tiles outside the map, fully transparent tiles and tiles hidden under an
+        // opaque one are skipped.
+        void appendTiles(sf::VertexArray    &vertices,
+                         const sf::IntRect  &area,
+                         const sf::Vector2f &origin,
+                         const sf::Vector2u  scale) const;
+
         // draw draws the tilemap to the given render target. viewPort is the
         // rectangle in the target that the tilemap should be drawn to, and
         // viewPosition is the center of the view in tile coordinates. Fractional tile
@@ -40,6 +141,37 @@ class Tilemap
                   const sf::Vector2f  &viewPosition,
                   const sf::Vector2u   scale);
 
+        // reloadTilesheet replaces the pixels of the tilesheet and tells listeners
+        // about every tile that uses one of the tiles that changed, so that caches
+        // redraw just those tiles.
+        void reloadTilesheet(const sf::Image &image);
+
+        // addListener registers a listener to be told about tile changes. The
+        // listener is not owned by the tilemap and must be removed before it is
+        // destroyed.
+        void addListener(TilemapListener *listener);
+
+        // removeListener unregisters a listener added with addListener.
+        void removeListener(TilemapListener *listener);
+
+        // getTileSize returns the size of a tile in pixels
+        sf::Vector2u getTileSize() const
+        {
+            return m_tileSize;
+        }
+
+        // getMapSize returns the size of the map in tiles
+        sf::Vector2u getMapSize() const
+        {
+            return m_mapSize;
+        }
+
+        // getLayerCount returns the number of layers in the tilemap
+        sf::Uint32 getLayerCount() const
+        {
+            return m_layers.size();
+        }
+
         // getTilesheet returns a pointer to the tilesheet used by the tilemap.
         Tilesheet *getTilesheet()
         {
@@ -0,0 +1,285 @@
+#include "TilemapLod.hpp"
+#include "Quad.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <spdlog/spdlog.h>
+
+TilemapLod::TilemapLod(Tilemap *tilemap, sf::Uint32 chunkTiles)
+{
+    m_tilemap    = tilemap;
+    m_chunkTiles = std::max(chunkTiles, 1u);
+    m_budget     = 0;
+    m_vertices.setPrimitiveType(sf::Triangles);
+    m_batch.setPrimitiveType(sf::Triangles);
+
+    auto mapSize  = m_tilemap->getMapSize();
+    auto tileSize = m_tilemap->getTileSize();
+
+    m_chunks.x = (mapSize.x + m_chunkTiles - 1) / m_chunkTiles;
+    m_chunks.y = (mapSize.y + m_chunkTiles - 1) / m_chunkTiles;
+
+    // Every level halves the chunk, so the chain ends at the last level where a
+    // chunk is still a whole number of pixels across.
+    sf::Vector2u chunkPx(m_chunkTiles * tileSize.x, m_chunkTiles * tileSize.y);
+    sf::Uint32   levels = 1;
+    while ((chunkPx.x >> levels) << levels == chunkPx.x && (chunkPx.y >> levels) << levels == chunkPx.y &&
+           (chunkPx.x >> levels) > 0 && (chunkPx.y >> levels) > 0)
+    {
+        levels++;
+    }
+
+    // The finest level we can use is the first one whose atlas fits in a texture.
+    // Level 0 would be the map at full resolution, which is never worth caching
+    // since it is no cheaper than drawing the tiles themselves.
+    sf::Uint32 maxSize = sf::Texture::getMaximumSize();
+
+    m_baseLevel = 1;
+    while (m_baseLevel < levels && ((m_chunks.x * chunkPx.x) >> m_baseLevel > maxSize ||
+                                    (m_chunks.y * chunkPx.y) >> m_baseLevel > maxSize))
+    {
+        m_baseLevel++;
+    }
+
+    m_levels.resize(levels);
+
+    spdlog::debug("TilemapLod::TilemapLod: {}x{} chunks, levels {} to {}",
+                  m_chunks.x,
+                  m_chunks.y,
+                  m_baseLevel,
+                  levels - 1);
+
+    m_tilemap->addListener(this);
+}
+
+TilemapLod::~TilemapLod()
+{
+    m_tilemap->removeListener(this);
+}
+
+sf::Vector2u TilemapLod::chunkSize(sf::Uint32 level) const
+{
+    auto tileSize = m_tilemap->getTileSize();
+    return sf::Vector2u((m_chunkTiles * tileSize.x) >> level, (m_chunkTiles * tileSize.y) >> level);
+}
+
+bool TilemapLod::createLevel(sf::Uint32 level)
+{
+    auto &lod = m_levels[level];
+    if (lod.texture) {
+        return true;
+    }
+
+    auto size    = chunkSize(level);
+    auto texture = std::make_unique<sf::RenderTexture>();
+
+    if (!texture->create(m_chunks.x * size.x, m_chunks.y * size.y)) {
+        spdlog::error("TilemapLod::createLevel: failed to create atlas for level {}", level);
+        return false;
+    }
+
+    // smoothing gives us a 2x2 box filter when downsampling one level into the
+    // next, and filters the quads when the level is drawn at a fractional scale
+    texture->setSmooth(true);
+    texture->clear(sf::Color::Transparent);
+    texture->display();
+
+    lod.texture = std::move(texture);
+    lod.chunks.assign(m_chunks.x * m_chunks.y, ChunkState::EMPTY);
+
+    spdlog::debug("TilemapLod::createLevel: created {}x{} atlas for level {}",
+                  m_chunks.x * size.x,
+                  m_chunks.y * size.y,
+                  level);
+
+    return true;
+}
+
+bool TilemapLod::buildChunk(sf::Uint32 level, sf::Uint32 chunk)
+{
+    if (!createLevel(level)) {
+        return false;
+    }
+
+    auto &lod   = m_levels[level];
+    auto  state = lod.chunks[chunk];
+
+    if (state == ChunkState::READY) {
+        return true;
+    }
+
+    // out of budget for this frame; a stale chunk is still better than nothing
+    if (m_budget == 0) {
+        return state != ChunkState::EMPTY;
+    }
+
+    m_budget--;
+
+    // every level but the finest is downsampled from the level above it, so that
+    // one has to be brought up to date first
+    bool fresh = true;
+    if (level != m_baseLevel) {
+        if (!buildChunk(level - 1, chunk)) {
+            return false;
+        }
+
+        fresh = m_levels[level - 1].chunks[chunk] == ChunkState::READY;
+    }
+
+    auto size = chunkSize(level);
+    auto cx   = chunk % m_chunks.x;
+    auto cy   = chunk / m_chunks.x;
+    auto slot = sf::Vector2f(cx * size.x, cy * size.y);
+
+    m_vertices.clear();
+    appendQuad(m_vertices, slot, sf::Vector2f(size), sf::Vector2f(0, 0), sf::Vector2f(0, 0), sf::Color::Transparent);
+    lod.texture->draw(m_vertices, sf::RenderStates(sf::BlendNone));
+
+    if (level == m_baseLevel) {
+        // the finest level is rendered straight from the tiles, shrunk by a transform
+        m_vertices.clear();
+        m_tilemap->appendTiles(m_vertices,
+                               sf::IntRect(cx * m_chunkTiles, cy * m_chunkTiles, m_chunkTiles, m_chunkTiles),
+                               sf::Vector2f(0, 0),
+                               sf::Vector2u(1, 1));
+
+        sf::RenderStates states(&m_tilemap->getTilesheet()->getTexture());
+        states.transform.translate(slot).scale(1.f / (1 << level), 1.f / (1 << level));
+        lod.texture->draw(m_vertices, states);
+    } else {
+        // a 2:1 downsample of a smoothed texture samples each 2x2 block at its centre
+        auto sourceSize = chunkSize(level - 1);
+        m_vertices.clear();
+        appendQuad(m_vertices,
+                   slot,
+                   sf::Vector2f(size),
+                   sf::Vector2f(cx * sourceSize.x, cy * sourceSize.y),
+                   sf::Vector2f(sourceSize));
+        lod.texture->draw(m_vertices, sf::RenderStates(&m_levels[level - 1].texture->getTexture()));
+    }
+
+    lod.texture->display();
+    lod.chunks[chunk] = fresh ? ChunkState::READY : ChunkState::STALE;
+
+    return true;
+}
+
+void TilemapLod::drawTiles(sf::RenderTarget    &target,
+                           const sf::FloatRect &viewPort,
+                           const sf::Vector2f  &viewPosition,
+                           float                zoom)
+{
+    auto tileSize = m_tilemap->getTileSize();
+    auto tilePx   = sf::Vector2f(tileSize.x * zoom, tileSize.y * zoom);
+
+    sf::IntRect area(static_cast<int>(std::floor(viewPosition.x - viewPort.width / 2 / tilePx.x)),
+                     static_cast<int>(std::floor(viewPosition.y - viewPort.height / 2 / tilePx.y)),
+                     static_cast<int>(std::ceil(viewPort.width / tilePx.x)) + 1,
+                     static_cast<int>(std::ceil(viewPort.height / tilePx.y)) + 1);
+
+    m_vertices.clear();
+    m_tilemap->appendTiles(m_vertices, area, sf::Vector2f(0, 0), sf::Vector2u(1, 1));
+
+    sf::RenderStates states(&m_tilemap->getTilesheet()->getTexture());
+    states.transform
+        .translate((area.left - viewPosition.x) * tilePx.x + viewPort.width / 2,
+                   (area.top - viewPosition.y) * tilePx.y + viewPort.height / 2)
+        .scale(zoom, zoom);
+    target.draw(m_vertices, states);
+}
+
+void TilemapLod::draw(sf::RenderTarget    &target,
+                      const sf::FloatRect &viewPort,
+                      const sf::Vector2f  &viewPosition,
+                      float                zoom,
+                      sf::Uint32           rebuildBudget)
+{
+    if (zoom <= 0) {
+        return;
+    }
+
+    // pick the level whose texels are closest to, but no smaller than, a screen pixel
+    auto level = static_cast<sf::Uint32>(std::max(0.f, std::floor(std::log2(1.f / zoom))));
+    level      = std::min(level, static_cast<sf::Uint32>(m_levels.size() - 1));
+
+    if (level < m_baseLevel) {
+        drawTiles(target, viewPort, viewPosition, zoom);
+        return;
+    }
+
+    m_budget = rebuildBudget;
+
+    auto mapSize  = m_tilemap->getMapSize();
+    auto tileSize = m_tilemap->getTileSize();
+    auto tilePx   = sf::Vector2f(tileSize.x * zoom, tileSize.y * zoom);
+    auto texel    = sf::Vector2f(static_cast<float>(tileSize.x) / (1 << level),
+                              static_cast<float>(tileSize.y) / (1 << level));
+    auto size     = chunkSize(level);
+
+    // work out which chunks are under the view
+    sf::Vector2f viewSize(viewPort.width / tilePx.x, viewPort.height / tilePx.y);
+    sf::Vector2f viewStart((viewPosition - viewSize / 2.f) / static_cast<float>(m_chunkTiles));
+    sf::Vector2f viewEnd((viewPosition + viewSize / 2.f) / static_cast<float>(m_chunkTiles));
+
+    auto left   = static_cast<sf::Uint32>(std::clamp(std::floor(viewStart.x), 0.f, static_cast<float>(m_chunks.x)));
+    auto top    = static_cast<sf::Uint32>(std::clamp(std::floor(viewStart.y), 0.f, static_cast<float>(m_chunks.y)));
+    auto right  = static_cast<sf::Uint32>(std::clamp(std::ceil(viewEnd.x), 0.f, static_cast<float>(m_chunks.x)));
+    auto bottom = static_cast<sf::Uint32>(std::clamp(std::ceil(viewEnd.y), 0.f, static_cast<float>(m_chunks.y)));
+
+    m_batch.clear();
+
+    for (sf::Uint32 cy = top; cy < bottom; cy++) {
+        for (sf::Uint32 cx = left; cx < right; cx++) {
+            if (!buildChunk(level, cy * m_chunks.x + cx)) {
+                continue;
+            }
+
+            // chunks on the right and bottom edges may be cut short by the map
+            sf::Vector2f tiles(std::min(m_chunkTiles, mapSize.x - cx * m_chunkTiles),
+                               std::min(m_chunkTiles, mapSize.y - cy * m_chunkTiles));
+
+            sf::Vector2f position((static_cast<float>(cx * m_chunkTiles) - viewPosition.x) * tilePx.x +
+                                      viewPort.width / 2,
+                                  (static_cast<float>(cy * m_chunkTiles) - viewPosition.y) * tilePx.y +
+                                      viewPort.height / 2);
+
+            appendQuad(m_batch,
+                       position,
+                       sf::Vector2f(tiles.x * tilePx.x, tiles.y * tilePx.y),
+                       sf::Vector2f(cx * size.x, cy * size.y),
+                       sf::Vector2f(tiles.x * texel.x, tiles.y * texel.y));
+        }
+    }
+
+    if (m_levels[level].texture) {
+        target.draw(m_batch, sf::RenderStates(&m_levels[level].texture->getTexture()));
+    }
+}
+
+void TilemapLod::invalidate()
+{
+    for (auto &lod : m_levels) {
+        for (auto &state : lod.chunks) {
+            if (state == ChunkState::READY) {
+                state = ChunkState::STALE;
+            }
+        }
+    }
+}
+
+void TilemapLod::onTileChanged(sf::Uint32, const sf::Vector2u &position, sf::Uint32)
+{
+    auto chunk = (position.y / m_chunkTiles) * m_chunks.x + position.x / m_chunkTiles;
+
+    for (auto &lod : m_levels) {
+        if (!lod.chunks.empty() && lod.chunks[chunk] == ChunkState::READY) {
+            lod.chunks[chunk] = ChunkState::STALE;
+        }
+    }
+}
+
+void TilemapLod::onTintChanged(const sf::Vector2u &position)
+{
+    onTileChanged(0, position, 0);
+}
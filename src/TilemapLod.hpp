@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "Tilemap.hpp"
+
+// TilemapLod draws a Tilemap zoomed out below 1:1, where drawing every tile is
+// hopeless once the whole map is on screen.
+//
+// The map is split into square chunks, and each chunk is pre-rendered into a mip
+// chain of textures. Level n holds every chunk at 1/2^n of its full resolution,
+// packed into one atlas per level, so the whole map at any level is drawn with a
+// single batch of one quad per chunk. The finest level that fits in a texture is
+// rendered from the tiles; every coarser level is downsampled from the level
+// above it. Chunks are invalidated lazily when a tile in them changes and are
+// rebuilt, a few per frame, only once they are drawn again.
+class TilemapLod : public TilemapListener
+{
+    private:
+        // state of a chunk in one level of the mip chain
+        enum class ChunkState : sf::Uint8
+        {
+            EMPTY, // never rendered
+            STALE, // rendered, but a tile in it has changed since
+            READY  // up to date
+        };
+
+        struct Level
+        {
+            std::unique_ptr<sf::RenderTexture> texture; // atlas holding every chunk at this level
+            std::vector<ChunkState>            chunks;  // state of each chunk
+        };
+
+        Tilemap           *m_tilemap;    // the tilemap being drawn
+        sf::Uint32         m_chunkTiles; // width and height of a chunk in tiles
+        sf::Vector2u       m_chunks;     // number of chunks across and down the map
+        sf::Uint32         m_baseLevel;  // finest level that fits in a texture
+        std::vector<Level> m_levels;     // mip chain, indexed by level
+        sf::Uint32         m_budget;     // chunk rebuilds left this frame
+        sf::VertexArray    m_vertices;   // scratch vertices for rendering chunks
+        sf::VertexArray    m_batch;      // one quad per visible chunk
+
+        // get the size of a chunk in pixels at the given level
+        sf::Vector2u chunkSize(sf::Uint32 level) const;
+
+        // make sure the atlas for a level exists
+        bool createLevel(sf::Uint32 level);
+
+        // bring a chunk up to date at a level, rebuilding the levels above it as
+        // needed. Returns false if the chunk still has no content to draw.
+        bool buildChunk(sf::Uint32 level, sf::Uint32 chunk);
+
+        // draw the tiles directly with a fractional scale, for zooms that are too
+        // close for the coarsest available level
+        void drawTiles(sf::RenderTarget    &target,
+                       const sf::FloatRect &viewPort,
+                       const sf::Vector2f  &viewPosition,
+                       float                zoom);
+
+    public:
+        TilemapLod(Tilemap *tilemap, sf::Uint32 chunkTiles = 32);
+        ~TilemapLod();
+
+        TilemapLod(const TilemapLod &)            = delete;
+        TilemapLod &operator=(const TilemapLod &) = delete;
+
+        // draw the tilemap at the given zoom, which is the number of screen pixels
+        // per tilesheet pixel and is expected to be below 1. viewPort and
+        // viewPosition have the same meaning as in Tilemap::draw. At most
+        // rebuildBudget chunks are re-rendered per call; chunks still waiting for
+        // their first render are left blank until their turn comes.
+        void draw(sf::RenderTarget    &target,
+                  const sf::FloatRect &viewPort,
+                  const sf::Vector2f  &viewPosition,
+                  float                zoom,
+                  sf::Uint32           rebuildBudget = 64);
+
+        // mark every chunk as stale
+        void invalidate();
+
+        // TilemapListener
+        void onTileChanged(sf::Uint32 layer, const sf::Vector2u &position, sf::Uint32 id) override;
+        void onTintChanged(const sf::Vector2u &position) override;
+};
@@ -1,12 +1,38 @@
 #include "Tilesheet.hpp"
+#include "Quad.hpp"
 #include <SFML/System/Time.hpp>
+#include <cstring>
 #include <spdlog/spdlog.h>
 
 Tilesheet::Tilesheet(const std::string &filename, const sf::Vector2u &tileSize)
 {
     sf::Clock clock;
 
-    m_texture.loadFromFile(filename);
+    if (!m_image.loadFromFile(filename)) {
+        spdlog::error("Tilesheet::Tilesheet: failed to load {}", filename);
+    }
+    create(tileSize);
+
+    spdlog::debug("Loaded Tilesheet from {} with {} tiles in {}ms",
+                  filename,
+                  m_sprites.size(),
+                  clock.getElapsedTime().asMilliseconds());
+}
+
+Tilesheet::Tilesheet(const sf::Image &image, const sf::Vector2u &tileSize)
+{
+    sf::Clock clock;
+
+    m_image = image;
+    create(tileSize);
+
+    spdlog::debug(
+        "Uploaded Tilesheet with {} tiles in {}ms", m_sprites.size(), clock.getElapsedTime().asMilliseconds());
+}
+
+void Tilesheet::create(const sf::Vector2u &tileSize)
+{
+    m_texture.loadFromImage(m_image);
     m_tileSize = tileSize;
     m_sprites.clear();
     m_tilesPerRow = m_texture.getSize().x / tileSize.x;
@@ -22,10 +48,53 @@ Tilesheet::Tilesheet(const std::string &filename, const sf::Vector2u &tileSize)
         }
     }
 
-    spdlog::debug("Loaded Tilesheet from {} with {} tiles in {}ms",
-                  filename,
-                  m_sprites.size(),
-                  clock.getElapsedTime().asMilliseconds());
+    analyse();
+}
+
+void Tilesheet::analyse()
+{
+    const sf::Uint8 *pixels = m_image.getPixelsPtr();
+    sf::Uint32       stride = m_image.getSize().x * 4;
+
+    m_opacity.assign(m_sprites.size(), EMPTY);
+
+    if (pixels == nullptr) {
+        return;
+    }
+
+    sf::Uint32 counts[3] = {0, 0, 0};
+
+    for (sf::Uint32 id = 0; id < m_sprites.size(); id++) {
+        auto rect   = getTileRect(id);
+        bool opaque = true;
+        bool clear  = true;
+
+        // tiles cut from the right or bottom edge of a sheet that is not a whole
+        // number of tiles across are partly outside the image
+        if (rect.left + rect.width > static_cast<int>(m_image.getSize().x) ||
+            rect.top + rect.height > static_cast<int>(m_image.getSize().y))
+        {
+            m_opacity[id] = MIXED;
+            continue;
+        }
+
+        for (int y = rect.top; y < rect.top + rect.height; y++) {
+            const sf::Uint8 *row = pixels + y * stride + rect.left * 4;
+
+            for (int x = 0; x < rect.width; x++) {
+                opaque &= row[x * 4 + 3] == 255;
+                clear  &= row[x * 4 + 3] == 0;
+            }
+        }
+
+        m_opacity[id] = opaque ? SOLID : clear ? EMPTY : MIXED;
+        counts[m_opacity[id]]++;
+    }
+
+    spdlog::debug("Tilesheet::analyse: {} opaque, {} transparent and {} mixed tiles",
+                  counts[SOLID],
+                  counts[EMPTY],
+                  counts[MIXED]);
 }
 
 Tilesheet::~Tilesheet()
@@ -47,6 +116,67 @@ sf::Sprite *Tilesheet::getTile(sf::Uint32 id, sf::Vector2u scale) const
     return sprite;
 }
 
+sf::IntRect Tilesheet::getTileRect(sf::Uint32 id) const
+{
+    return sf::IntRect(
+        (id % m_tilesPerRow) * m_tileSize.x, (id / m_tilesPerRow) * m_tileSize.y, m_tileSize.x, m_tileSize.y);
+}
+
+void Tilesheet::appendTile(sf::VertexArray    &vertices,
+                           sf::Uint32          id,
+                           const sf::Vector2f &position,
+                           const sf::Vector2u  scale,
+                           const sf::Color    &color) const
+{
+    if (id >= m_sprites.size()) {
+        spdlog::error("Tilesheet::appendTile: id out of bounds");
+        return;
+    }
+
+    auto rect = sf::FloatRect(getTileRect(id));
+    auto size = sf::Vector2f(m_tileSize.x * scale.x, m_tileSize.y * scale.y);
+
+    appendQuad(vertices, position, size, rect.getPosition(), rect.getSize(), color);
+}
+
+std::vector<sf::Uint32> Tilesheet::setImage(const sf::Image &image)
+{
+    std::vector<sf::Uint32> changed;
+
+    if (image.getSize() != m_image.getSize()) {
+        spdlog::error("Tilesheet::setImage: image is {}x{} but the tilesheet is {}x{}",
+                      image.getSize().x,
+                      image.getSize().y,
+                      m_image.getSize().x,
+                      m_image.getSize().y);
+        return changed;
+    }
+
+    // compare the tiles row by row to find the ones that were edited
+    const sf::Uint8 *before = m_image.getPixelsPtr();
+    const sf::Uint8 *after  = image.getPixelsPtr();
+    sf::Uint32       stride = m_image.getSize().x * 4;
+
+    for (sf::Uint32 id = 0; id < m_sprites.size(); id++) {
+        auto rect = getTileRect(id);
+
+        for (int y = rect.top; y < rect.top + rect.height; y++) {
+            size_t offset = y * stride + rect.left * 4;
+            if (std::memcmp(before + offset, after + offset, rect.width * 4) != 0) {
+                changed.push_back(id);
+                break;
+            }
+        }
+    }
+
+    m_image = image;
+    m_texture.update(m_image);
+
+    analyse();
+
+    return changed;
+}
+
 void Tilesheet::drawTile(sf::RenderTarget   &target,
                          sf::Uint32          id,
                          const sf::Vector2f &position,
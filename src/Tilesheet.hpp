@@ -9,19 +9,47 @@
 // arranged in a grid within the texture. The constructor takes a filename and
 // a tile size, and the filename is used to load the texture, and the tile size
 // is used to calculate the sub-rectangles for each tile in the texture.
+//
+// The pixels of the tilesheet are kept in memory as well as on the GPU, so that
+// tiles can also be composited on the CPU.
+//
+// Whenever the pixels are loaded, every tile is sorted into fully transparent,
+// fully opaque or a mix of the two, which lets renderers skip tiles that draw
+// nothing and tiles hidden under opaque ones.
 class Tilesheet
 {
+    public:
+        // how much of what is under a tile shows through it
+        enum Opacity : sf::Uint8
+        {
+            EMPTY, // every pixel is fully transparent, so the tile draws nothing
+            MIXED, // some pixels are at least partly transparent
+            SOLID  // every pixel is fully opaque, so the tile hides what is under it
+        };
+
     private:
+        sf::Image                 m_image;
         sf::Texture               m_texture;
         sf::Vector2u              m_tileSize;
         std::vector<sf::Sprite *> m_sprites;
         sf::Uint32                m_tilesPerRow;
+        std::vector<Opacity>      m_opacity; // opacity of each tile
+
+        // upload m_image to the texture and cut it into tiles
+        void create(const sf::Vector2u &tileSize);
+
+        // find the opacity of every tile
+        void analyse();
 
     public:
         // The constructor takes a filename and a tile size. The filename is used to
         // load the texture, and the tile size is used to calculate the sub-rectangles
         // for each tile in the texture.
         Tilesheet(const std::string &filename, const sf::Vector2u &tileSize);
+
+        // This constructor takes an image that has already been decoded, for example
+        // by the AssetLoader, so that only the texture upload happens here.
+        Tilesheet(const sf::Image &image, const sf::Vector2u &tileSize);
         ~Tilesheet();
 
         // The drawTile method takes a render target, an ID, and a position, and draws
@@ -35,6 +63,34 @@ class Tilesheet
         // caller.
         sf::Sprite *getTile(sf::Uint32 id, sf::Vector2u scale) const;
 
+        // getTileRect returns the sub-rectangle of the texture that holds the tile
+        // with the given ID, in pixel coordinates.
+        sf::IntRect getTileRect(sf::Uint32 id) const;
+
+        // appendTile appends the two triangles needed to draw the tile with the given
+        // ID at the given position to a vertex array. This lets callers batch any
+        // number of tiles into a single draw call using the tilesheet texture. The
+        // vertex array must use sf::Triangles, and the position is in pixel
+        // coordinates.
+        void appendTile(sf::VertexArray    &vertices,
+                        sf::Uint32          id,
+                        const sf::Vector2f &position,
+                        const sf::Vector2u  scale,
+                        const sf::Color    &color = sf::Color::White) const;
+
+        // setImage replaces the pixels of the tilesheet, for example after the file
+        // was edited, and uploads them to the texture. The new image must be the
+        // same size as the old one. Returns the IDs of the tiles whose pixels
+        // changed, so that only they need to be redrawn.
+        std::vector<sf::Uint32> setImage(const sf::Image &image);
+
+        // getOpacity returns the opacity of the tile with the given ID. IDs outside the
+        // tilesheet are MIXED, so that drawing them still reports the error.
+        Opacity getOpacity(sf::Uint32 id) const
+        {
+            return id < m_opacity.size() ? m_opacity[id] : MIXED;
+        }
+
         // getTileCount returns the number of tiles in the tilesheet
         sf::Uint32 getTileCount() const
         {
@@ -59,6 +115,12 @@ class Tilesheet
             return m_sprites.size();
         }
 
+        // getImage returns a reference to the pixels of the tilesheet
+        const sf::Image &getImage() const
+        {
+            return m_image;
+        }
+
         // getTexture returns a reference to the texture used by the tilesheet
         const sf::Texture &getTexture() const
         {
@@ -1,17 +1,22 @@
 #include <algorithm>
+#include <cmath>
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
 #include "TilesheetExplorer.hpp"
 
-TilesheetExplorer::TilesheetExplorer(Tilesheet *tilesheet)
+TilesheetExplorer::TilesheetExplorer(Tilesheet *tilesheet, const sf::Font &font)
 {
     m_tilesheet = tilesheet;
     m_viewPos   = sf::Vector2f(-50, -50);
     m_tileSize  = m_tilesheet->getTileSize();
     m_scale     = sf::Vector2u(2, 2);
+    m_valid     = false;
 
-    m_font.loadFromFile("assets/fonts/TerminessNerdFontMono-Regular.ttf");
+    m_marked.resize(m_tilesheet->getTileCount(), false);
+    m_vertices.setPrimitiveType(sf::Triangles);
+
+    m_font = font;
     m_font.setSmooth(true);
     m_text.setFont(m_font);
     m_text.setCharacterSize(24);
@@ -21,6 +26,42 @@ TilesheetExplorer::TilesheetExplorer(Tilesheet *tilesheet)
     spdlog::info("TilesheetExplorer::TilesheetExplorer() initialized");
 }
 
+void TilesheetExplorer::updateVertices(const sf::Vector2u &windowSize)
+{
+    sf::Vector2f tilePx(m_tileSize.x * m_scale.x, m_tileSize.y * m_scale.y);
+    int          columns = m_tilesheet->getTilesPerRow();
+    int          rows    = (m_tilesheet->getTileCount() + columns - 1) / columns;
+
+    // work out which tiles are at least partly inside the window
+    int left   = std::clamp(static_cast<int>(std::floor(m_viewPos.x / tilePx.x)), 0, columns);
+    int top    = std::clamp(static_cast<int>(std::floor(m_viewPos.y / tilePx.y)), 0, rows);
+    int right  = std::clamp(static_cast<int>(std::ceil((m_viewPos.x + windowSize.x) / tilePx.x)), 0, columns);
+    int bottom = std::clamp(static_cast<int>(std::ceil((m_viewPos.y + windowSize.y) / tilePx.y)), 0, rows);
+
+    sf::IntRect visible(left, top, right - left, bottom - top);
+    if (m_valid && visible == m_visible && m_scale == m_builtScale) {
+        return;
+    }
+
+    m_vertices.clear();
+    for (int y = top; y < bottom; y++) {
+        for (int x = left; x < right; x++) {
+            sf::Uint32 id = y * columns + x;
+            if (id >= m_tilesheet->getTileCount()) {
+                break;
+            }
+
+            // marked tiles are shaded red through their vertex colour
+            sf::Color color = m_marked[id] ? sf::Color(255, 128, 128) : sf::Color::White;
+            m_tilesheet->appendTile(m_vertices, id, sf::Vector2f(x * tilePx.x, y * tilePx.y), m_scale, color);
+        }
+    }
+
+    m_visible    = visible;
+    m_builtScale = m_scale;
+    m_valid      = true;
+}
+
 void TilesheetExplorer::run(sf::RenderWindow *window)
 {
     spdlog::info("TilesheetExplorer::run() entered");
@@ -30,10 +71,6 @@ void TilesheetExplorer::run(sf::RenderWindow *window)
     m_mousePos     = sf::Vector2f(0, 0);
     bool mouseDown = false;
 
-    // a vector of selected tiles that we will shade red when the user presses space
-    std::vector<bool> selected_tiles;
-    selected_tiles.resize(m_tilesheet->getTileCount(), false);
-
     while (running) {
         sf::Event event;
 
@@ -55,15 +92,16 @@ void TilesheetExplorer::run(sf::RenderWindow *window)
                     m_scale.x = std::max(m_scale.x - 1, 1u);
                     m_scale.y = std::max(m_scale.y - 1, 1u);
                     break;
-                case sf::Keyboard::Space:
-                    // check if this tile is already selected, we toggle the selection
-                    if (selected_tiles[m_selectedTile.y * m_tilesheet->getTilesPerRow() + m_selectedTile.x]) {
-                        selected_tiles[m_selectedTile.y * m_tilesheet->getTilesPerRow() + m_selectedTile.x] = false;
-                    } else {
-                        selected_tiles[m_selectedTile.y * m_tilesheet->getTilesPerRow() + m_selectedTile.x] = true;
+                case sf::Keyboard::Space: {
+                    // toggle the mark on the tile under the mouse
+                    sf::Uint32 id = m_selectedTile.y * m_tilesheet->getTilesPerRow() + m_selectedTile.x;
+                    if (m_selectedTile.x < m_tilesheet->getTilesPerRow() && id < m_marked.size()) {
+                        m_marked[id] = !m_marked[id];
+                        m_valid      = false;
                     }
 
                     break;
+                }
                 default:
                     break;
                 }
@@ -130,14 +168,14 @@ void TilesheetExplorer::run(sf::RenderWindow *window)
             m_viewPos.y += m_tileSize.y * m_scale.y;
         }
 
+        updateVertices(window->getSize());
+
         window->clear(sf::Color::Black);
 
-        for (sf::Uint32 i = 0; i < m_tilesheet->getTileCount(); i++) {
-            sf::Sprite *tile = m_tilesheet->getTile(i, m_scale);
-            tile->setPosition((i % m_tilesheet->getTilesPerRow()) * m_tileSize.x * m_scale.x - m_viewPos.x,
-                              (i / m_tilesheet->getTilesPerRow()) * m_tileSize.y * m_scale.y - m_viewPos.y);
-            window->draw(*tile);
-        }
+        // every visible tile is drawn in one call, offset by the view position
+        sf::RenderStates states(&m_tilesheet->getTexture());
+        states.transform.translate(-m_viewPos);
+        window->draw(m_vertices, states);
 
         if (m_selected) {
             // if the mouse is not over a tile, display nothing
@@ -155,31 +193,6 @@ void TilesheetExplorer::run(sf::RenderWindow *window)
             }
         }
 
-        window->clear(sf::Color::Black);
-
-        for (sf::Uint32 i = 0; i < m_tilesheet->getTileCount(); i++) {
-            sf::Sprite *tile = m_tilesheet->getTile(i, m_scale);
-            tile->setPosition((i % m_tilesheet->getTilesPerRow()) * m_tileSize.x * m_scale.x - m_viewPos.x,
-                              (i / m_tilesheet->getTilesPerRow()) * m_tileSize.y * m_scale.y - m_viewPos.y);
-            window->draw(*tile);
-        }
-
-        // shade the selected tiles red
-        for (sf::Uint32 i = 0; i < m_tilesheet->getTileCount(); i++) {
-            sf::Sprite *tile = m_tilesheet->getTile(i, m_scale);
-            tile->setPosition((i % m_tilesheet->getTilesPerRow()) * m_tileSize.x * m_scale.x - m_viewPos.x,
-                              (i / m_tilesheet->getTilesPerRow()) * m_tileSize.y * m_scale.y - m_viewPos.y);
-            if (selected_tiles[i]) {
-                // tile needs to be 50% opaque
-                tile->setColor(sf::Color(255, 0, 0, 128));
-            } else {
-                // tile needs to be completely transparent
-                tile->setColor(sf::Color::White);
-            }
-
-            window->draw(*tile);
-        }
-
         // draw a black rectangle to hold the text
         sf::RectangleShape rect(sf::Vector2f(400, 50));
         rect.setFillColor(sf::Color::Black);
@@ -10,20 +10,30 @@
 class TilesheetExplorer
 {
     private:
-        Tilesheet   *m_tilesheet;    // the tilesheet
-        sf::Vector2f m_viewPos;      // position of the view
-        sf::Vector2u m_tileSize;     // size of the tiles
-        sf::Vector2u m_selectedTile; // selected tile
-        bool         m_selected;     // true if a tile is selected
-        sf::Vector2u m_scale;        // scale of the tiles
-        sf::Font     m_font;         // font for the text
-        sf::Text     m_text;         // text for the selected tile
-        sf::Vector2f m_mousePos;     // position of the mouse
-        sf::Vector2f m_lastMousePos; // last position of the mouse
+        Tilesheet        *m_tilesheet;    // the tilesheet
+        sf::Vector2f      m_viewPos;      // position of the view
+        sf::Vector2u      m_tileSize;     // size of the tiles
+        sf::Vector2u      m_selectedTile; // selected tile
+        bool              m_selected;     // true if a tile is selected
+        sf::Vector2u      m_scale;        // scale of the tiles
+        sf::Font          m_font;         // font for the text
+        sf::Text          m_text;         // text for the selected tile
+        sf::Vector2f      m_mousePos;     // position of the mouse
+        sf::Vector2f      m_lastMousePos; // last position of the mouse
+        std::vector<bool> m_marked;       // tiles marked with space, shaded red
+        sf::VertexArray   m_vertices;     // the visible tiles, in sheet pixel coordinates
+        sf::IntRect       m_visible;      // tiles held in m_vertices
+        sf::Vector2u      m_builtScale;   // scale m_vertices was built at
+        bool              m_valid;        // false if m_vertices must be rebuilt
+
+        // rebuild the vertex array if the tiles visible in a window of the given size
+        // or their scale changed since it was last built. Panning within a tile only
+        // moves the view transform, so it costs nothing.
+        void updateVertices(const sf::Vector2u &windowSize);
 
     public:
-        TilesheetExplorer(Tilesheet *tilesheet);
+        TilesheetExplorer(Tilesheet *tilesheet, const sf::Font &font);
         ~TilesheetExplorer() = default;
 
         void run(sf::RenderWindow *window); // run the tilesheet explorer
-};
\ No newline at end of file
+};
@@ -0,0 +1,454 @@
+#include "WfcGenerator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+#include <SFML/System/Clock.hpp>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+
+// sides of a cell, in the order of the compatibility tables and edge masks
+const int offsetsX[4] = {0, -1, 1, 0};
+const int offsetsY[4] = {-1, 0, 0, 1};
+
+// the cells of a pattern on each side: the top row, left column, right column and
+// bottom row
+const sf::Uint16 sideMasks[4] = {0x007, 0x049, 0x124, 0x1c0};
+
+bool isOpen(sf::Uint16 pattern, int x, int y)
+{
+    return pattern >> (y * 3 + x) & 1;
+}
+
+// check that pattern b, placed on side d of pattern a, agrees with a where they
+// overlap
+bool overlaps(sf::Uint16 a, sf::Uint16 b, int d)
+{
+    for (int y = 0; y < 3; y++) {
+        for (int x = 0; x < 3; x++) {
+            int bx = x - offsetsX[d];
+            int by = y - offsetsY[d];
+
+            if (bx >= 0 && bx < 3 && by >= 0 && by < 3 && isOpen(a, x, y) != isOpen(b, bx, by)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+} // namespace
+
+WfcGenerator::WfcGenerator()
+{
+    m_margin      = 1;
+    m_repairs     = 1000;
+    m_restarts    = 4;
+    m_radius      = 2;
+    m_words       = 0;
+    m_size        = sf::Vector2u(0, 0);
+    m_lowest      = 0;
+    m_bucketScale = 0;
+    m_buckets.resize(256);
+}
+
+sf::Uint32 WfcGenerator::learn(const std::vector<RoomShape> &prefabs)
+{
+    // every 3x3 window of two kinds of cell is one of 512 patterns, so they can
+    // be counted in a table, kept on the stack since this runs for every maze
+    std::array<sf::Uint32, 512> counts = {};
+    int                         margin = m_margin;
+
+    for (const auto &prefab : prefabs) {
+        int width  = prefab.getSize().x;
+        int height = prefab.getSize().y;
+
+        auto isOpenAt = [&](int x, int y) {
+            return x >= 0 && y >= 0 && x < width && y < height &&
+                   !prefab.isCell(sf::Vector2u(x, y), Cell::WALL);
+        };
+
+        // windows are centred on every cell of the prefab and its margin, and
+        // anything past the margin counts as wall too
+        for (int y = -margin; y < height + margin; y++) {
+            for (int x = -margin; x < width + margin; x++) {
+                sf::Uint16 pattern = 0;
+                for (int j = 0; j < 3; j++) {
+                    for (int i = 0; i < 3; i++) {
+                        pattern |= isOpenAt(x + i - 1, y + j - 1) << (j * 3 + i);
+                    }
+                }
+
+                counts[pattern]++;
+            }
+        }
+    }
+
+    // solid rock is always allowed, so that the edges of the map can be closed
+    // even without prefabs
+    counts[0] = std::max<sf::Uint32>(counts[0], 1);
+
+    m_patterns.clear();
+    m_weights.clear();
+    m_weightLogs.clear();
+
+    for (sf::Uint32 pattern = 0; pattern < counts.size(); pattern++) {
+        if (counts[pattern] > 0) {
+            m_patterns.push_back(pattern);
+            m_weights.push_back(counts[pattern]);
+            m_weightLogs.push_back(counts[pattern] * std::log(static_cast<double>(counts[pattern])));
+        }
+    }
+
+    sf::Uint32 count = m_patterns.size();
+    m_words          = (count + 63) / 64;
+
+    m_compatible.assign(count * 4 * m_words, 0);
+    m_edges.assign(4 * m_words, 0);
+    m_allowed.assign(m_words, 0);
+
+    // no cell has more entropy than one with every pattern equally likely
+    m_bucketScale = (m_buckets.size() - 1) / std::max(std::log(static_cast<double>(count)), 1.0);
+
+    for (sf::Uint32 a = 0; a < count; a++) {
+        for (int d = 0; d < 4; d++) {
+            auto *compatible = &m_compatible[(a * 4 + d) * m_words];
+            for (sf::Uint32 b = 0; b < count; b++) {
+                if (overlaps(m_patterns[a], m_patterns[b], d)) {
+                    compatible[b / 64] |= 1ull << (b % 64);
+                }
+            }
+
+            // on an edge of the map, the side of the pattern past the edge is wall
+            if ((m_patterns[a] & sideMasks[d]) == 0) {
+                m_edges[d * m_words + a / 64] |= 1ull << (a % 64);
+            }
+        }
+    }
+
+    // the size is kept, but the domains have to be made again for the new patterns
+    m_size = sf::Vector2u(0, 0);
+
+    spdlog::debug("WfcGenerator::learn: learned {} patterns from {} prefabs", count, prefabs.size());
+
+    return count;
+}
+
+bool WfcGenerator::generate(const sf::Vector2u &size, sf::Uint32 seed)
+{
+    sf::Clock clock;
+
+    if (m_patterns.empty()) {
+        spdlog::error("WfcGenerator::generate: no patterns have been learned");
+        return false;
+    }
+
+    if (size != m_size) {
+        size_t cells = static_cast<size_t>(size.x) * size.y;
+
+        m_size = size;
+        m_domains.assign(cells * m_words, 0);
+        m_counts.assign(cells, 0);
+        m_sums.assign(cells, 0);
+        m_sumLogs.assign(cells, 0);
+    }
+
+    // each restart gets a seed of its own, derived from the one given
+    for (sf::Uint32 restart = 0; restart <= m_restarts; restart++) {
+        if (attempt(seed + restart * 0x9e3779b9u)) {
+            spdlog::debug("WfcGenerator::generate: generated {}x{} after {} restarts in {}ms",
+                          size.x,
+                          size.y,
+                          restart,
+                          clock.getElapsedTime().asMilliseconds());
+            return true;
+        }
+
+        spdlog::warn("WfcGenerator::generate: seed {} ran out of repairs, restarting", seed);
+    }
+
+    spdlog::error("WfcGenerator::generate: gave up on seed {} after {} restarts", seed, m_restarts);
+
+    return false;
+}
+
+bool WfcGenerator::attempt(sf::Uint32 seed)
+{
+    m_gen.seed(seed);
+    m_worklist.clear();
+    m_lowest = m_buckets.size();
+
+    for (auto &bucket : m_buckets) {
+        bucket.clear();
+    }
+
+    resetCells(sf::IntRect(0, 0, m_size.x, m_size.y));
+
+    if (propagate() >= 0) {
+        spdlog::error("WfcGenerator::attempt: the learned patterns cannot fill the edges of the map");
+        return false;
+    }
+
+    sf::Uint32 repairs = 0;
+
+    while (m_lowest < m_buckets.size()) {
+        auto &bucket = m_buckets[m_lowest];
+        if (bucket.empty()) {
+            m_lowest++;
+            continue;
+        }
+
+        Entry entry = bucket.back();
+        bucket.pop_back();
+
+        // cells are pushed again each time they narrow, so older entries are stale
+        if (entry.count != m_counts[entry.cell] || entry.count <= 1) {
+            continue;
+        }
+
+        collapse(entry.cell);
+
+        // clear the square around a contradiction and fill it in again from its
+        // surroundings, clearing a bigger square each time that fails in a row
+        sf::Int64 failed = propagate();
+        int       radius = m_radius;
+
+        while (failed >= 0) {
+            if (++repairs > m_repairs) {
+                return false;
+            }
+
+            int         x = failed % m_size.x;
+            int         y = failed / m_size.x;
+            sf::IntRect rect(x - radius, y - radius, radius * 2 + 1, radius * 2 + 1);
+            sf::IntRect area;
+            rect.intersects(sf::IntRect(0, 0, m_size.x, m_size.y), area);
+
+            resetCells(area);
+
+            // the cells around the square narrow it down again
+            for (int ry = area.top - 1; ry <= area.top + area.height; ry++) {
+                for (int rx = area.left - 1; rx <= area.left + area.width; rx++) {
+                    bool inside = rx >= 0 && ry >= 0 && rx < static_cast<int>(m_size.x) &&
+                                  ry < static_cast<int>(m_size.y);
+                    bool ring   = !area.contains(rx, ry);
+
+                    if (inside && ring) {
+                        m_worklist.push_back(ry * m_size.x + rx);
+                    }
+                }
+            }
+
+            failed = propagate();
+            radius = std::min<int>(radius * 2, std::max(m_size.x, m_size.y));
+        }
+    }
+
+    if (repairs > 0) {
+        spdlog::debug("WfcGenerator::attempt: repaired {} contradictions", repairs);
+    }
+
+    return true;
+}
+
+void WfcGenerator::resetCells(const sf::IntRect &rect)
+{
+    sf::Uint32 count = m_patterns.size();
+
+    for (int y = rect.top; y < rect.top + rect.height; y++) {
+        for (int x = rect.left; x < rect.left + rect.width; x++) {
+            sf::Uint32  cell   = y * m_size.x + x;
+            sf::Uint64 *domain = getDomain(cell);
+
+            // every pattern, then only those that close off any edges of the map
+            // the cell is on
+            for (size_t w = 0; w < m_words; w++) {
+                domain[w] = w + 1 < m_words || count % 64 == 0 ? ~0ull : (1ull << (count % 64)) - 1;
+            }
+
+            bool edges[4] = {y == 0, x == 0, x + 1 == static_cast<int>(m_size.x), y + 1 == static_cast<int>(m_size.y)};
+            bool onEdge   = false;
+
+            for (int d = 0; d < 4; d++) {
+                if (edges[d]) {
+                    onEdge = true;
+                    for (size_t w = 0; w < m_words; w++) {
+                        domain[w] &= m_edges[d * m_words + w];
+                    }
+                }
+            }
+
+            m_counts[cell]  = 0;
+            m_sums[cell]    = 0;
+            m_sumLogs[cell] = 0;
+
+            for (size_t w = 0; w < m_words; w++) {
+                for (sf::Uint64 bits = domain[w]; bits != 0; bits &= bits - 1) {
+                    sf::Uint32 pattern = w * 64 + std::countr_zero(bits);
+                    m_counts[cell]++;
+                    m_sums[cell]    += m_weights[pattern];
+                    m_sumLogs[cell] += m_weightLogs[pattern];
+                }
+            }
+
+            if (onEdge) {
+                m_worklist.push_back(cell);
+            }
+
+            if (m_counts[cell] > 1) {
+                push(cell);
+            }
+        }
+    }
+}
+
+void WfcGenerator::push(sf::Uint32 cell)
+{
+    double     sum     = m_sums[cell];
+    double     entropy = std::log(sum) - m_sumLogs[cell] / sum;
+    sf::Uint32 bucket  = std::clamp(entropy * m_bucketScale, 0.0, m_buckets.size() - 1.0);
+
+    m_buckets[bucket].push_back(Entry{cell, m_counts[cell]});
+    m_lowest = std::min(m_lowest, bucket);
+}
+
+bool WfcGenerator::narrow(sf::Uint32 cell, const sf::Uint64 *mask)
+{
+    sf::Uint64 *domain  = getDomain(cell);
+    bool        changed = false;
+
+    for (size_t w = 0; w < m_words; w++) {
+        sf::Uint64 removed = domain[w] & ~mask[w];
+        if (removed == 0) {
+            continue;
+        }
+
+        changed    = true;
+        domain[w] &= mask[w];
+
+        for (; removed != 0; removed &= removed - 1) {
+            sf::Uint32 pattern = w * 64 + std::countr_zero(removed);
+            m_counts[cell]--;
+            m_sums[cell]    -= m_weights[pattern];
+            m_sumLogs[cell] -= m_weightLogs[pattern];
+        }
+    }
+
+    if (!changed) {
+        return true;
+    }
+
+    if (m_counts[cell] == 0) {
+        return false;
+    }
+
+    m_worklist.push_back(cell);
+
+    if (m_counts[cell] > 1) {
+        push(cell);
+    }
+
+    return true;
+}
+
+sf::Int64 WfcGenerator::propagate()
+{
+    while (!m_worklist.empty()) {
+        sf::Uint32 cell = m_worklist.back();
+        m_worklist.pop_back();
+
+        int               x      = cell % m_size.x;
+        int               y      = cell / m_size.x;
+        const sf::Uint64 *domain = getDomain(cell);
+
+        for (int d = 0; d < 4; d++) {
+            int nx = x + offsetsX[d];
+            int ny = y + offsetsY[d];
+
+            if (nx < 0 || ny < 0 || nx >= static_cast<int>(m_size.x) || ny >= static_cast<int>(m_size.y)) {
+                continue;
+            }
+
+            // a neighbour keeps the patterns that some pattern of this cell allows
+            std::fill(m_allowed.begin(), m_allowed.end(), 0);
+
+            for (size_t w = 0; w < m_words; w++) {
+                for (sf::Uint64 bits = domain[w]; bits != 0; bits &= bits - 1) {
+                    const sf::Uint64 *compatible = getCompatible(w * 64 + std::countr_zero(bits), d);
+                    for (size_t i = 0; i < m_words; i++) {
+                        m_allowed[i] |= compatible[i];
+                    }
+                }
+            }
+
+            sf::Uint32 neighbour = ny * m_size.x + nx;
+            if (!narrow(neighbour, m_allowed.data())) {
+                m_worklist.clear();
+                return neighbour;
+            }
+        }
+    }
+
+    return -1;
+}
+
+void WfcGenerator::collapse(sf::Uint32 cell)
+{
+    // the draw is made from the raw generator, as the standard distributions are
+    // not the same everywhere and the map must be
+    const sf::Uint64 *domain = getDomain(cell);
+    double            target = m_gen() * 0x1p-32 * m_sums[cell];
+    sf::Uint32        chosen = 0;
+
+    for (size_t w = 0; w < m_words && target >= 0; w++) {
+        for (sf::Uint64 bits = domain[w]; bits != 0 && target >= 0; bits &= bits - 1) {
+            chosen  = w * 64 + std::countr_zero(bits);
+            target -= m_weights[chosen];
+        }
+    }
+
+    std::fill(m_allowed.begin(), m_allowed.end(), 0);
+    m_allowed[chosen / 64] = 1ull << (chosen % 64);
+
+    // the cell always keeps the chosen pattern, so this cannot fail
+    narrow(cell, m_allowed.data());
+}
+
+void WfcGenerator::getCells(GridView<Cell> cells) const
+{
+    if (cells.getSize() != m_size) {
+        spdlog::error("WfcGenerator::getCells: cells are {}x{} but the map is {}x{}",
+                      cells.getSize().x,
+                      cells.getSize().y,
+                      m_size.x,
+                      m_size.y);
+        return;
+    }
+
+    for (sf::Uint32 y = 0; y < m_size.y; y++) {
+        auto row = cells.row(y);
+
+        for (sf::Uint32 x = 0; x < m_size.x; x++) {
+            sf::Uint32 cell = y * m_size.x + x;
+            Cell       type = Cell::WALL;
+
+            // cells are open if the centre of their pattern is, and cells an attempt
+            // gave up on are left as wall
+            if (m_counts[cell] == 1) {
+                const sf::Uint64 *domain = getDomain(cell);
+                for (size_t w = 0; w < m_words; w++) {
+                    if (domain[w] != 0 && isOpen(m_patterns[w * 64 + std::countr_zero(domain[w])], 1, 1)) {
+                        type = Cell::ROOM;
+                    }
+                }
+            }
+
+            row[x] = type;
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <random>
+#include <vector>
+
+#include <SFML/Config.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/System/Vector2.hpp>
+
+#include "Cell.hpp"
+#include "GridView.hpp"
+#include "RoomShape.hpp"
+
+// WfcGenerator lays out levels with the overlapping model of Wave Function
+// Collapse, learning the local structure of hand-made RoomShape prefabs and
+// producing a map that looks like them everywhere. Maze::generateWfc runs it with
+// the prefabs of the maze and connects the rooms it made.
+//
+// Every 3x3 window of the prefabs, each surrounded by a margin of wall, is a
+// pattern, weighted by how often it appears. Each cell of the map starts able to
+// be any pattern, as a bitset of them, and the cell with the lowest entropy is
+// collapsed to one pattern at a time. Collapsing a cell removes the patterns of
+// its neighbours that do not overlap it consistently, which is propagated from a
+// worklist using tables of the patterns each pattern allows on each side, so a
+// step is a few word-wide ORs and ANDs. The next cell comes from a bucket queue of
+// entropies, rounded to 256 levels: pushing a cell is an append, the last cell
+// pushed to the lowest bucket is taken next, which keeps collapsing near the cells
+// just narrowed and so in cache, and stale entries are skipped when taken.
+//
+// A cell left with no patterns is a contradiction. The square around it is
+// cleared and filled in again, growing each time it fails again, up to a repair
+// budget, after which the whole map is restarted with a new seed, up to a limit.
+// Everything is driven by the seed, so the same seed always gives the same map.
+class WfcGenerator
+{
+    private:
+        // an entry in a bucket of the entropy queue
+        struct Entry
+        {
+            sf::Uint32 cell;  // index of the cell
+            sf::Uint32 count; // patterns the cell had left, to spot stale entries
+        };
+
+        sf::Uint32                      m_margin;      // walls around each prefab when learning patterns
+        sf::Uint32                      m_repairs;     // contradictions repaired before restarting
+        sf::Uint32                      m_restarts;    // restarts before giving up
+        sf::Uint32                      m_radius;      // radius of the first square cleared by a repair
+        std::vector<sf::Uint16>         m_patterns;    // 3x3 patterns, bit j * 3 + i set if cell (i, j) is open
+        std::vector<double>             m_weights;     // how often each pattern appeared
+        std::vector<double>             m_weightLogs;  // weight * log(weight) of each pattern
+        size_t                          m_words;       // 64-bit words in a bitset of patterns
+        std::vector<sf::Uint64>         m_compatible;  // patterns allowed on each side of each pattern
+        std::vector<sf::Uint64>         m_edges;       // patterns allowed on each edge of the map
+        sf::Vector2u                    m_size;        // size of the map
+        std::vector<sf::Uint64>         m_domains;     // patterns each cell can still be
+        std::vector<sf::Uint16>         m_counts;      // number of patterns each cell can still be
+        std::vector<double>             m_sums;        // sum of the weights of each cell's patterns
+        std::vector<double>             m_sumLogs;     // sum of weight * log(weight) of each cell's patterns
+        std::vector<std::vector<Entry>> m_buckets;     // cells to collapse, by rounded entropy
+        sf::Uint32                      m_lowest;      // no bucket below this has entries
+        double                          m_bucketScale; // buckets per unit of entropy
+        std::vector<sf::Uint32>         m_worklist;    // cells whose domains changed, to propagate from
+        std::vector<sf::Uint64>         m_allowed;     // patterns allowed next to the cell being propagated
+        std::mt19937                    m_gen;         // random numbers for the current attempt
+
+        sf::Uint64 *getDomain(sf::Uint32 cell)
+        {
+            return &m_domains[cell * m_words];
+        }
+
+        const sf::Uint64 *getDomain(sf::Uint32 cell) const
+        {
+            return &m_domains[cell * m_words];
+        }
+
+        // get the patterns that may be on side d of pattern p
+        const sf::Uint64 *getCompatible(sf::Uint32 p, int d) const
+        {
+            return &m_compatible[(p * 4 + d) * m_words];
+        }
+
+        // queue a cell to be collapsed, by its entropy
+        void push(sf::Uint32 cell);
+
+        // give cells in the rectangle every pattern allowed where they are
+        void resetCells(const sf::IntRect &rect);
+
+        // narrow a cell to the patterns in mask, returning false if none are left
+        bool narrow(sf::Uint32 cell, const sf::Uint64 *mask);
+
+        // propagate from the cells on the worklist, returning the first cell left
+        // with no patterns, or -1
+        sf::Int64 propagate();
+
+        // collapse one cell to a random pattern, weighted by how common it is
+        void collapse(sf::Uint32 cell);
+
+        // run one attempt at filling the map, returning false if it ran out of repairs
+        bool attempt(sf::Uint32 seed);
+
+    public:
+        WfcGenerator();
+        ~WfcGenerator() = default;
+
+        // set the number of wall cells around each prefab when learning from it,
+        // which sets how far apart the rooms of the map are
+        void setMargin(sf::Uint32 margin)
+        {
+            m_margin = margin;
+        }
+
+        sf::Uint32 getMargin() const
+        {
+            return m_margin;
+        }
+
+        // set the number of contradictions repaired before an attempt is abandoned
+        void setRepairs(sf::Uint32 repairs)
+        {
+            m_repairs = repairs;
+        }
+
+        sf::Uint32 getRepairs() const
+        {
+            return m_repairs;
+        }
+
+        // set the number of times the map is restarted after running out of repairs
+        void setRestarts(sf::Uint32 restarts)
+        {
+            m_restarts = restarts;
+        }
+
+        sf::Uint32 getRestarts() const
+        {
+            return m_restarts;
+        }
+
+        // learn the patterns of a set of prefabs, replacing any learned before.
+        // Returns the number of patterns.
+        sf::Uint32 learn(const std::vector<RoomShape> &prefabs);
+
+        // fill a map of the given size with the learned patterns. Returns false if
+        // every attempt ran out of repairs, which leaves the cells that could not be
+        // decided as walls.
+        bool generate(const sf::Vector2u &size, sf::Uint32 seed);
+
+        // write the map to cells of the same size, WALL for walls and ROOM for the rest
+        void getCells(GridView<Cell> cells) const;
+};
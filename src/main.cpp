@@ -1,25 +1,199 @@
+#include <SFML/Graphics/RenderTexture.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Window/Event.hpp>
+#include <algorithm>
 #include <cstdio>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
+#include "AssetLoader.hpp"
+#include "AssetWatcher.hpp"
 #include "Autotile.hpp"
+#include "ChangeJournal.hpp"
+#include "EntityStore.hpp"
+#include "FrameTimes.hpp"
+#include "InputLog.hpp"
+#include "LightMap.hpp"
 #include "Maze.hpp"
+#include "MessageLog.hpp"
+#include "Minimap.hpp"
+#include "ScrollCache.hpp"
+#include "SoftwareCompositor.hpp"
+#include "TextRenderer.hpp"
 #include "Tilemap.hpp"
 #include "Tilesheet.hpp"
+#include "TilemapLod.hpp"
 #include "TilesheetExplorer.hpp"
 
-int main()
+namespace
+{
+
+// collect the input for a frame from the window
+InputFrame pollInput(sf::RenderWindow &window, sf::Time time)
+{
+    InputFrame input;
+    input.time  = time.asMicroseconds();
+    input.mouse = sf::Mouse::getPosition(window);
+    input.keys  = 0;
+
+    sf::Event event;
+    while (window.pollEvent(event)) {
+        switch (event.type) {
+        case sf::Event::Closed:
+            input.events.push_back(InputEvent{InputEvent::Type::CLOSED, 0, 0});
+            break;
+        case sf::Event::KeyPressed:
+            input.events.push_back(InputEvent{InputEvent::Type::KEY_PRESSED, event.key.code, 0});
+            break;
+        case sf::Event::MouseWheelScrolled:
+            input.events.push_back(InputEvent{InputEvent::Type::MOUSE_WHEEL, 0, event.mouseWheelScroll.delta});
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
+        input.keys |= InputFrame::UP;
+    }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
+        input.keys |= InputFrame::DOWN;
+    }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
+        input.keys |= InputFrame::LEFT;
+    }
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
+        input.keys |= InputFrame::RIGHT;
+    }
+
+    return input;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
 {
     spdlog::info("starting quantum ...");
 
     // configure spdlog debug mode
     spdlog::set_level(spdlog::level::debug);
 
-    Tilemap tilemap("assets/RogueEnvironment16x16.png", sf::Vector2u(16, 16), sf::Vector2u(200, 200), 1);
+    // time to first frame is the startup cost players actually see
+    sf::Clock startupClock;
+
+    // --record saves the seed, window size and input of a run, and --replay plays
+    // it back as fast as it will draw and reports the frame times, so rendering
+    // changes can be compared on exactly the same run
+    cxxopts::Options options("quantum", "A 2d Rogue-like game");
+
+    // clang-format off
+    options.add_options()
+        ("seed", "seed to generate the maze with", cxxopts::value<sf::Uint32>()->default_value("1000"))
+        ("record", "record the seed, window size and input to a file", cxxopts::value<std::string>())
+        ("replay", "replay a recording and report frame times", cxxopts::value<std::string>())
+        ("headless", "replay into an offscreen texture instead of a window")
+        ("h,help", "show this help");
+    // clang-format on
+
+    sf::Uint32   seed;
+    sf::Vector2u windowSize(1920, 1028);
+    std::string  recordFile;
+    bool         replaying;
+    bool         headless;
+    InputLog     inputLog;
+
+    try {
+        auto args = options.parse(argc, argv);
+
+        if (args.count("help")) {
+            fmt::print("{}\n", options.help());
+            return EXIT_SUCCESS;
+        }
+
+        seed      = args["seed"].as<sf::Uint32>();
+        replaying = args.count("replay") > 0;
+        headless  = args.count("headless") > 0;
+
+        if (args.count("record")) {
+            recordFile = args["record"].as<std::string>();
+        }
+
+        if (replaying && !inputLog.load(args["replay"].as<std::string>())) {
+            return EXIT_FAILURE;
+        }
+    } catch (const std::exception &e) {
+        spdlog::error("{}", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if (headless && !replaying) {
+        spdlog::error("--headless needs a recording to --replay");
+        return EXIT_FAILURE;
+    }
+
+    if (replaying) {
+        seed       = inputLog.getSeed();
+        windowSize = inputLog.getWindowSize();
+    } else {
+        inputLog.setSeed(seed);
+        inputLog.setWindowSize(windowSize);
+    }
+
+    const std::string tilesheetFile = "assets/RogueEnvironment16x16.png";
+    const std::string fontFile      = "assets/fonts/TerminessNerdFontMono-Regular.ttf";
+
+    // every asset is read and decoded in parallel up front; the GPU uploads
+    // happen below as the objects using them are created
+    AssetLoader loader;
+    loader.addImage(tilesheetFile);
+    loader.addFont(fontFile);
+
+    std::vector<std::string> prefabFiles;
+    std::error_code          prefabError;
+    for (const auto &entry : std::filesystem::directory_iterator("assets/prefabs", prefabError)) {
+        if (entry.path().extension() == ".txt") {
+            prefabFiles.push_back(entry.path().string());
+            loader.addPrefab(prefabFiles.back());
+        }
+    }
+
+    loader.load();
+    loader.pruneCache();
+
+    const sf::Image *tilesheetImage = loader.getImage(tilesheetFile);
+    if (tilesheetImage == nullptr) {
+        spdlog::error("failed to load {}", tilesheetFile);
+        return EXIT_FAILURE;
+    }
+
+    const sf::Font *font = loader.getFont(fontFile);
+    if (font == nullptr) {
+        spdlog::error("failed to load {}", fontFile);
+        return EXIT_FAILURE;
+    }
+
+    Tilemap tilemap(*tilesheetImage, sf::Vector2u(16, 16), sf::Vector2u(200, 200), 1);
 
     Maze maze(sf::Vector2u(200, 200));
-    maze.generate(1000);
+
+    // edits to the tilesheet and the prefab rooms show up without restarting.
+    // Reloaded prefabs are used by the next maze generated.
+    AssetWatcher assets;
+    assets.watchTilesheet(tilesheetFile, &tilemap);
+
+    for (const auto &filename : prefabFiles) {
+        const RoomShape *prefab = loader.getPrefab(filename);
+        if (prefab == nullptr) {
+            continue;
+        }
+
+        sf::Uint32 index = maze.addPrefab(*prefab);
+        assets.watchPrefab(filename, [&maze, index](const RoomShape &shape) { maze.setPrefab(index, shape); });
+    }
+
+    maze.generate(seed);
 
     spdlog::info("maze generated");
 
@@ -27,6 +201,17 @@ int main()
     Autotile autotile(&maze, &tilemap);
     autotile.render();
 
+    // edits to the level are autosaved as they happen, and recovered on the next
+    // start. Recordings must start from the seeded maze, so they do not recover.
+    ChangeJournal journal("saves/level", &maze, &tilemap);
+    bool          recovered = false;
+    if (recordFile.empty() && !replaying) {
+        recovered = journal.open();
+    }
+
+    // monsters, items and projectiles live in the entity store on top of the map
+    EntityStore entities(maze.getSize());
+
     // print current working directory using C++ standard library
     char cwd[1024];
     if (getcwd(cwd, sizeof(cwd)) != nullptr) {
@@ -35,60 +220,212 @@ int main()
         spdlog::error("getcwd() failed");
     }
 
-    sf::RenderWindow window(sf::VideoMode(1920, 1028), "Quantum");
-    window.setFramerateLimit(120);
+    // replays draw as fast as they can, since the frame times are what they measure
+    sf::RenderWindow  window;
+    sf::RenderTexture offscreen;
+
+    if (headless) {
+        offscreen.create(windowSize.x, windowSize.y);
+    } else {
+        window.create(sf::VideoMode(windowSize.x, windowSize.y), "Quantum");
+        window.setFramerateLimit(replaying ? 0 : 120);
+    }
+
+    sf::RenderTarget &target = headless ? static_cast<sf::RenderTarget &>(offscreen) : window;
 
     sf::Vector2f      viewPosition(0, 0);
     sf::Vector2f      viewDesiredPosition(0, 0);
     float             viewSpeed = 0.1;
-    TilesheetExplorer explorer(tilemap.getTilesheet());
+    TilesheetExplorer explorer(tilemap.getTilesheet(), *font);
+
+    // the scroll cache only redraws tiles that scroll into view; F2 toggles it off
+    // to compare against drawing every visible tile each frame
+    ScrollCache scrollCache(&tilemap);
+    bool        useScrollCache = true;
+
+    // zoom is in screen pixels per tilesheet pixel. Integer zooms draw the tiles,
+    // and zooming out below 1 switches to the chunk level of detail renderer.
+    TilemapLod lod(&tilemap);
+    float      zoom = 2;
+
+    // the minimap reveals the maze as the view passes over it
+    Minimap minimap(&maze);
+
+    // the maze is lit by a torch carried at the centre of the screen
+    LightMap lights(&maze);
+    LightId  torch = lights.addLight(sf::Vector2u(0, 0), sf::Color(255, 180, 100), 12);
+
+    // F12 exports the whole map, as it is currently lit, without going through the GPU
+    SoftwareCompositor compositor(&tilemap);
+
+    // the HUD and the message log are drawn together as one batch of glyphs.
+    // Page Up and Page Down scroll the log.
+    TextRenderer text(font, 16);
+    MessageLog   messages;
+    // a recovered level has no rooms recorded, so it is not described by its seed
+    if (recovered) {
+        messages.add("Welcome back to quantum. Your saved level was recovered.");
+    } else {
+        messages.add(fmt::format("Welcome to quantum. Maze {} has {} rooms.", seed, maze.getRooms().size()));
+    }
+    messages.add("F1 explores the tilesheet, F2 toggles the scroll cache and F12 exports the map.",
+                 sf::Color(180, 180, 180));
+
+    bool       firstFrame = true;
+    bool       running    = true;
+    sf::Clock  inputClock;
+    sf::Clock  frameClock;
+    sf::Time   frameTime;
+    FrameTimes frameTimes;
+
+    while (running) {
+        InputFrame input;
+        if (replaying) {
+            if (!inputLog.nextFrame(input)) {
+                break;
+            }
+
+            // a replay ignores live input, but the window still has to be serviced
+            sf::Event event;
+            while (!headless && window.pollEvent(event)) {
+            }
+        } else {
+            input = pollInput(window, inputClock.getElapsedTime());
+            if (!recordFile.empty()) {
+                inputLog.addFrame(input);
+            }
+        }
 
-    while (window.isOpen()) {
-        sf::Event event;
-        while (window.pollEvent(event)) {
+        for (const auto &event : input.events) {
             switch (event.type) {
-            case sf::Event::Closed:
-                window.close();
+            case InputEvent::Type::CLOSED:
+                running = false;
                 break;
-            case sf::Event::KeyPressed:
-                switch (event.key.code) {
+            case InputEvent::Type::KEY_PRESSED:
+                switch (event.key) {
                 case sf::Keyboard::Escape:
-                    window.close();
+                    running = false;
                     break;
                 case sf::Keyboard::F1:
-                    explorer.run(&window);
+                    // the explorer runs its own loop on live input, so replays skip it
+                    if (replaying) {
+                        spdlog::info("skipping the tilesheet explorer while replaying");
+                    } else {
+                        explorer.run(&window);
+                    }
+                    break;
+                case sf::Keyboard::F2:
+                    useScrollCache = !useScrollCache;
+                    spdlog::info("scroll cache {}", useScrollCache ? "enabled" : "disabled");
+                    messages.add(fmt::format("Scroll cache {}.", useScrollCache ? "enabled" : "disabled"));
+                    break;
+                case sf::Keyboard::F12:
+                    compositor.exportPng("quantum-map.png");
+                    messages.add("Exported the map to quantum-map.png.");
+                    break;
+                case sf::Keyboard::PageUp:
+                    messages.scroll(5);
+                    break;
+                case sf::Keyboard::PageDown:
+                    messages.scroll(-5);
                     break;
                 default:
                     break;
                 }
                 break;
-            default:
+            case InputEvent::Type::MOUSE_WHEEL:
+                if (event.delta > 0) {
+                    zoom = zoom >= 1 ? std::min(zoom + 1, 8.f) : zoom * 2;
+                } else {
+                    zoom = zoom > 1 ? zoom - 1 : std::max(zoom / 2, 1.f / 64);
+                }
                 break;
             }
         }
 
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
-            viewDesiredPosition.y -= 1;
+        // pan faster when zoomed out so that crossing the map takes the same time
+        float viewStep = std::max(1.f, 1.f / zoom);
+
+        if (input.keys & InputFrame::UP) {
+            viewDesiredPosition.y -= viewStep;
         }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
-            viewDesiredPosition.y += 1;
+        if (input.keys & InputFrame::DOWN) {
+            viewDesiredPosition.y += viewStep;
         }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
-            viewDesiredPosition.x -= 1;
+        if (input.keys & InputFrame::LEFT) {
+            viewDesiredPosition.x -= viewStep;
         }
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
-            viewDesiredPosition.x += 1;
+        if (input.keys & InputFrame::RIGHT) {
+            viewDesiredPosition.x += viewStep;
         }
 
-        window.clear();
+        // keep the torch in the cell at the centre of the screen
+        lights.moveLight(torch, sf::Vector2u(std::max(viewPosition.x, 0.f), std::max(viewPosition.y, 0.f)));
+        lights.apply(tilemap);
 
-        // draw the Tilemap to the window
-        tilemap.draw(window, sf::FloatRect(0, 0, 1920, 1080), viewPosition, sf::Vector2u(2, 2));
-        window.display();
+        target.clear();
+
+        // draw the Tilemap to the window, at the size it was recorded at when replaying
+        sf::FloatRect screen(0, 0, windowSize.x, windowSize.y);
+        sf::Vector2u  scale(static_cast<sf::Uint32>(zoom), static_cast<sf::Uint32>(zoom));
+        if (zoom < 1) {
+            lod.draw(target, screen, viewPosition, zoom);
+        } else if (useScrollCache) {
+            scrollCache.draw(target, screen, viewPosition, scale);
+        } else {
+            tilemap.draw(target, screen, viewPosition, scale);
+        }
+
+        // entities are too small to be worth drawing once the map is zoomed out
+        if (zoom >= 1) {
+            entities.draw(target, *tilemap.getTilesheet(), screen, viewPosition, scale);
+        }
+        minimap.explore(sf::IntRect(viewPosition.x - 16, viewPosition.y - 16, 32, 32));
+        minimap.draw(target, sf::FloatRect(windowSize.x - 410.f, 10, 400, 400));
+
+        auto hud = fmt::format("{:.2f}ms  zoom {}  cell {:.0f}, {:.0f}",
+                               frameTime.asMicroseconds() / 1000.f,
+                               zoom,
+                               viewPosition.x,
+                               viewPosition.y);
+        const auto &hudLayout = text.getScratchLayout(hud);
+        text.addRect(sf::FloatRect(10, 10, hudLayout.size.x + 12, text.getLineSpacing() + 8), sf::Color(0, 0, 0, 160));
+        text.addLayout(hudLayout, sf::Vector2f(16, 14));
+        messages.draw(text, sf::FloatRect(10, target.getSize().y - 190, 640, 180));
+        text.draw(target);
+
+        if (headless) {
+            offscreen.display();
+        } else {
+            window.display();
+        }
+
+        frameTime = frameClock.restart();
+        frameTimes.add(frameTime);
+
+        if (firstFrame) {
+            spdlog::info("time to first frame: {}ms", startupClock.getElapsedTime().asMilliseconds());
+            firstFrame = false;
+        }
+
+        assets.update();
+
+        // there are no turns yet, so every frame is one
+        journal.endTurn();
 
         // move the view towards the desired position
         viewPosition += (viewDesiredPosition - viewPosition) * viewSpeed;
     }
 
+    if (window.isOpen()) {
+        window.close();
+    }
+
+    if (!recordFile.empty() && !inputLog.save(recordFile)) {
+        return EXIT_FAILURE;
+    }
+
+    frameTimes.report(replaying ? "replay frame times" : "frame times");
+
     return EXIT_SUCCESS;
 }
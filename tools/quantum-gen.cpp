@@ -0,0 +1,797 @@
+// quantum-gen generates mazes without a window, sweeping ranges of seeds and
+// maze sizes across every core, and writes layout metrics for each one as CSV or
+// JSON so that good seeds can be picked out of tens of thousands. Each maze can
+// also be dumped as a binary level file.
+//
+// With a world file, the mazes are also saved side by side into one paged world,
+// a window each, and a camera then pans across the world loading the window under
+// it, prefetching the chunks ahead of it from its velocity, to measure streaming.
+//
+// --bench-layout times the cell layouts a Grid can use, row by row, tiled and
+// Morton order, on the code that does the two kinds of work over maze cells:
+// Autotile::getMasks, the 3x3 stencil of Autotile::render, and floodRelabel, the
+// search Maze merges regions with. Each size is measured on the maze of the first
+// seed.
+//
+// --engine terrain generates overworld terrain instead of mazes. The map of the
+// first seed at each size is generated with scalar noise on one thread, then with
+// scalar and AVX2 noise on more and more threads, which must all give the same
+// tiles, and each is timed in noise samples per second.
+//
+// Each worker thread reuses one maze and regenerates it for every seed. Every
+// allocation is counted, and the allocations made while regenerating are written
+// out with the metrics, which should be 0 once the buffers of each maze have grown
+// to fit. --check-allocations generates every maze twice, the first time to grow
+// the buffers to fit its seed, and fails if the second run allocates at all. Only
+// generation on one thread is allocation free, so that is what is checked.
+//
+// Settings come from an optional TOML config file and are overridden by the
+// command line:
+//
+//   seed              = 1                       # first seed
+//   count             = 10000                   # number of seeds per size
+//   sizes             = ["200x200", "400x300"]  # maze sizes, WIDTHxHEIGHT
+//   threads           = 0                       # 0 uses every hardware thread
+//   engine            = "rooms"                 # rooms, caves, wfc or terrain
+//   partitioned       = false                   # place rooms in partitions, as on a huge map
+//   output            = "seeds.csv"             # results file
+//   format            = "csv"                   # csv or json, default from the output extension
+//   dump              = "levels"                # directory for binary level dumps
+//   world             = "world.bin"             # paged world file, needs a single size
+//   check_allocations = false                   # fail if a maze allocates when generated again
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <SFML/System/Clock.hpp>
+#include <cxxopts.hpp>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <toml.hpp>
+
+#include "Autotile.hpp"
+#include "FloodFill.hpp"
+#include "Grid.hpp"
+#include "Maze.hpp"
+#include "MazeMetrics.hpp"
+#include "PagedStore.hpp"
+#include "Parallel.hpp"
+#include "TerrainGenerator.hpp"
+
+namespace
+{
+
+// number of allocations made by the current thread
+thread_local sf::Uint64 allocations = 0;
+
+// the camera panning across a world moves this many cells a step, and prefetches
+// the chunks it will reach this many steps ahead
+const sf::Uint32 panStep      = PagedStore::CHUNK / 4;
+const sf::Uint32 panLookahead = 8;
+
+struct Settings
+{
+    sf::Uint32                firstSeed   = 1;
+    sf::Uint32                seedCount   = 1000;
+    std::vector<sf::Vector2u> sizes       = {sf::Vector2u(200, 200)};
+    sf::Uint32                threads     = 0;
+    std::string               engine      = "rooms";
+    bool                      partitioned = false;
+    std::string               output      = "quantum-gen.csv";
+    std::string               format;
+    std::string               dumpDirectory;
+    std::string               world;
+    bool                      checkAllocations = false;
+};
+
+// best times of the layout benchmark workloads, in microseconds
+struct LayoutTimes
+{
+    sf::Int64  stencil;  // Autotile::getMasks over every cell, the stencil of Autotile::render
+    sf::Int64  search;   // moving every region to a new label with floodRelabel, as Maze does
+    sf::Uint64 checksum; // sum of the masks and region count, the same for every layout
+};
+
+struct Result
+{
+    sf::Uint32   seed;
+    sf::Vector2u size;
+    MazeMetrics  metrics;
+    sf::Int32    milliseconds;
+    sf::Uint64   allocations; // allocations made while regenerating the maze
+};
+
+// level dumps start with this header, followed by one byte per cell, row by row
+struct DumpHeader
+{
+    char       magic[4] = {'Q', 'M', 'A', 'Z'};
+    sf::Uint32 version  = 1;
+    sf::Uint32 width;
+    sf::Uint32 height;
+    sf::Uint32 seed;
+};
+
+// parse a maze size written as WIDTHxHEIGHT
+std::optional<sf::Vector2u> parseSize(const std::string &text)
+{
+    unsigned int width;
+    unsigned int height;
+    char         separator;
+
+    if (std::sscanf(text.c_str(), "%u%c%u", &width, &separator, &height) != 3 || separator != 'x' || width < 3 ||
+        height < 3)
+    {
+        return std::nullopt;
+    }
+
+    return sf::Vector2u(width, height);
+}
+
+bool parseSizes(const std::vector<std::string> &texts, std::vector<sf::Vector2u> &sizes)
+{
+    sizes.clear();
+
+    for (const auto &text : texts) {
+        auto size = parseSize(text);
+        if (!size) {
+            spdlog::error("quantum-gen: invalid maze size '{}', expected WIDTHxHEIGHT", text);
+            return false;
+        }
+
+        sizes.push_back(*size);
+    }
+
+    return true;
+}
+
+bool loadConfig(const std::string &filename, Settings &settings)
+{
+    auto config = toml::parse(filename);
+
+    if (config.contains("seed")) {
+        settings.firstSeed = toml::find<sf::Uint32>(config, "seed");
+    }
+
+    if (config.contains("count")) {
+        settings.seedCount = toml::find<sf::Uint32>(config, "count");
+    }
+
+    if (config.contains("sizes")) {
+        if (!parseSizes(toml::find<std::vector<std::string>>(config, "sizes"), settings.sizes)) {
+            return false;
+        }
+    }
+
+    if (config.contains("threads")) {
+        settings.threads = toml::find<sf::Uint32>(config, "threads");
+    }
+
+    if (config.contains("engine")) {
+        settings.engine = toml::find<std::string>(config, "engine");
+    }
+
+    if (config.contains("partitioned")) {
+        settings.partitioned = toml::find<bool>(config, "partitioned");
+    }
+
+    if (config.contains("output")) {
+        settings.output = toml::find<std::string>(config, "output");
+    }
+
+    if (config.contains("format")) {
+        settings.format = toml::find<std::string>(config, "format");
+    }
+
+    if (config.contains("dump")) {
+        settings.dumpDirectory = toml::find<std::string>(config, "dump");
+    }
+
+    if (config.contains("world")) {
+        settings.world = toml::find<std::string>(config, "world");
+    }
+
+    if (config.contains("check_allocations")) {
+        settings.checkAllocations = toml::find<bool>(config, "check_allocations");
+    }
+
+    return true;
+}
+
+bool dumpMaze(const std::filesystem::path &path, const Maze &maze, sf::Uint32 seed)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        spdlog::error("quantum-gen: failed to open {}", path.string());
+        return false;
+    }
+
+    DumpHeader header;
+    header.width  = maze.getSize().x;
+    header.height = maze.getSize().y;
+    header.seed   = seed;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<sf::Uint8> row(header.width);
+    auto                   cells = maze.getCells();
+
+    for (sf::Uint32 y = 0; y < header.height; y++) {
+        auto cellRow = cells.row(y);
+        for (sf::Uint32 x = 0; x < header.width; x++) {
+            row[x] = static_cast<sf::Uint8>(cellRow[x]);
+        }
+
+        file.write(reinterpret_cast<const char *>(row.data()), row.size());
+    }
+
+    return file.good();
+}
+
+// pan a camera the size of a maze diagonally across the world, loading the window
+// under it at every step, and report how long the steps took
+void panWorld(PagedStore &world, const sf::Vector2u &size)
+{
+    Maze maze(size);
+    maze.getContext().setThreads(1);
+
+    sf::Vector2u range = world.getSize() - size;
+    sf::Uint32   steps = std::max(range.x, range.y) / panStep + 1;
+
+    sf::Clock  clock;
+    sf::Uint64 slowest = 0;
+
+    for (sf::Uint32 step = 0; step < steps; step++) {
+        sf::Vector2u offset(std::min(step * panStep, range.x), std::min(step * panStep, range.y));
+
+        // the camera keeps moving the same way, so its next windows are ahead of it
+        // along the diagonal
+        sf::Vector2i velocity(offset.x < range.x ? panStep : 0, offset.y < range.y ? panStep : 0);
+        world.prefetch(sf::IntRect(sf::Vector2i(offset), sf::Vector2i(size)),
+                       velocity * static_cast<int>(panLookahead));
+
+        sf::Clock stepClock;
+        if (!maze.loadWindow(world, offset)) {
+            return;
+        }
+        slowest = std::max<sf::Uint64>(slowest, stepClock.getElapsedTime().asMicroseconds());
+    }
+
+    spdlog::info("quantum-gen: panned across the world in {} steps, {}ms, slowest step {}us, {} pages resident",
+                 steps,
+                 clock.getElapsedTime().asMilliseconds(),
+                 slowest,
+                 world.getResidentPages());
+}
+
+// time Autotile::getMasks and Maze's region flood fill on a copy of the maze's
+// cells stored in Layout, taking the best of repeats runs of each
+template <typename Layout>
+LayoutTimes benchLayout(const Maze &maze, sf::Uint32 repeats)
+{
+    auto size  = maze.getSize();
+    auto cells = maze.getCells();
+
+    // both grids have a border, of walls around the cells and of 0 around the
+    // labels, as the grids of a Maze do
+    Grid<Cell, Layout>        grid(size, Cell::WALL, 1);
+    Grid<sf::Uint32, Layout>  labels(size, 0, 1);
+    Grid<sf::Uint16>          masks(size);
+    std::vector<sf::Vector2i> queue;
+
+    for (sf::Uint32 y = 0; y < size.y; y++) {
+        for (sf::Uint32 x = 0; x < size.x; x++) {
+            grid(x, y) = cells.row(y)[x];
+        }
+    }
+
+    LayoutTimes times = {std::numeric_limits<sf::Int64>::max(), std::numeric_limits<sf::Int64>::max(), 0};
+
+    for (sf::Uint32 run = 0; run < repeats; run++) {
+        sf::Clock stencilClock;
+        Autotile::getMasks(grid, masks.view());
+        times.stencil = std::min(times.stencil, stencilClock.getElapsedTime().asMicroseconds());
+
+        // every open cell starts labelled 1, and each region is moved to a label
+        // of its own the way Maze merges regions
+        for (sf::Uint32 y = 0; y < size.y; y++) {
+            for (sf::Uint32 x = 0; x < size.x; x++) {
+                labels(x, y) = grid(x, y) != Cell::WALL;
+            }
+        }
+
+        sf::Clock  searchClock;
+        sf::Uint32 regions = 0;
+
+        for (int y = 0; y < static_cast<int>(size.y); y++) {
+            for (int x = 0; x < static_cast<int>(size.x); x++) {
+                if (labels(x, y) == 1) {
+                    regions++;
+                    floodRelabel(labels, sf::Vector2i(x, y), 1, regions + 1, queue);
+                }
+            }
+        }
+
+        times.search = std::min(times.search, searchClock.getElapsedTime().asMicroseconds());
+
+        times.checksum = regions;
+        for (auto mask : masks.view().elements()) {
+            times.checksum += mask;
+        }
+    }
+
+    return times;
+}
+
+// compare the cell layouts on the maze of the first seed of every size
+bool benchLayouts(const Settings &settings)
+{
+    const sf::Uint32 repeats = 5;
+
+    for (const auto &size : settings.sizes) {
+        Maze maze(size);
+        maze.getContext().setThreads(1);
+        maze.generate(settings.firstSeed);
+
+        std::pair<const char *, LayoutTimes> results[] = {
+            {"row major", benchLayout<RowMajor>(maze, repeats)},
+            {"tiled 8x8", benchLayout<Tiled<8>>(maze, repeats)},
+            {"morton", benchLayout<Morton>(maze, repeats)},
+        };
+
+        for (const auto &[name, times] : results) {
+            spdlog::info("quantum-gen: {}x{} {:<9}  stencil {:>7}us  search {:>7}us",
+                         size.x,
+                         size.y,
+                         name,
+                         times.stencil,
+                         times.search);
+
+            if (times.checksum != results[0].second.checksum) {
+                spdlog::error("quantum-gen: {} gave different results to row major", name);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// check that terrain is the same on every number of threads and with either noise
+// path, on the map of the first seed of every size, and time each of them
+bool benchTerrain(const Settings &settings)
+{
+    const sf::Uint32 repeats = 3;
+
+    std::vector<sf::Uint32> threadCounts;
+    for (sf::Uint32 threads = 1; threads < getThreadCount(); threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(getThreadCount());
+
+    TerrainGenerator terrain;
+    terrain.setSeed(settings.firstSeed);
+
+    for (const auto &size : settings.sizes) {
+        Grid<sf::Uint32> reference(size);
+        Grid<sf::Uint32> tiles(size);
+
+        terrain.setVectorised(false);
+        terrain.generate(reference.view(), sf::Vector2i(0, 0), 1);
+
+        for (bool vectorised : {false, true}) {
+            terrain.setVectorised(vectorised);
+            if (vectorised && !terrain.isVectorised()) {
+                spdlog::warn("quantum-gen: the CPU has no AVX2, only scalar noise was checked");
+                continue;
+            }
+
+            const char *noise = vectorised ? "avx2" : "scalar";
+
+            for (auto threads : threadCounts) {
+                sf::Int64 best = std::numeric_limits<sf::Int64>::max();
+
+                for (sf::Uint32 repeat = 0; repeat < repeats; repeat++) {
+                    tiles.fill(0);
+
+                    sf::Clock clock;
+                    terrain.generate(tiles.view(), sf::Vector2i(0, 0), threads);
+                    best = std::min(best, clock.getElapsedTime().asMicroseconds());
+                }
+
+                // every tile takes a sample of height and one of moisture
+                double samples = 2.0 * size.x * size.y / std::max<sf::Int64>(best, 1);
+
+                spdlog::info("quantum-gen: terrain {}x{} {:<6} {:>3} threads  {:>8}us  {:.1f}M samples a second",
+                             size.x,
+                             size.y,
+                             noise,
+                             threads,
+                             best,
+                             samples);
+
+                sf::Uint64 differences = 0;
+                for (sf::Uint32 y = 0; y < size.y; y++) {
+                    for (sf::Uint32 x = 0; x < size.x; x++) {
+                        differences += tiles(x, y) != reference(x, y);
+                    }
+                }
+
+                if (differences > 0) {
+                    spdlog::error("quantum-gen: {} noise on {} threads differs from scalar on one thread in {} tiles",
+                                  noise,
+                                  threads,
+                                  differences);
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool writeCsv(const std::string &filename, const std::vector<Result> &results)
+{
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        spdlog::error("quantum-gen: failed to open {}", filename);
+        return false;
+    }
+
+    file << "seed,width,height,rooms,floor_ratio,regions,connectivity,dead_ends,longest_path,milliseconds,"
+            "allocations\n";
+
+    for (const auto &result : results) {
+        const auto &metrics = result.metrics;
+        file << fmt::format("{},{},{},{},{:.4f},{},{:.4f},{},{},{},{}\n",
+                            result.seed,
+                            result.size.x,
+                            result.size.y,
+                            metrics.rooms,
+                            metrics.floorRatio,
+                            metrics.regions,
+                            metrics.connectivity,
+                            metrics.deadEnds,
+                            metrics.longestPath,
+                            result.milliseconds,
+                            result.allocations);
+    }
+
+    return file.good();
+}
+
+bool writeJson(const std::string &filename, const std::vector<Result> &results)
+{
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        spdlog::error("quantum-gen: failed to open {}", filename);
+        return false;
+    }
+
+    file << "[\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &result  = results[i];
+        const auto &metrics = result.metrics;
+
+        file << fmt::format("  {{\"seed\": {}, \"width\": {}, \"height\": {}, \"rooms\": {}, \"floor_ratio\": {:.4f}, "
+                            "\"regions\": {}, \"connectivity\": {:.4f}, \"dead_ends\": {}, \"longest_path\": {}, "
+                            "\"milliseconds\": {}, \"allocations\": {}}}{}\n",
+                            result.seed,
+                            result.size.x,
+                            result.size.y,
+                            metrics.rooms,
+                            metrics.floorRatio,
+                            metrics.regions,
+                            metrics.connectivity,
+                            metrics.deadEnds,
+                            metrics.longestPath,
+                            result.milliseconds,
+                            result.allocations,
+                            i + 1 < results.size() ? "," : "");
+    }
+
+    file << "]\n";
+
+    return file.good();
+}
+
+} // namespace
+
+// count every allocation, to check that regenerating a maze does not allocate
+void *operator new(size_t size)
+{
+    allocations++;
+
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+
+    throw std::bad_alloc();
+}
+
+// not inlined, or GCC takes the free for a mismatch with the new it was paired with
+[[gnu::noinline]] void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+int main(int argc, char **argv)
+{
+    cxxopts::Options options("quantum-gen", "Generate mazes for a range of seeds and sizes and measure their layouts");
+
+    // clang-format off
+    options.add_options()
+        ("c,config", "TOML file to read settings from", cxxopts::value<std::string>())
+        ("s,seed", "first seed", cxxopts::value<sf::Uint32>())
+        ("n,count", "number of seeds per size", cxxopts::value<sf::Uint32>())
+        ("size", "maze size as WIDTHxHEIGHT, can be given more than once", cxxopts::value<std::vector<std::string>>())
+        ("j,threads", "number of threads, 0 for every hardware thread", cxxopts::value<sf::Uint32>())
+        ("e,engine", "rooms, caves, wfc or terrain", cxxopts::value<std::string>())
+        ("p,partitioned", "place rooms in partitions of the maze, the way huge maps are placed in parallel")
+        ("o,output", "file to write the results to", cxxopts::value<std::string>())
+        ("f,format", "csv or json, by default from the output file extension", cxxopts::value<std::string>())
+        ("dump", "directory to write a binary dump of every maze to", cxxopts::value<std::string>())
+        ("bench-layout", "time row major, tiled and Morton cell layouts instead of sweeping seeds")
+        ("world", "paged world file to save the mazes into side by side and pan across", cxxopts::value<std::string>())
+        ("check-allocations", "generate every maze twice and fail if the second run allocates")
+        ("v,verbose", "log maze generation")
+        ("h,help", "show this help");
+    // clang-format on
+
+    Settings settings;
+    bool     benchmark = false;
+
+    try {
+        auto args = options.parse(argc, argv);
+
+        if (args.count("help")) {
+            fmt::print("{}\n", options.help());
+            return 0;
+        }
+
+        if (args.count("config") && !loadConfig(args["config"].as<std::string>(), settings)) {
+            return 1;
+        }
+
+        if (args.count("seed")) {
+            settings.firstSeed = args["seed"].as<sf::Uint32>();
+        }
+
+        if (args.count("count")) {
+            settings.seedCount = args["count"].as<sf::Uint32>();
+        }
+
+        if (args.count("size") && !parseSizes(args["size"].as<std::vector<std::string>>(), settings.sizes)) {
+            return 1;
+        }
+
+        if (args.count("threads")) {
+            settings.threads = args["threads"].as<sf::Uint32>();
+        }
+
+        if (args.count("engine")) {
+            settings.engine = args["engine"].as<std::string>();
+        }
+
+        if (args.count("partitioned")) {
+            settings.partitioned = true;
+        }
+
+        if (args.count("output")) {
+            settings.output = args["output"].as<std::string>();
+        }
+
+        if (args.count("format")) {
+            settings.format = args["format"].as<std::string>();
+        }
+
+        if (args.count("dump")) {
+            settings.dumpDirectory = args["dump"].as<std::string>();
+        }
+
+        if (args.count("world")) {
+            settings.world = args["world"].as<std::string>();
+        }
+
+        if (args.count("check-allocations")) {
+            settings.checkAllocations = true;
+        }
+
+        benchmark = args.count("bench-layout") > 0;
+
+        spdlog::set_level(args.count("verbose") ? spdlog::level::debug : spdlog::level::info);
+    } catch (const std::exception &e) {
+        spdlog::error("quantum-gen: {}", e.what());
+        return 1;
+    }
+
+    if (settings.format.empty()) {
+        settings.format = std::filesystem::path(settings.output).extension() == ".json" ? "json" : "csv";
+    }
+
+    if (settings.format != "csv" && settings.format != "json") {
+        spdlog::error("quantum-gen: unknown format '{}', expected csv or json", settings.format);
+        return 1;
+    }
+
+    if (settings.engine != "rooms" && settings.engine != "caves" && settings.engine != "wfc" &&
+        settings.engine != "terrain")
+    {
+        spdlog::error("quantum-gen: unknown engine '{}', expected rooms, caves, wfc or terrain", settings.engine);
+        return 1;
+    }
+
+    if (benchmark) {
+        return benchLayouts(settings) ? 0 : 1;
+    }
+
+    if (settings.engine == "terrain") {
+        return benchTerrain(settings) ? 0 : 1;
+    }
+
+    if (!settings.dumpDirectory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(settings.dumpDirectory, error);
+        if (error) {
+            spdlog::error("quantum-gen: failed to create {}: {}", settings.dumpDirectory, error.message());
+            return 1;
+        }
+    }
+
+    // the world is a grid of windows the size of the mazes, as near square as the
+    // number of seeds allows
+    PagedStore world;
+    std::mutex worldMutex;
+    sf::Uint32 worldColumns = 0;
+
+    if (!settings.world.empty()) {
+        if (settings.sizes.size() != 1) {
+            spdlog::error("quantum-gen: a world needs a single maze size");
+            return 1;
+        }
+
+        worldColumns = static_cast<sf::Uint32>(std::ceil(std::sqrt(settings.seedCount)));
+
+        auto       size = settings.sizes[0];
+        sf::Uint32 rows = (settings.seedCount + worldColumns - 1) / worldColumns;
+
+        if (!world.open(settings.world, sf::Vector2u(worldColumns * size.x, rows * size.y), sizeof(Cell))) {
+            return 1;
+        }
+    }
+
+    sf::Uint32 jobs    = settings.seedCount * settings.sizes.size();
+    sf::Uint32 threads = settings.threads == 0 ? getThreadCount() : settings.threads;
+
+    spdlog::info("quantum-gen: generating {} mazes on {} threads", jobs, threads);
+
+    std::vector<Result>     results(jobs);
+    std::atomic<sf::Uint32> done(0);
+    std::atomic<bool>       failed(false);
+    std::atomic<sf::Uint32> allocating(0);
+    sf::Clock               clock;
+
+    // every maze is independent, and generation time varies with the seed, so
+    // jobs are handed out one at a time
+    parallelForEach(
+        0,
+        jobs,
+        [&](sf::Uint32 job) {
+            auto &result = results[job];
+            result.seed  = settings.firstSeed + job % settings.seedCount;
+            result.size  = settings.sizes[job / settings.seedCount];
+
+            // jobs are handed out in order, so a thread only needs a new maze when
+            // the sweep moves on to the next size. Each maze is generated on one
+            // thread, since the sweep already keeps every core busy.
+            thread_local std::unique_ptr<Maze> maze;
+            thread_local CaveGenerator         caves;
+            thread_local WfcGenerator          wfc;
+            if (!maze || maze->getSize() != result.size) {
+                maze = std::make_unique<Maze>(result.size);
+                maze->getContext().setThreads(1);
+                maze->setParallelRooms(settings.partitioned);
+            }
+
+            auto generate = [&]() {
+                if (settings.engine == "caves") {
+                    maze->generateCaves(result.seed, caves);
+                } else if (settings.engine == "wfc") {
+                    maze->generateWfc(result.seed, wfc);
+                } else {
+                    maze->regenerate(result.seed);
+                }
+            };
+
+            // warm up on the same seed, and grow the arena to what it used, so the
+            // buffers already fit when counted
+            if (settings.checkAllocations) {
+                generate();
+                maze->getContext().reset();
+            }
+
+            sf::Clock  mazeClock;
+            sf::Uint64 before = allocations;
+
+            generate();
+
+            result.allocations  = allocations - before;
+            result.metrics      = measureMaze(*maze);
+            result.milliseconds = mazeClock.getElapsedTime().asMilliseconds();
+
+            if (result.allocations > 0) {
+                allocating++;
+            }
+
+            if (!settings.dumpDirectory.empty()) {
+                auto name = fmt::format("maze-{}x{}-{}.bin", result.size.x, result.size.y, result.seed);
+                if (!dumpMaze(std::filesystem::path(settings.dumpDirectory) / name, *maze, result.seed)) {
+                    failed = true;
+                }
+            }
+
+            // the store is not thread safe, so the windows are saved one at a time
+            if (world.isOpen()) {
+                sf::Uint32   window = job % settings.seedCount;
+                sf::Vector2u offset((window % worldColumns) * result.size.x, (window / worldColumns) * result.size.y);
+
+                std::lock_guard lock(worldMutex);
+                if (!maze->saveWindow(world, offset)) {
+                    failed = true;
+                }
+            }
+
+            auto count = ++done;
+            if (count % 1000 == 0) {
+                spdlog::info("quantum-gen: {} / {} mazes", count, jobs);
+            }
+        },
+        threads);
+
+    spdlog::info("quantum-gen: generated {} mazes in {}ms", jobs, clock.getElapsedTime().asMilliseconds());
+    if (settings.checkAllocations) {
+        if (allocating > 0) {
+            spdlog::error(
+                "quantum-gen: {} of {} mazes allocated when generated a second time", allocating.load(), jobs);
+            failed = true;
+        } else {
+            spdlog::info("quantum-gen: no maze allocated when generated a second time");
+        }
+    } else {
+        spdlog::info("quantum-gen: {} of {} regenerations allocated while buffers grew", allocating.load(), jobs);
+    }
+
+    if (world.isOpen()) {
+        world.flush();
+        panWorld(world, settings.sizes[0]);
+        world.close();
+
+        spdlog::info("quantum-gen: wrote {}", settings.world);
+    }
+
+    bool written = settings.format == "json" ? writeJson(settings.output, results) : writeCsv(settings.output, results);
+    if (!written) {
+        return 1;
+    }
+
+    spdlog::info("quantum-gen: wrote {}", settings.output);
+
+    return failed ? 1 : 0;
+}